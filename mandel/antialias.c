@@ -0,0 +1,205 @@
+#include "antialias.h"
+#include "render.h"
+#include "bitmap.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct antialias * antialias_create( int samples, int threshold )
+{
+	struct antialias *a = malloc(sizeof(*a));
+	if(!a) return 0;
+
+	memset(a,0,sizeof(*a));
+	a->samples = samples;
+	a->threshold = threshold;
+
+	return a;
+}
+
+void antialias_delete( struct antialias *a )
+{
+	free(a);
+}
+
+int antialias_run( struct render *r, palette_t palette, int *rgba )
+{
+	struct antialias *a = r->antialias;
+
+	// The samples are closer together than the pixels, and may need more precision.
+	a->precision = precision_select(r->precision,r->extent,r->step/a->samples,r->max);
+	a->rgba = rgba;
+	a->edges = 0;
+	a->extra = 0;
+
+	// Samples are colored just like the pixels, with the histogram of the image if it has one.
+	int *table = palette_table(palette,r->iters,r->width*r->height,r->max,render_pool(r));
+	if(!table) {
+		fprintf(stderr,"mandel: out of memory for the palette\n");
+		return 0;
+	}
+	a->table = table;
+
+	int result = render_threads(r,compute_antialias,(r->height+r->chunk-1)/r->chunk);
+
+	free(table);
+	a->table = 0;
+
+	return result;
+}
+
+/* Return true if the point at i,j differs from any of its neighbors by more than the threshold. */
+
+static int on_edge( struct render *r, int threshold, int i, int j )
+{
+	int n = r->iters[j*r->width+i];
+	int di, dj;
+
+	for(dj=-1;dj<=1;dj++) {
+		if(j+dj<0 || j+dj>=r->height) continue;
+		for(di=-1;di<=1;di++) {
+			if(i+di<0 || i+di>=r->width) continue;
+			int d = r->iters[(j+dj)*r->width+i+di] - n;
+			if(d>threshold || -d>threshold) return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+Add offset to the coordinate hi+lo, keeping what rounding loses in the new low part,
+so that the samples are as precise as the pixels.
+*/
+
+static double add_offset( double hi, double lo, double offset, double *newlo )
+{
+	double s = hi + offset;
+	double v = s - hi;
+	*newlo = lo + ((hi - (s - v)) + (offset - v));
+	return s;
+}
+
+// The buffers each thread keeps for one row of samples.
+struct samples {
+	double *xs;
+	double *xlo;
+	int *iters;
+	float *frac;
+	int *sums;
+};
+
+/*
+Supersample the run of edge pixels start..end-1 in row j.
+Every row of samples across the whole run goes to the kernel in one call.
+*/
+
+static void supersample_run( struct render *r, struct antialias *a, struct samples *s, int j, int start, int end, struct kernel_stats *stats )
+{
+	int n = a->samples;
+	int count = (end-start)*n;
+	double dx = (r->xmax - r->xmin)/r->width;
+	double dy = r->height>1 ? r->ys[1] - r->ys[0] : dx;
+	int i, k;
+
+	// The samples sit at the centers of an n x n grid over the pixel, which is centered on the pixel's own point.
+	for(i=start;i<end;i++) {
+		for(k=0;k<n;k++) {
+			int m = (i-start)*n + k;
+			s->xs[m] = add_offset(r->xs[i],r->xlo[i],((k+0.5)/n - 0.5)*dx,&s->xlo[m]);
+		}
+	}
+
+	memset(s->sums,0,(end-start)*3*sizeof(int));
+
+	for(k=0;k<n;k++) {
+		double ylo;
+		double y = add_offset(r->ys[j],r->ylo[j],((k+0.5)/n - 0.5)*dy,&ylo);
+
+		if(r->frac) {
+			kernel_row_smooth(r->kernel,a->precision,s->xs,s->xlo,y,ylo,count,r->max,s->iters,s->frac,stats);
+		} else {
+			kernel_row(r->kernel,a->precision,s->xs,s->xlo,y,ylo,count,r->max,s->iters,stats);
+		}
+
+		for(i=0;i<count;i++) {
+			int color = palette_color(a->table,r->max,s->iters[i],r->frac ? s->frac[i] : 0);
+			int *sum = &s->sums[(i/n)*3];
+			sum[0] += GET_RED(color);
+			sum[1] += GET_GREEN(color);
+			sum[2] += GET_BLUE(color);
+		}
+	}
+
+	for(i=start;i<end;i++) {
+		int *sum = &s->sums[(i-start)*3];
+		int total = n*n;
+		a->rgba[j*r->width+i] = MAKE_RGBA((sum[0]+total/2)/total,(sum[1]+total/2)/total,(sum[2]+total/2)/total,0);
+	}
+}
+
+/*
+Each thread takes chunks of rows from the work queue, finds the runs of edge pixels
+in each row, and supersamples them. Edges bunch up, so the queue does the balancing.
+*/
+
+void * compute_antialias( void *arg )
+{
+	struct thread_args *args = arg;
+	struct render *r = args->r;
+	struct antialias *a = r->antialias;
+	struct kernel_stats stats = {0,0,0};
+	struct samples s;
+	int width = r->width*a->samples;
+	long edges = 0, extra = 0;
+	int i, j, unit;
+
+	s.xs = malloc(width*sizeof(double));
+	s.xlo = malloc(width*sizeof(double));
+	s.iters = malloc(width*sizeof(int));
+	s.frac = malloc(width*sizeof(float));
+	s.sums = malloc(r->width*3*sizeof(int));
+
+	if(!s.xs || !s.xlo || !s.iters || !s.frac || !s.sums) {
+		fprintf(stderr,"mandel: out of memory in thread %d\n",args->tnumber+1);
+		exit(1);
+	}
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		for(j=start;j<end;j++) {
+			i = 0;
+			while(i<r->width) {
+				if(!on_edge(r,a->threshold,i,j)) {
+					i++;
+					continue;
+				}
+
+				int first = i;
+				while(i<r->width && on_edge(r,a->threshold,i,j)) i++;
+
+				supersample_run(r,a,&s,j,first,i,r->shortcuts ? &stats : 0);
+
+				edges += i-first;
+				extra += (long)(i-first)*a->samples*a->samples;
+			}
+		}
+	}
+
+	free(s.xs);
+	free(s.xlo);
+	free(s.iters);
+	free(s.frac);
+	free(s.sums);
+
+	__sync_fetch_and_add(&a->edges,edges);
+	__sync_fetch_and_add(&a->extra,extra);
+	render_add_stats(r,&stats);
+
+	return (void *) 1;
+}
@@ -0,0 +1,47 @@
+#ifndef ANTIALIAS_H
+#define ANTIALIAS_H
+
+#include "kernel.h"
+#include "palette.h"
+
+struct render;
+
+/*
+Adaptive anti-aliasing, after an image has been computed and colored.
+
+A pixel is on an edge if any of its eight neighbors has a count that differs
+from its own by more than "threshold". Only those pixels are supersampled,
+on a grid of samples x samples points spread evenly over the pixel, and their
+color becomes the average color of the samples. Everywhere else the one sample
+per pixel is already as good as supersampling would make it.
+A threshold below zero supersamples every pixel, for comparison.
+*/
+
+struct antialias {
+	int samples;
+	int threshold;
+
+	// What the threads need while they run.
+	const int *table;
+	int *rgba;
+	precision_t precision;
+
+	// Results: the pixels that were supersampled, and the samples taken for them.
+	long edges;
+	long extra;
+};
+
+struct antialias * antialias_create( int samples, int threshold );
+void               antialias_delete( struct antialias *a );
+
+/*
+Supersample the edges of the image computed in r, which has already been
+colored with "palette" into rgba, using the render's threads.
+Returns 0 on failure.
+*/
+int                antialias_run( struct render *r, palette_t palette, int *rgba );
+
+/* The thread body of antialias_run. */
+void *             compute_antialias( void *a );
+
+#endif
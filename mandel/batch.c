@@ -0,0 +1,300 @@
+#include "batch.h"
+#include "bitmap.h"
+#include "deepzoom.h"
+#include "reproject.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+// While frame n is computed, frame n-1 is written, so two of everything is enough.
+#define SLOTS 2
+
+// One finished frame, waiting to be colored and written.
+struct slot {
+	int *iters;
+	struct bitmap *bm;
+	int frame;
+	int full;
+};
+
+struct batch {
+	struct slot slots[SLOTS];
+	int width;
+	int height;
+	int max;
+	int frames;
+	palette_t palette;
+	const char *outfile;
+	int failed;
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+static double elapsed( struct timeval *start )
+{
+	struct timeval now;
+	gettimeofday(&now,0);
+	return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1000000.0;
+}
+
+static double ease( easing_t easing, double t )
+{
+	switch(easing) {
+		case EASING_IN:    return t*t;
+		case EASING_OUT:   return t*(2-t);
+		case EASING_INOUT: return t*t*(3-2*t);
+		case EASING_LINEAR:
+		default:           return t;
+	}
+}
+
+// How far along the path frame n is, from 0 to 1.
+static double path_position( struct zoom_path *path, int n )
+{
+	double t = path->frames>1 ? (double)n/(path->frames-1) : 0;
+	return ease(path->easing,t);
+}
+
+void zoom_path_frame( struct zoom_path *path, int n, double *x, double *y, double *scale )
+{
+	double t = path_position(path,n);
+
+	*x = path->xstart + t*(path->xend-path->xstart);
+	*y = path->ystart + t*(path->yend-path->ystart);
+	*scale = path->scale_start * pow(path->scale_end/path->scale_start,t);
+}
+
+// start + t*(end-start), where t is exact in high precision since it is a double.
+static int interpolate( struct hp *r, const char *start, const char *end, double t, int limbs )
+{
+	struct hp a, b, f;
+
+	if(!hp_from_string(&a,start,limbs)) return 0;
+	if(!hp_from_string(&b,end,limbs)) return 0;
+	hp_from_double(&f,t,limbs);
+
+	hp_sub(&b,&b,&a);
+	hp_mul(&b,&b,&f);
+	hp_add(r,&a,&b);
+	return 1;
+}
+
+int zoom_path_frame_hp( struct zoom_path *path, int n, struct hp *x, struct hp *y, int limbs )
+{
+	double t = path_position(path,n);
+
+	return interpolate(x,path->xstart_text,path->xend_text,t,limbs)
+	    && interpolate(y,path->ystart_text,path->yend_text,t,limbs);
+}
+
+/*
+The writer thread takes the frames in order as the renderer finishes them,
+colors them, saves them, and hands the slot back.
+*/
+
+static void * write_frames( void *a )
+{
+	struct batch *b = a;
+	int n;
+
+	for(n=0;n<b->frames;n++) {
+		struct slot *s = &b->slots[n%SLOTS];
+
+		pthread_mutex_lock(&b->lock);
+		while(!s->full) pthread_cond_wait(&b->changed,&b->lock);
+		pthread_mutex_unlock(&b->lock);
+
+		// A frame of -1 means the renderer gave up.
+		if(s->frame<0) break;
+
+		// The pool is busy with the next frame, so the palette pass runs right here.
+		if(!palette_apply_bitmap(b->palette,s->iters,0,b->width*b->height,b->max,s->bm,0)) {
+			fprintf(stderr,"mandel: couldn't color frame %d\n",s->frame+1);
+			b->failed = 1;
+		}
+
+		char filename[4096];
+		snprintf(filename,sizeof(filename),b->outfile,s->frame+1);
+
+		if(!bitmap_save(s->bm,filename)) {
+			fprintf(stderr,"mandel: couldn't write to %s: %s\n",filename,strerror(errno));
+			b->failed = 1;
+		}
+
+		pthread_mutex_lock(&b->lock);
+		s->full = 0;
+		pthread_cond_broadcast(&b->changed);
+		pthread_mutex_unlock(&b->lock);
+	}
+
+	return 0;
+}
+
+/* Wait for the writer to be done with a slot, then take it. */
+
+static void take_slot( struct batch *b, struct slot *s )
+{
+	pthread_mutex_lock(&b->lock);
+	while(s->full) pthread_cond_wait(&b->changed,&b->lock);
+	pthread_mutex_unlock(&b->lock);
+}
+
+/* Hand a finished slot to the writer. */
+
+static void give_slot( struct batch *b, struct slot *s, int frame )
+{
+	pthread_mutex_lock(&b->lock);
+	s->frame = frame;
+	s->full = 1;
+	pthread_cond_broadcast(&b->changed);
+	pthread_mutex_unlock(&b->lock);
+}
+
+int batch_run( struct render *r, struct bitmap *bm, engine_t engine, palette_t palette, struct zoom_path *path, int max, const char *outfile )
+{
+	struct batch b;
+	pthread_t writer;
+	struct timeval start;
+	int n, i, ok = 1;
+
+	memset(&b,0,sizeof(b));
+	b.width = r->width;
+	b.height = r->height;
+	b.max = max;
+	b.palette = palette;
+	b.frames = path->frames;
+	b.outfile = outfile;
+
+	// The caller's buffers are the first slot; the others are only needed for the batch.
+	int *own = r->iters;
+
+	for(i=0;i<SLOTS;i++) {
+		b.slots[i].iters = i==0 ? own : malloc(r->width*r->height*sizeof(int));
+		b.slots[i].bm = i==0 ? bm : bitmap_create_like(bm,r->width,r->height);
+		if(!b.slots[i].iters || !b.slots[i].bm) {
+			fprintf(stderr,"mandel: couldn't allocate a %dx%d frame: %s\n",r->width,r->height,strerror(errno));
+			ok = 0;
+		}
+	}
+
+	pthread_mutex_init(&b.lock,0);
+	pthread_cond_init(&b.changed,0);
+
+	if(ok && pthread_create(&writer,0,write_frames,&b)!=0) {
+		fprintf(stderr,"mandel: couldn't create the writer thread: %s\n",strerror(errno));
+		ok = 0;
+	}
+
+	if(ok) {
+		gettimeofday(&start,0);
+
+		for(n=0;n<path->frames;n++) {
+			struct slot *s = &b.slots[n%SLOTS];
+			double x, y, scale;
+			struct timeval frame_start;
+
+			take_slot(&b,s);
+			r->iters = s->iters;
+
+			zoom_path_frame(path,n,&x,&y,&scale);
+
+			// The doubles above have lost the digits a deep zoom needs, so the center comes from the text:
+			// all of it for the perturbation engine, and a double and what it leaves out for the others.
+			struct hp hx, hy;
+			int limbs = engine==ENGINE_PERTURB ? hp_limbs_for(2*scale/(r->width>r->height ? r->width : r->height)) : hp_limbs_for(ldexp(1,-160));
+
+			if(!zoom_path_frame_hp(path,n,&hx,&hy,limbs)) {
+				fprintf(stderr,"mandel: couldn't set the view of frame %d\n",n+1);
+				give_slot(&b,s,-1);
+				ok = 0;
+				break;
+			}
+
+			if(engine==ENGINE_PERTURB) {
+				if(!deepzoom_set_view_hp(r,&hx,&hy,scale,max)) {
+					fprintf(stderr,"mandel: couldn't set the view of frame %d\n",n+1);
+					give_slot(&b,s,-1);
+					ok = 0;
+					break;
+				}
+			} else {
+				double xlo, ylo;
+				hp_split(&hx,&x,&xlo);
+				hp_split(&hy,&y,&ylo);
+				render_set_view_parts(r,x,xlo,y,ylo,scale,max);
+			}
+
+			gettimeofday(&frame_start,0);
+
+			if(!render_run(r,engine)) {
+				give_slot(&b,s,-1);
+				ok = 0;
+				break;
+			}
+
+			printf("mandel: frame %d of %d: x=%.17g y=%.17g scale=%g computed in %.3fs in %s precision\n",n+1,path->frames,x,y,scale,elapsed(&frame_start),engine==ENGINE_PERTURB ? "perturbation" : precision_name(r->chosen));
+
+			if(r->reproject) {
+				long total = (long)r->width*r->height;
+				printf("mandel: frame %d reused %ld of %ld points (%.1f%%)\n",n+1,r->reproject->hits,total,100.0*r->reproject->hits/total);
+
+				// This slot is not taken again until the next frame is done with it.
+				reproject_remember(r->reproject,r);
+			}
+
+			give_slot(&b,s,n);
+		}
+
+		pthread_join(writer,0);
+
+		if(b.failed) ok = 0;
+
+		printf("mandel: %d frames in %.3fs\n",n,elapsed(&start));
+	}
+
+	r->iters = own;
+
+	for(i=0;i<SLOTS;i++) {
+		if(i==0) continue;
+		free(b.slots[i].iters);
+		if(b.slots[i].bm) bitmap_delete(b.slots[i].bm);
+	}
+
+	pthread_cond_destroy(&b.changed);
+	pthread_mutex_destroy(&b.lock);
+
+	return ok;
+}
+
+int easing_from_name( const char *name, easing_t *easing )
+{
+	if(!strcmp(name,"linear")) {
+		*easing = EASING_LINEAR;
+	} else if(!strcmp(name,"in")) {
+		*easing = EASING_IN;
+	} else if(!strcmp(name,"out")) {
+		*easing = EASING_OUT;
+	} else if(!strcmp(name,"inout")) {
+		*easing = EASING_INOUT;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * easing_name( easing_t easing )
+{
+	switch(easing) {
+		case EASING_LINEAR: return "linear";
+		case EASING_IN:     return "in";
+		case EASING_OUT:    return "out";
+		case EASING_INOUT:  return "inout";
+	}
+	return "unknown";
+}
@@ -0,0 +1,55 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "render.h"
+#include "palette.h"
+#include "hp.h"
+
+struct bitmap;
+
+/*
+A batch renders every frame of a zoom in one process, reusing the render,
+its threads, and two sets of buffers.  While one frame is being computed,
+a writer thread colors and saves the frame before it.
+*/
+
+typedef enum {
+	EASING_LINEAR,
+	EASING_IN,
+	EASING_OUT,
+	EASING_INOUT
+} easing_t;
+
+// A zoom from one view to another.
+// The center moves in a straight line, and the scale changes by the same ratio every step.
+struct zoom_path {
+	double xstart, ystart, scale_start;
+	double xend, yend, scale_end;
+	int frames;
+	easing_t easing;
+
+	// The centers as they were given, which the perturbation engine follows with every digit.
+	const char *xstart_text, *ystart_text;
+	const char *xend_text, *yend_text;
+};
+
+/* Return the center and scale of frame n (0-based) of the path. */
+void         zoom_path_frame( struct zoom_path *path, int n, double *x, double *y, double *scale );
+
+/* Return the center of frame n in high precision with the given number of limbs, from the text of the centers. Returns 0 if they are not numbers. */
+int          zoom_path_frame_hp( struct zoom_path *path, int n, struct hp *x, struct hp *y, int limbs );
+
+/*
+Render every frame of the path into files named by the pattern outfile,
+which must contain one %d for the frame number (starting at 1).
+The render's iteration buffer and bm (of the same size) are used for every other frame.
+Frames are colored with the given palette.
+Returns 0 on failure.
+*/
+int          batch_run( struct render *r, struct bitmap *bm, engine_t engine, palette_t palette, struct zoom_path *path, int max, const char *outfile );
+
+/* Convert between an easing and its name. Returns 0 if the name is unknown. */
+int          easing_from_name( const char *name, easing_t *easing );
+const char * easing_name( easing_t easing );
+
+#endif
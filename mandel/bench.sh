@@ -0,0 +1,139 @@
+#!/bin/sh
+#
+# Scaling benchmark for mandel, the automated version of report.txt.
+#
+# Runs the thread views A and B over a range of thread counts, and
+# mandelmovie over a range of process counts, repeating every point.
+# The "tiles" scenario runs mandelmovie with its shared tile queue instead.
+# Writes one row per point to bench.csv and bench.json with the median
+# and 95th percentile wall time, pixels and iterations per second, and
+# the speedup and efficiency relative to the smallest count.
+#
+# Everything can be changed from the environment, for example:
+#   THREADS="1 2 4" REPEATS=3 SCENARIOS="A B" MANDEL_OPTS="-S steal" ./bench.sh
+# or, to see how far pinned threads with their own memory scale on a NUMA machine,
+#   MANDEL_OPTS="-S static -b all -i" ./bench.sh
+#
+
+THREADS=${THREADS:-"1 2 3 4 5 10 20 50 100"}
+PROCESSES=${PROCESSES:-"1 2 3 4 5 10"}
+REPEATS=${REPEATS:-5}
+SCENARIOS=${SCENARIOS:-"A B movie"}
+MANDEL_OPTS=${MANDEL_OPTS:-""}
+OUTPUT=${OUTPUT:-bench}
+
+VIEW_A="-x -.5 -y .5 -s 1 -m 2000"
+VIEW_B="-x 0.2869325 -y 0.0142905 -s .000001 -W 1024 -H 1024 -m 1000"
+
+# mandelmovie renders 50 frames of 800x600.
+MOVIE_PIXELS=24000000
+
+RESULTS=$(mktemp)
+LOG=$(mktemp)
+trap 'rm -f $RESULTS $LOG mandel_bench.bmp mandel[0-9]*.bmp' EXIT
+
+now()
+{
+	date +%s.%N
+}
+
+# Run a command REPEATS times, appending "scenario workers pixels iterations seconds" for each run.
+# The iterations come from the "mandel: N iterations" lines of every image it makes.
+measure()
+{
+	scenario=$1
+	workers=$2
+	pixels=$3
+	shift 3
+
+	i=0
+	while [ $i -lt $REPEATS ]
+	do
+		start=$(now)
+		if ! "$@" > $LOG 2>&1
+		then
+			echo "bench: $* failed:" 1>&2
+			tail -5 $LOG 1>&2
+			exit 1
+		fi
+		end=$(now)
+
+		iterations=$(awk '/iterations over/ { sum += $2 } END { printf "%.0f", sum }' $LOG)
+		echo "$scenario $workers $pixels $iterations $start $end" | awk '{ printf "%s %s %s %s %.6f\n", $1, $2, $3, $4, $6-$5 }' >> $RESULTS
+
+		i=$((i+1))
+	done
+
+	echo "bench: $scenario with $workers done" 1>&2
+}
+
+for scenario in $SCENARIOS
+do
+	case $scenario in
+		A|B)
+			if [ $scenario = A ]; then view=$VIEW_A; pixels=250000; else view=$VIEW_B; pixels=1048576; fi
+			for n in $THREADS
+			do
+				measure $scenario $n $pixels ./mandel $view $MANDEL_OPTS -n $n -o mandel_bench.bmp
+			done
+			;;
+		movie)
+			for n in $PROCESSES
+			do
+				measure movie $n $MOVIE_PIXELS ./mandelmovie $n
+			done
+			;;
+		tiles)
+			for n in $PROCESSES
+			do
+				measure tiles $n $MOVIE_PIXELS ./mandelmovie -t 32 $n
+			done
+			;;
+		*)
+			echo "bench: unknown scenario $scenario" 1>&2
+			exit 1
+			;;
+	esac
+done
+
+# Sort each point's times, then summarize.
+sort -k1,1 -k2,2n -k5,5n $RESULTS | awk -v csv=$OUTPUT.csv -v json=$OUTPUT.json -v opts="$MANDEL_OPTS" '
+function summarize(   median, p95, speedup, efficiency, sep)
+{
+	# Nearest rank percentiles over the sorted times.
+	median = (count%2) ? t[(count+1)/2] : (t[count/2] + t[count/2+1])/2
+	p95 = t[int(0.95*count + 0.999999)]
+
+	if(first[key]=="") { first[key] = workers; basetime[key] = median }
+
+	speedup = basetime[key]/median
+	efficiency = speedup * first[key] / workers
+
+	printf "%s,%d,%d,%.6f,%.6f,%.0f,%.0f,%.3f,%.3f\n", key, workers, count, median, p95, pixels/median, iterations/median, speedup, efficiency >> csv
+
+	sep = rows++ ? ",\n" : ""
+	printf "%s    {\"scenario\": \"%s\", \"workers\": %d, \"repeats\": %d, \"median_s\": %.6f, \"p95_s\": %.6f, \"pixels_per_s\": %.0f, \"iterations_per_s\": %.0f, \"speedup\": %.3f, \"efficiency\": %.3f}", sep, key, workers, count, median, p95, pixels/median, iterations/median, speedup, efficiency >> json
+}
+
+BEGIN {
+	print "scenario,workers,repeats,median_s,p95_s,pixels_per_s,iterations_per_s,speedup,efficiency" > csv
+	printf "{\n  \"mandel_opts\": \"%s\",\n  \"results\": [\n", opts > json
+}
+
+{
+	if(count && ($1!=key || $2!=workers)) summarize()
+	if($1!=key || $2!=workers) { count = 0 }
+	key = $1
+	workers = $2
+	pixels = $3
+	iterations = $4
+	t[++count] = $5
+}
+
+END {
+	if(count) summarize()
+	printf "\n  ]\n}\n" >> json
+}
+'
+
+column -s, -t $OUTPUT.csv 2>/dev/null || cat $OUTPUT.csv
@@ -2,46 +2,322 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <immintrin.h>
 
 #include "bitmap.h"
+#include "pool.h"
+
+// The data starts on a page, so that every band of it can belong to one thread.
+#define PAGE_SIZE 4096
+
+// The number of pixels in a cache line, which is where each thread's band of pixels starts.
+#define LINE_PIXELS(m) (64*8/(m)->bits)
+
+// The tiles of the tiled layouts are TILE_SHIFT bits wide and high.
+#define TILE_SHIFT 6
+#define TILE_MASK (BITMAP_TILE-1)
 
 struct bitmap {
 	int width;
 	int height;
 	int *data;
+
+	bitmap_layout_t layout;
+
+	// The number of ints in data, which in the tiled layouts
+	// includes the parts of the edge tiles that are past the image.
+	long size;
+
+	// In the tiled layouts, the number of tiles across,
+	// and where in data each tile starts, in units of a whole tile.
+	int tiles_across;
+	int *slot;
+
+	// An indexed bitmap has no data, but 8 or 16-bit indices into a table of colors,
+	// and may be saved run-length encoded. Otherwise bits is 32.
+	int bits;
+	void *indices;
+	int *colors;
+	int ncolors;
+	int rle;
+
+	// The encoded file, kept from one bitmap_save to the next,
+	// so that its pages only have to be faulted in once.
+	unsigned char *file;
+};
+
+/* Where pixel x,y is in the data. x and y must be in range. */
+
+static inline long pixel_offset( struct bitmap *m, int x, int y )
+{
+	if(m->layout==BITMAP_ROWS) return (long)y*m->width + x;
+
+	long tile = m->slot[(y>>TILE_SHIFT)*m->tiles_across + (x>>TILE_SHIFT)];
+	return (tile<<(2*TILE_SHIFT)) + ((y&TILE_MASK)<<TILE_SHIFT) + (x&TILE_MASK);
+}
+
+/* Spread the bits of v apart, so that another number's bits can go in between. */
+
+static unsigned long spread_bits( unsigned long v )
+{
+	v &= 0xffffffff;
+	v = (v | (v<<16)) & 0x0000ffff0000ffffUL;
+	v = (v | (v<<8))  & 0x00ff00ff00ff00ffUL;
+	v = (v | (v<<4))  & 0x0f0f0f0f0f0f0f0fUL;
+	v = (v | (v<<2))  & 0x3333333333333333UL;
+	v = (v | (v<<1))  & 0x5555555555555555UL;
+	return v;
+}
+
+struct morton {
+	unsigned long key;
+	int tile;
 };
 
+static int compare_morton( const void *a, const void *b )
+{
+	const struct morton *x = a, *y = b;
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+/*
+Decide where each tile goes. Z-order keeps the tiles of an image that isn't
+a power of two square in the order of their Morton codes, but packed together.
+*/
+
+static int place_tiles( struct bitmap *m, int tiles_down )
+{
+	int ntiles = m->tiles_across*tiles_down;
+	int i;
+
+	m->slot = malloc(ntiles*sizeof(int));
+	if(!m->slot) return 0;
+
+	if(m->layout==BITMAP_TILES) {
+		for(i=0;i<ntiles;i++) m->slot[i] = i;
+		return 1;
+	}
+
+	struct morton *order = malloc(ntiles*sizeof(*order));
+	if(!order) return 0;
+
+	for(i=0;i<ntiles;i++) {
+		order[i].key = spread_bits(i % m->tiles_across) | (spread_bits(i / m->tiles_across)<<1);
+		order[i].tile = i;
+	}
+
+	qsort(order,ntiles,sizeof(*order),compare_morton);
+
+	for(i=0;i<ntiles;i++) m->slot[order[i].tile] = i;
+
+	free(order);
+	return 1;
+}
+
 struct bitmap * bitmap_create( int w, int h )
+{
+	return bitmap_create_layout(w,h,BITMAP_ROWS);
+}
+
+struct bitmap * bitmap_create_layout( int w, int h, bitmap_layout_t layout )
 {
 	struct bitmap *m;
 
 	m = malloc(sizeof *m);
 	if(!m) return 0;
 
-	m->data = malloc(w*h*sizeof(int));
-	if(!m->data) {
-		free(m);
+	memset(m,0,sizeof(*m));
+	m->width = w;
+	m->height = h;
+	m->layout = layout;
+	m->size = (long)w*h;
+	m->bits = 32;
+
+	if(layout!=BITMAP_ROWS) {
+		int tiles_down = (h+TILE_MASK)>>TILE_SHIFT;
+		m->tiles_across = (w+TILE_MASK)>>TILE_SHIFT;
+		m->size = (long)m->tiles_across*tiles_down*BITMAP_TILE*BITMAP_TILE;
+		if(!place_tiles(m,tiles_down)) {
+			bitmap_delete(m);
+			return 0;
+		}
+	}
+
+	if(posix_memalign((void**)&m->data,PAGE_SIZE,m->size*sizeof(int))) {
+		m->data = 0;
+		bitmap_delete(m);
 		return 0;
 	}
 
+	return m;
+}
+
+struct bitmap * bitmap_create_indexed( int w, int h, int bits )
+{
+	struct bitmap *m;
+
+	if(bits!=8 && bits!=16) return 0;
+
+	m = malloc(sizeof *m);
+	if(!m) return 0;
+
+	memset(m,0,sizeof(*m));
 	m->width = w;
 	m->height = h;
+	m->layout = BITMAP_ROWS;
+	m->size = (long)w*h;
+	m->bits = bits;
+
+	// Until the colors are set, every index is black.
+	m->colors = calloc(1<<bits,sizeof(int));
+	m->ncolors = 1<<bits;
+
+	if(!m->colors || posix_memalign(&m->indices,PAGE_SIZE,m->size*(bits/8))) {
+		m->indices = 0;
+		bitmap_delete(m);
+		return 0;
+	}
+
+	return m;
+}
+
+struct bitmap * bitmap_create_like( struct bitmap *b, int w, int h )
+{
+	struct bitmap *m;
+
+	if(b->bits==32) return bitmap_create_layout(w,h,b->layout);
+
+	m = bitmap_create_indexed(w,h,b->bits);
+	if(!m) return 0;
+
+	bitmap_set_colors(m,b->colors,b->ncolors);
+	m->rle = b->rle;
 
 	return m;
 }
 
 void bitmap_delete( struct bitmap *m )
 {
+	free(m->file);
+	free(m->slot);
 	free(m->data);
+	free(m->indices);
+	free(m->colors);
 	free(m);
 }
 
+int bitmap_bits( struct bitmap *m )
+{
+	return m->bits;
+}
+
+void * bitmap_indices( struct bitmap *m )
+{
+	return m->indices;
+}
+
+int bitmap_set_colors( struct bitmap *m, const int *colors, int ncolors )
+{
+	if(m->bits==32 || ncolors<1 || ncolors>(1<<m->bits)) return 0;
+
+	memcpy(m->colors,colors,ncolors*sizeof(int));
+	m->ncolors = ncolors;
+
+	return 1;
+}
+
+void bitmap_set_rle( struct bitmap *m, int rle )
+{
+	m->rle = rle;
+}
+
+/* The color of the pixel at this offset. */
+
+static int color_at( struct bitmap *m, long offset )
+{
+	switch(m->bits) {
+		case 8:  return m->colors[((unsigned char *)m->indices)[offset]];
+		case 16: return m->colors[((unsigned short *)m->indices)[offset]];
+		default: return m->data[offset];
+	}
+}
+
+/* The index of a color in the table of an indexed bitmap, or 0 if it isn't there. */
+
+static int index_of( struct bitmap *m, int color )
+{
+	int i;
+
+	for(i=0;i<m->ncolors;i++) {
+		if(m->colors[i]==color) return i;
+	}
+
+	return 0;
+}
+
+/* Put a value, which is a color or an index depending on the bitmap, at this offset. */
+
+static void store_at( struct bitmap *m, long offset, int value )
+{
+	switch(m->bits) {
+		case 8:  ((unsigned char *)m->indices)[offset] = value; break;
+		case 16: ((unsigned short *)m->indices)[offset] = value; break;
+		default: m->data[offset] = value; break;
+	}
+}
+
 void bitmap_reset( struct bitmap *m, int value )
 {
+	long i;
+
+	if(m->bits!=32) value = index_of(m,value);
+
+	for(i=0;i<m->size;i++) {
+		store_at(m,i,value);
+	}
+}
+
+// Each thread of bitmap_reset_threads fills one band of pixels.
+struct reset_job {
+	struct bitmap *m;
+	long start;
+	long end;
+	int value;
+};
+
+static void * reset_band( void *a )
+{
+	struct reset_job *job = a;
+	long i;
+
+	for(i=job->start;i<job->end;i++) {
+		store_at(job->m,i,job->value);
+	}
+
+	return (void *) 1;
+}
+
+void bitmap_reset_threads( struct bitmap *m, int value, struct pool *pool )
+{
+	int nthreads = pool_size(pool);
+	struct reset_job jobs[nthreads];
+	void *args[nthreads];
 	int i;
-	for(i=0;i<(m->width*m->height);i++) {
-		m->data[i] = value;
+
+	for(i=0;i<nthreads;i++) {
+		jobs[i].m = m;
+		jobs[i].start = pool_split(m->size,nthreads,i,LINE_PIXELS(m));
+		jobs[i].end = pool_split(m->size,nthreads,i+1,LINE_PIXELS(m));
+		jobs[i].value = m->bits==32 ? value : index_of(m,value);
+		args[i] = &jobs[i];
 	}
+
+	pool_run(pool,reset_band,args);
 }
 
 int bitmap_get( struct bitmap *m, int x, int y )
@@ -51,7 +327,7 @@ int bitmap_get( struct bitmap *m, int x, int y )
 	while(x<0)         x+=m->width;
 	while(y<0)         y+=m->height;
 
-	return m->data[y*m->width+x];
+	return color_at(m,pixel_offset(m,x,y));
 }
 
 void bitmap_set( struct bitmap *m, int x, int y, int value )
@@ -61,7 +337,7 @@ void bitmap_set( struct bitmap *m, int x, int y, int value )
 	while(x<0)         x+=m->width;
 	while(y<0)         y+=m->height;
 
-	m->data[y*m->width+x] = value;
+	store_at(m,pixel_offset(m,x,y),m->bits==32 ? value : index_of(m,value));
 }
 
 int bitmap_width( struct bitmap *m )
@@ -79,6 +355,46 @@ int * bitmap_data( struct bitmap *m )
 	return m->data;
 }
 
+bitmap_layout_t bitmap_layout( struct bitmap *m )
+{
+	return m->layout;
+}
+
+long bitmap_offset( struct bitmap *m, int x, int y )
+{
+	return pixel_offset(m,x,y);
+}
+
+int * bitmap_tile( struct bitmap *m, int x, int y, int *stride )
+{
+	*stride = m->layout==BITMAP_ROWS ? m->width : BITMAP_TILE;
+	return &m->data[pixel_offset(m,x & ~TILE_MASK,y & ~TILE_MASK)];
+}
+
+int bitmap_layout_from_name( const char *name, bitmap_layout_t *layout )
+{
+	if(!strcmp(name,"rows")) {
+		*layout = BITMAP_ROWS;
+	} else if(!strcmp(name,"tiles")) {
+		*layout = BITMAP_TILES;
+	} else if(!strcmp(name,"zorder")) {
+		*layout = BITMAP_ZORDER;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * bitmap_layout_name( bitmap_layout_t layout )
+{
+	switch(layout) {
+		case BITMAP_ROWS:   return "rows";
+		case BITMAP_TILES:  return "tiles";
+		case BITMAP_ZORDER: return "zorder";
+	}
+	return "unknown";
+}
+
 #pragma pack(1)
 struct bmp_header {
 	char	magic1;
@@ -99,7 +415,35 @@ struct bmp_header {
 	int	icolors;
 };
 
-int bitmap_save( struct bitmap *m, const char *path )
+static void fill_header( struct bmp_header *header, int width, int height )
+{
+	// Past 2GB the sizes don't fit in the header. Zero is allowed for imagesize,
+	// and readers go by the width and height anyway.
+	long bytes = (long)width*height*3;
+	if(bytes>INT_MAX) bytes = 0;
+
+	memset(header,0,sizeof(*header));
+	header->magic1 = 'B';
+	header->magic2 = 'M';
+	header->size   = bytes;
+	header->offset = sizeof(*header);
+	header->infosize = sizeof(*header)-14;
+	header->width = width;
+	header->height = height;
+	header->planes = 1;
+	header->bits = 24;
+	header->compression = 0;
+	header->imagesize = bytes;
+	header->xres = 1000;
+	header->yres = 1000;
+}
+
+/*
+The original encoder, one pixel at a time through bitmap_get.
+It is kept to check and benchmark the fast one against (see bitmap_bench.c).
+*/
+
+int bitmap_save_reference( struct bitmap *m, const char *path )
 {
 	FILE *file;
 	struct bmp_header header;
@@ -109,26 +453,14 @@ int bitmap_save( struct bitmap *m, const char *path )
 	file = fopen(path,"wb");
 	if(!file) return 0;
 
-	memset(&header,0,sizeof(header));
-	header.magic1 = 'B';
-	header.magic2 = 'M';
-	header.size   = m->width*m->height*3;
-	header.offset = sizeof(header);
-	header.infosize = sizeof(header)-14;
-	header.width = m->width;
-	header.height = m->height;
-	header.planes = 1;
-	header.bits = 24;
-	header.compression = 0;
-	header.imagesize = m->width*m->height*3;
-	header.xres = 1000;
-	header.yres = 1000;
+	fill_header(&header,m->width,m->height);
 
 	fwrite(&header,1,sizeof(header),file);
 
 	/* if the scanline is not a multiple of four, round it up. */
 	int padlength = 4 - (m->width*3)%4;
 	if(padlength==4) padlength=0;
+	static const unsigned char zeros[4] = {0,0,0,0};
 
 	scanline = malloc(header.width*3);
 
@@ -141,7 +473,7 @@ int bitmap_save( struct bitmap *m, const char *path )
 			*s++ = GET_RED(rgba);
 		}
 		fwrite(scanline,1,m->width*3,file);
-		fwrite(scanline,1,padlength,file);
+		fwrite(zeros,1,padlength,file);
 	}
 
 	free(scanline);
@@ -150,6 +482,464 @@ int bitmap_save( struct bitmap *m, const char *path )
 	return 1;
 }
 
+/*
+Convert n RGBA pixels to BGR.
+In memory, each RGBA int is already the bytes blue, green, red, alpha,
+so all there is to do is to drop every fourth byte.
+Each vector store is wider than the bytes it produces, so the vector loops stop
+while there are still enough pixels left for the rest of the row to overwrite
+the extra bytes. Nothing is ever written past the end of the 3*n bytes.
+*/
+
+static void rgba_to_bgr_scalar( const int *src, int n, unsigned char *dst )
+{
+	int i;
+	for(i=0;i<n;i++) {
+		int rgba = src[i];
+		*dst++ = GET_BLUE(rgba);
+		*dst++ = GET_GREEN(rgba);
+		*dst++ = GET_RED(rgba);
+	}
+}
+
+__attribute__((target("ssse3")))
+static void rgba_to_bgr_ssse3( const int *src, int n, unsigned char *dst )
+{
+	const __m128i shuffle = _mm_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+	int i;
+
+	// Four pixels in, twelve bytes out, and four more bytes that the next two pixels overwrite.
+	for(i=0;i+6<=n;i+=4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src+i));
+		_mm_storeu_si128((__m128i *)dst,_mm_shuffle_epi8(v,shuffle));
+		dst += 12;
+	}
+
+	rgba_to_bgr_scalar(src+i,n-i,dst);
+}
+
+__attribute__((target("avx2")))
+static void rgba_to_bgr_avx2( const int *src, int n, unsigned char *dst )
+{
+	// Pack twelve bytes to the bottom of each 128-bit half, then move the halves together.
+	const __m256i shuffle = _mm256_setr_epi8(0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1,
+	                                         0,1,2,4,5,6,8,9,10,12,13,14,-1,-1,-1,-1);
+	const __m256i gather = _mm256_setr_epi32(0,1,2,4,5,6,3,7);
+	int i;
+
+	// Eight pixels in, twenty-four bytes out, and eight more bytes that the next three pixels overwrite.
+	for(i=0;i+11<=n;i+=8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(src+i));
+		v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v,shuffle),gather);
+		_mm256_storeu_si256((__m256i *)dst,v);
+		dst += 24;
+	}
+
+	rgba_to_bgr_ssse3(src+i,n-i,dst);
+}
+
+static void rgba_to_bgr( const int *src, int n, unsigned char *dst )
+{
+	if(__builtin_cpu_supports("avx2")) {
+		rgba_to_bgr_avx2(src,n,dst);
+	} else if(__builtin_cpu_supports("ssse3")) {
+		rgba_to_bgr_ssse3(src,n,dst);
+	} else {
+		rgba_to_bgr_scalar(src,n,dst);
+	}
+}
+
+#define ALIGNMENT 64
+
+// Each thread converts a band of rows into the shared file buffer.
+struct encode_job {
+	struct bitmap *m;
+	unsigned char *pixels;
+	int rowbytes;
+	int start;
+	int end;
+};
+
+/*
+In the tiled layouts, a row of the file is made of one row of each tile across,
+each BITMAP_TILE pixels long and all in one piece. They are copied together
+into a scratch row, which is then converted in one go: converting each piece
+straight into the file is twice as slow, because the vector stores of one
+piece keep overlapping the start of the next.
+*/
+
+static void encode_tiled_rows( struct bitmap *m, int start, int end, unsigned char *pixels, int rowbytes )
+{
+	int *row = malloc(m->width*sizeof(int));
+	int j, x;
+
+	for(j=start;j<end;j++) {
+		unsigned char *out = pixels + (size_t)j*rowbytes;
+
+		for(x=0;x<m->width;x+=BITMAP_TILE) {
+			int n = m->width-x < BITMAP_TILE ? m->width-x : BITMAP_TILE;
+			const int *src = &m->data[pixel_offset(m,x,j)];
+
+			// Without memory for the scratch row, the slow way still works.
+			if(row) {
+				memcpy(row+x,src,n*sizeof(int));
+			} else {
+				rgba_to_bgr(src,n,out + 3*x);
+			}
+		}
+
+		if(row) rgba_to_bgr(row,m->width,out);
+	}
+
+	free(row);
+}
+
+/*
+An 8-bit bitmap is saved as it is, with its colors in the file.
+A 16-bit one has too many colors for that, so its rows are looked up in
+the color table into a scratch row, and saved as 24-bit like any other.
+*/
+
+static void encode_indexed_rows( struct bitmap *m, int start, int end, unsigned char *pixels, int rowbytes )
+{
+	int j, i;
+
+	if(m->bits==8) {
+		for(j=start;j<end;j++) {
+			memcpy(pixels + (size_t)j*rowbytes,(unsigned char *)m->indices + (size_t)j*m->width,m->width);
+		}
+		return;
+	}
+
+	int *row = malloc(m->width*sizeof(int));
+
+	for(j=start;j<end;j++) {
+		const unsigned short *src = (unsigned short *)m->indices + (size_t)j*m->width;
+		unsigned char *out = pixels + (size_t)j*rowbytes;
+
+		// Without memory for the scratch row, do it a pixel at a time.
+		if(!row) {
+			for(i=0;i<m->width;i++) rgba_to_bgr_scalar(&m->colors[src[i]],1,out + 3*i);
+			continue;
+		}
+
+		for(i=0;i<m->width;i++) row[i] = m->colors[src[i]];
+		rgba_to_bgr(row,m->width,out);
+	}
+
+	free(row);
+}
+
+static void * encode_rows( void *a )
+{
+	struct encode_job *job = a;
+	struct bitmap *m = job->m;
+	int j;
+
+	if(m->bits!=32) {
+		encode_indexed_rows(m,job->start,job->end,job->pixels,job->rowbytes);
+		return 0;
+	}
+
+	if(m->layout!=BITMAP_ROWS) {
+		encode_tiled_rows(m,job->start,job->end,job->pixels,job->rowbytes);
+		return 0;
+	}
+
+	for(j=job->start;j<job->end;j++) {
+		unsigned char *row = job->pixels + (size_t)j*job->rowbytes;
+		rgba_to_bgr(&m->data[(size_t)j*m->width],m->width,row);
+	}
+
+	return 0;
+}
+
+// The file buffer has room in front of the pixels for the header and the largest color table.
+#define PREFIX (sizeof(struct bmp_header) + 4*256)
+
+/* The bytes of one row of pixels in the file, before it is padded. */
+
+static int pixel_bytes( struct bitmap *m )
+{
+	return m->bits==8 ? m->width : m->width*3;
+}
+
+/*
+Convert the first nrows rows of the bitmap into the file buffer, which
+belongs to the bitmap so that saving it again costs no allocation.
+Returns a pointer to the first row, which has room for the header and colors in front of it.
+*/
+
+static unsigned char * encode( struct bitmap *m, int nrows, int nthreads, int *rowbytes )
+{
+	int j;
+
+	/* if the scanline is not a multiple of four, round it up. */
+	*rowbytes = (pixel_bytes(m)+3) & ~3;
+
+	if(!m->file) {
+		size_t total = PREFIX + (size_t)*rowbytes*m->height;
+		if(posix_memalign((void **)&m->file,ALIGNMENT,total)) {
+			m->file = 0;
+			return 0;
+		}
+	}
+
+	unsigned char *pixels = m->file + PREFIX;
+
+	// The padding at the end of each row, which the rows themselves never touch.
+	for(j=0;j<nrows;j++) {
+		memset(pixels + (size_t)j**rowbytes + pixel_bytes(m),0,*rowbytes - pixel_bytes(m));
+	}
+
+	if(nthreads<1) nthreads = 1;
+	if(nthreads>nrows) nthreads = nrows>0 ? nrows : 1;
+
+	struct encode_job jobs[nthreads];
+	pthread_t tid[nthreads];
+	int started[nthreads];
+
+	for(j=0;j<nthreads;j++) {
+		jobs[j].m = m;
+		jobs[j].pixels = pixels;
+		jobs[j].rowbytes = *rowbytes;
+		jobs[j].start = (long)nrows*j/nthreads;
+		jobs[j].end = (long)nrows*(j+1)/nthreads;
+	}
+
+	if(nthreads==1) {
+		encode_rows(&jobs[0]);
+	} else {
+		// If a thread can't be started, its band is simply done here.
+		for(j=1;j<nthreads;j++) {
+			started[j] = pthread_create(&tid[j],0,encode_rows,&jobs[j])==0;
+			if(!started[j]) encode_rows(&jobs[j]);
+		}
+		encode_rows(&jobs[0]);
+		for(j=1;j<nthreads;j++) {
+			if(started[j]) pthread_join(tid[j],0);
+		}
+	}
+
+	return pixels;
+}
+
+/* Write all of data at the given offset of the file, however many calls it takes. */
+
+static int write_all( int fd, const unsigned char *data, size_t length, off_t offset )
+{
+	size_t done = 0;
+
+	while(done<length) {
+		ssize_t n = pwrite(fd,data+done,length-done,offset+done);
+		if(n<0) {
+			if(errno==EINTR) continue;
+			return 0;
+		}
+		done += n;
+	}
+
+	return 1;
+}
+
+int bitmap_save( struct bitmap *m, const char *path )
+{
+	return bitmap_save_threads(m,path,1);
+}
+
+// The compression of a run-length encoded 8-bit file.
+#define BI_RLE8 1
+
+/*
+Put the header of an 8-bit file at out, followed by its color table in the
+blue, green, red, zero order of the file. Returns the size of the two,
+which is where the pixels start.
+*/
+
+static size_t fill_indexed_header( struct bitmap *m, unsigned char *out, int compression, size_t imagesize )
+{
+	struct bmp_header header;
+	size_t front = sizeof(header) + 4*m->ncolors;
+	int i;
+
+	fill_header(&header,m->width,m->height);
+	header.bits = 8;
+	header.compression = compression;
+	header.offset = front;
+	header.ncolors = m->ncolors;
+	header.imagesize = imagesize<=INT_MAX ? imagesize : 0;
+	header.size = front+imagesize<=INT_MAX ? front+imagesize : 0;
+	memcpy(out,&header,sizeof(header));
+
+	for(i=0;i<m->ncolors;i++) {
+		unsigned char *c = out + sizeof(header) + 4*i;
+		c[0] = GET_BLUE(m->colors[i]);
+		c[1] = GET_GREEN(m->colors[i]);
+		c[2] = GET_RED(m->colors[i]);
+		c[3] = 0;
+	}
+
+	return front;
+}
+
+/*
+Run-length encode one row of indices (BI_RLE8), returning the bytes written.
+A run of two or more of the same index is a count and the index.
+Three or more pixels without such a run between them are written as they are,
+after a zero and their count, and padded to an even length. Anything shorter
+costs less as runs of one.
+*/
+
+static size_t encode_rle_row( const unsigned char *row, int n, unsigned char *out )
+{
+	unsigned char *o = out;
+	int i = 0;
+
+	while(i<n) {
+		int run = 1;
+		while(i+run<n && run<255 && row[i+run]==row[i]) run++;
+
+		if(run>=2) {
+			*o++ = run;
+			*o++ = row[i];
+			i += run;
+			continue;
+		}
+
+		// Gather pixels up to the next run.
+		int length = 1;
+		while(i+length<n && length<255 && !(i+length+1<n && row[i+length]==row[i+length+1])) length++;
+
+		if(length>=3) {
+			*o++ = 0;
+			*o++ = length;
+			memcpy(o,row+i,length);
+			o += length;
+			if(length&1) *o++ = 0;
+		} else {
+			int k;
+			for(k=0;k<length;k++) {
+				*o++ = 1;
+				*o++ = row[i+k];
+			}
+		}
+		i += length;
+	}
+
+	return o-out;
+}
+
+/* Save an 8-bit bitmap run-length encoded, which is done on one thread. */
+
+static int save_rle( struct bitmap *m, const char *path )
+{
+	// No row can take more than two bytes a pixel, and each ends with two more.
+	size_t most = PREFIX + (size_t)m->height*(2*m->width+2) + 2;
+	unsigned char *buffer = malloc(most);
+	unsigned char *pixels, *o;
+	int j;
+
+	if(!buffer) return 0;
+
+	pixels = o = buffer + PREFIX;
+
+	for(j=0;j<m->height;j++) {
+		o += encode_rle_row((unsigned char *)m->indices + (size_t)j*m->width,m->width,o);
+
+		// The end of a row, and after the last one the end of the bitmap.
+		*o++ = 0;
+		*o++ = j+1<m->height ? 0 : 1;
+	}
+
+	size_t front = fill_indexed_header(m,buffer,BI_RLE8,o-pixels);
+	memmove(buffer+front,pixels,o-pixels);
+
+	int ok = 0;
+	int fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0666);
+	if(fd>=0) {
+		ok = write_all(fd,buffer,front + (o-pixels),0);
+		if(close(fd)!=0) ok = 0;
+	}
+
+	free(buffer);
+
+	return ok;
+}
+
+/*
+Build the whole file in one aligned buffer, converting rows straight from
+the pixel data, and then hand it to the kernel in as few writes as it takes.
+*/
+
+int bitmap_save_threads( struct bitmap *m, const char *path, int nthreads )
+{
+	struct bmp_header header;
+	int rowbytes, fd;
+	unsigned char *buffer;
+	size_t front;
+
+	if(m->bits==8 && m->rle) return save_rle(m,path);
+
+	unsigned char *pixels = encode(m,m->height,nthreads,&rowbytes);
+	if(!pixels) return 0;
+
+	// The header, and any color table, go just in front of the pixels.
+	if(m->bits==8) {
+		front = sizeof(header) + 4*m->ncolors;
+		buffer = pixels - front;
+		fill_indexed_header(m,buffer,0,(size_t)rowbytes*m->height);
+	} else {
+		front = sizeof(header);
+		buffer = pixels - front;
+		fill_header(&header,m->width,m->height);
+		memcpy(buffer,&header,sizeof(header));
+	}
+
+	fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0666);
+	if(fd<0) return 0;
+
+	int ok = write_all(fd,buffer,front + (size_t)rowbytes*m->height,0);
+
+	if(close(fd)!=0) ok = 0;
+
+	return ok;
+}
+
+int bitmap_open_stream( const char *path, int width, int height )
+{
+	struct bmp_header header;
+	int rowbytes = (width*3+3) & ~3;
+
+	int fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0666);
+	if(fd<0) return -1;
+
+	fill_header(&header,width,height);
+
+	// Set the final size up front, so the rows can arrive in any order.
+	if(ftruncate(fd,sizeof(header) + (off_t)rowbytes*height)!=0 || !write_all(fd,(unsigned char *)&header,sizeof(header),0)) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int bitmap_write_rows( struct bitmap *m, int fd, int nrows, int first )
+{
+	int rowbytes;
+
+	// A stream is always 24-bit, and an 8-bit bitmap is saved as it is.
+	if(m->bits==8) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	unsigned char *pixels = encode(m,nrows,1,&rowbytes);
+	if(!pixels) return 0;
+
+	return write_all(fd,pixels,(size_t)rowbytes*nrows,sizeof(struct bmp_header) + (off_t)first*rowbytes);
+}
+
 struct bitmap * bitmap( const char *path )
 {
 	FILE *file;
@@ -2,11 +2,79 @@
 #ifndef BITMAP_H
 #define BITMAP_H
 
+struct pool;
+
+/*
+How the pixels of a bitmap are kept in memory.
+BITMAP_ROWS   row by row, the same as the image, which is what bitmap_data
+              means to palette_apply and everything else that colors a whole image.
+BITMAP_TILES  in BITMAP_TILE x BITMAP_TILE tiles, each one row by row and all in
+              one piece, with the tiles in rows. Working a tile at a time then
+              touches a few pages, rather than a page or two for every row.
+BITMAP_ZORDER the same tiles in Z (Morton) order, so that neighboring tiles,
+              above and below as well as to the side, are mostly near each other too.
+Whatever the layout, bitmap_get, bitmap_set and the save functions work the same,
+and the files are the same.
+*/
+
+typedef enum {
+	BITMAP_ROWS,
+	BITMAP_TILES,
+	BITMAP_ZORDER
+} bitmap_layout_t;
+
+#define BITMAP_TILE 64
+
 struct bitmap * bitmap_create( int w, int h );
+struct bitmap * bitmap_create_layout( int w, int h, bitmap_layout_t layout );
+
+/*
+An indexed bitmap keeps an 8 or 16-bit index into a table of colors for each
+pixel, instead of the 32-bit color, and is always in rows. It has no
+bitmap_data, but bitmap_indices, and bitmap_get gives the color of a pixel.
+bitmap_set and bitmap_reset take a color, and use its index if it is in the table,
+and index 0 if not, so the fast way to fill one is through bitmap_indices.
+An 8-bit bitmap is saved as an 8-bit BMP with its colors, which is a third
+the size, or run-length encoded (BI_RLE8) after bitmap_set_rle. A 16-bit
+bitmap has too many colors for a BMP, and is saved in 24 bits like any other.
+*/
+struct bitmap * bitmap_create_indexed( int w, int h, int bits );
+
+/* A new w x h bitmap with the same layout, or the same depth, colors and encoding, as b. */
+struct bitmap * bitmap_create_like( struct bitmap *b, int w, int h );
 void            bitmap_delete( struct bitmap *b );
 struct bitmap * bitmap_load( const char *file );
 int             bitmap_save( struct bitmap *b, const char *file );
 
+/* The same as bitmap_save, with the pixels converted by nthreads threads. */
+int             bitmap_save_threads( struct bitmap *b, const char *file, int nthreads );
+
+/* 32, or 8 or 16 for an indexed bitmap. */
+int             bitmap_bits( struct bitmap *b );
+
+/* The unsigned char or unsigned short indices of an indexed bitmap, row by row. */
+void *          bitmap_indices( struct bitmap *b );
+
+/* Set the table of an indexed bitmap to ncolors colors. Returns 0 if they don't fit in its indices. */
+int             bitmap_set_colors( struct bitmap *b, const int *colors, int ncolors );
+
+/* Have an 8-bit bitmap saved run-length encoded, or not. */
+void            bitmap_set_rle( struct bitmap *b, int rle );
+
+/*
+Write a bitmap too big to hold in memory a band of rows at a time.
+bitmap_open_stream creates the file for a width x height image and returns
+its descriptor (or -1), and bitmap_write_rows encodes the first nrows rows
+of b (which must be width wide) as rows first..first+nrows-1 of the file.
+Bands may be written in any order, and the caller closes the file.
+The file is 24-bit, so b may be a 16-bit bitmap but not an 8-bit one.
+*/
+int             bitmap_open_stream( const char *file, int width, int height );
+int             bitmap_write_rows( struct bitmap *b, int fd, int nrows, int first );
+
+/* The original, pixel-at-a-time bitmap_save, for comparison. */
+int             bitmap_save_reference( struct bitmap *b, const char *file );
+
 int   bitmap_get( struct bitmap *b, int x, int y );
 void  bitmap_set( struct bitmap *b, int x, int y, int value );
 int   bitmap_width( struct bitmap *b );
@@ -14,6 +82,29 @@ int   bitmap_height( struct bitmap *b );
 void  bitmap_reset( struct bitmap *b, int value );
 int  *bitmap_data( struct bitmap *b );
 
+bitmap_layout_t bitmap_layout( struct bitmap *b );
+
+/* Where pixel x,y is in bitmap_data. Unlike bitmap_get, x and y must be inside the image. */
+long  bitmap_offset( struct bitmap *b, int x, int y );
+
+/*
+The top left pixel of the tile that x,y is in, with the rows of the tile
+*stride ints apart. Tiles are BITMAP_TILE pixels square, and those on the
+right and bottom edges are cut short by the image in every layout.
+*/
+int  *bitmap_tile( struct bitmap *b, int x, int y, int *stride );
+
+/* Convert between a layout and its name. Returns 0 if the name is unknown. */
+int          bitmap_layout_from_name( const char *name, bitmap_layout_t *layout );
+const char * bitmap_layout_name( bitmap_layout_t layout );
+
+/*
+The same as bitmap_reset, with each thread of the pool filling the band of
+pixels that palette_apply will give it, so that on a NUMA machine a freshly
+created bitmap's pages end up on the node of the thread that colors them.
+*/
+void  bitmap_reset_threads( struct bitmap *b, int value, struct pool *pool );
+
 #ifndef MAKE_RGBA
 /** Create a 32-bit RGBA value from 8-bit red, green, blue, and alpha values */
 #define MAKE_RGBA(r,g,b,a) ( (((int)(a))<<24) | (((int)(r))<<16) | (((int)(g))<<8) | (((int)(b))<<0) )
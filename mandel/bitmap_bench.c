@@ -0,0 +1,293 @@
+/*
+Compare the speed of bitmap_save against the original pixel-at-a-time encoder,
+and check that they write exactly the same file.
+
+Then compare the layouts of bitmap.h on the ways the tile-based code walks an
+image: filling whole tiles, following the borders of tiles as the subdivide
+engine does, and comparing each pixel with its neighbors as anti-aliasing does.
+A row by row scan and a save show what the tiled layouts cost the rest of the code.
+*/
+
+#include "bitmap.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv,0);
+	return tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static char * read_file( const char *path, long *size )
+{
+	FILE *file = fopen(path,"rb");
+	if(!file) return 0;
+
+	fseek(file,0,SEEK_END);
+	*size = ftell(file);
+	fseek(file,0,SEEK_SET);
+
+	char *data = malloc(*size);
+	if(data && fread(data,1,*size,file)!=(size_t)*size) {
+		free(data);
+		data = 0;
+	}
+
+	fclose(file);
+	return data;
+}
+
+static int same_files( const char *x, const char *y )
+{
+	long xsize, ysize;
+	char *a = read_file(x,&xsize);
+	char *b = read_file(y,&ysize);
+
+	int same = a && b && xsize==ysize && !memcmp(a,b,xsize);
+
+	free(a);
+	free(b);
+
+	return same;
+}
+
+// Something other than a flat color, so that a misplaced byte would show.
+static int pattern( int i, int j )
+{
+	return MAKE_RGBA(i*7+j+1,i^j,i*j,(i+j)&0xff);
+}
+
+// Keeps the compiler from dropping the loops whose results are otherwise unused.
+static volatile long sink;
+
+/* Fill every tile in turn, a row of the tile at a time, the way a uniform tile is filled. */
+
+static void walk_fill( struct bitmap *bm )
+{
+	int w = bitmap_width(bm), h = bitmap_height(bm);
+	int tx, ty, i, j, stride;
+
+	for(ty=0;ty<h;ty+=BITMAP_TILE) {
+		for(tx=0;tx<w;tx+=BITMAP_TILE) {
+			int *tile = bitmap_tile(bm,tx,ty,&stride);
+			int tw = w-tx < BITMAP_TILE ? w-tx : BITMAP_TILE;
+			int th = h-ty < BITMAP_TILE ? h-ty : BITMAP_TILE;
+
+			for(j=0;j<th;j++) {
+				for(i=0;i<tw;i++) tile[j*stride+i] = pattern(tx+i,ty+j);
+			}
+		}
+	}
+}
+
+/* Read the four edges of every tile, and then of its four quarters, as the subdivide engine does. */
+
+static void walk_borders( struct bitmap *bm )
+{
+	int w = bitmap_width(bm), h = bitmap_height(bm);
+	int tx, ty, k, size;
+	long sum = 0;
+
+	for(ty=0;ty<h;ty+=BITMAP_TILE) {
+		for(tx=0;tx<w;tx+=BITMAP_TILE) {
+			for(size=BITMAP_TILE;size>=16;size/=2) {
+				int x, y;
+				for(y=ty;y<ty+BITMAP_TILE;y+=size) {
+					for(x=tx;x<tx+BITMAP_TILE;x+=size) {
+						for(k=0;k<size;k++) {
+							sum += bitmap_get(bm,x+k,y) + bitmap_get(bm,x+k,y+size-1);
+							sum += bitmap_get(bm,x,y+k) + bitmap_get(bm,x+size-1,y+k);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	sink = sum;
+}
+
+/* Compare every pixel with its eight neighbors, a tile at a time, as the edge test of anti-aliasing does. */
+
+static void walk_neighbors( struct bitmap *bm )
+{
+	int w = bitmap_width(bm), h = bitmap_height(bm);
+	int tx, ty, i, j, di, dj;
+	long edges = 0;
+
+	for(ty=0;ty<h;ty+=BITMAP_TILE) {
+		for(tx=0;tx<w;tx+=BITMAP_TILE) {
+			for(j=ty;j<ty+BITMAP_TILE && j<h;j++) {
+				for(i=tx;i<tx+BITMAP_TILE && i<w;i++) {
+					int n = bitmap_get(bm,i,j);
+					for(dj=-1;dj<=1;dj++) {
+						for(di=-1;di<=1;di++) {
+							if(bitmap_get(bm,i+di,j+dj)!=n) edges++;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	sink = edges;
+}
+
+/* Read the whole image row by row. */
+
+static void walk_rows( struct bitmap *bm )
+{
+	int w = bitmap_width(bm), h = bitmap_height(bm);
+	int i, j;
+	long sum = 0;
+
+	for(j=0;j<h;j++) {
+		for(i=0;i<w;i++) sum += bitmap_get(bm,i,j);
+	}
+
+	sink = sum;
+}
+
+/* Run a walk "repeats" times, and return the best time. */
+
+static double best_walk( struct bitmap *bm, void (*walk)( struct bitmap *bm ), int repeats )
+{
+	double best = 0;
+	int k;
+
+	for(k=0;k<repeats;k++) {
+		double start = now();
+		walk(bm);
+		double t = now()-start;
+		if(k==0 || t<best) best = t;
+	}
+
+	return best;
+}
+
+/* Save the bitmap "repeats" times with the given encoder, and return the best time. */
+
+static double best_time( struct bitmap *bm, const char *path, int threads, int repeats )
+{
+	double best = 0;
+	int k;
+
+	for(k=0;k<repeats;k++) {
+		double start = now();
+		int ok = threads ? bitmap_save_threads(bm,path,threads) : bitmap_save_reference(bm,path);
+		double t = now()-start;
+
+		if(!ok) {
+			fprintf(stderr,"bitmap_bench: couldn't write to %s: %s\n",path,strerror(errno));
+			exit(1);
+		}
+
+		if(k==0 || t<best) best = t;
+	}
+
+	return best;
+}
+
+int main( int argc, char *argv[] )
+{
+	int width = 4000;
+	int height = 3000;
+	int repeats = 5;
+	int threads = 4;
+	const char *prefix = "bitmap_bench";
+	int c, i, j;
+
+	while((c = getopt(argc,argv,"W:H:r:n:o:h"))!=-1) {
+		switch(c) {
+			case 'W':
+				width = atoi(optarg);
+				break;
+			case 'H':
+				height = atoi(optarg);
+				break;
+			case 'r':
+				repeats = atoi(optarg);
+				break;
+			case 'n':
+				threads = atoi(optarg);
+				break;
+			case 'o':
+				prefix = optarg;
+				break;
+			default:
+				printf("Use: bitmap_bench [-W width] [-H height] [-r repeats] [-n threads] [-o file prefix]\n");
+				exit(1);
+		}
+	}
+
+	if(repeats<1) repeats = 1;
+	if(threads<1) threads = 1;
+
+	struct bitmap *bm = bitmap_create(width,height);
+	if(!bm) {
+		fprintf(stderr,"bitmap_bench: couldn't allocate a %dx%d bitmap\n",width,height);
+		exit(1);
+	}
+
+	for(j=0;j<height;j++) {
+		for(i=0;i<width;i++) {
+			bitmap_set(bm,i,j,pattern(i,j));
+		}
+	}
+
+	char reference[4096], fast[4096];
+	snprintf(reference,sizeof(reference),"%s_reference.bmp",prefix);
+	snprintf(fast,sizeof(fast),"%s_fast.bmp",prefix);
+
+	double megapixels = (double)width*height/1e6;
+	double tref = best_time(bm,reference,0,repeats);
+	double tone = best_time(bm,fast,1,repeats);
+	int same = same_files(reference,fast);
+	double tmany = best_time(bm,fast,threads,repeats);
+	same = same && same_files(reference,fast);
+
+	printf("bitmap_bench: %dx%d, best of %d\n",width,height,repeats);
+	printf("reference:    %8.4fs %8.1f Mpixels/s\n",tref,megapixels/tref);
+	printf("fast:         %8.4fs %8.1f Mpixels/s %5.1fx\n",tone,megapixels/tone,tref/tone);
+	printf("fast, %2d thr: %8.4fs %8.1f Mpixels/s %5.1fx\n",threads,tmany,megapixels/tmany,tref/tmany);
+	printf("output is %s\n",same ? "identical" : "DIFFERENT");
+
+	bitmap_delete(bm);
+
+	// The same image in each layout, timed in milliseconds per walk.
+	static const bitmap_layout_t layouts[] = { BITMAP_ROWS, BITMAP_TILES, BITMAP_ZORDER };
+
+	printf("\nlayout        fill   borders neighbors      rows      save\n");
+
+	for(c=0;c<3;c++) {
+		bm = bitmap_create_layout(width,height,layouts[c]);
+		if(!bm) {
+			fprintf(stderr,"bitmap_bench: couldn't allocate a %dx%d bitmap\n",width,height);
+			exit(1);
+		}
+
+		double tfill = best_walk(bm,walk_fill,repeats);
+		double tborders = best_walk(bm,walk_borders,repeats);
+		double tneighbors = best_walk(bm,walk_neighbors,repeats);
+		double trows = best_walk(bm,walk_rows,repeats);
+		double tsave = best_time(bm,fast,1,repeats);
+		int layout_same = same_files(reference,fast);
+		same = same && layout_same;
+
+		printf("%-8s %9.2f %9.2f %9.2f %9.2f %9.2f%s\n",bitmap_layout_name(layouts[c]),tfill*1000,tborders*1000,tneighbors*1000,trows*1000,tsave*1000,layout_same ? "" : "  output is DIFFERENT");
+
+		bitmap_delete(bm);
+	}
+
+	unlink(reference);
+	unlink(fast);
+
+	return same ? 0 : 1;
+}
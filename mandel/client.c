@@ -0,0 +1,114 @@
+#include "client.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+struct client {
+	FILE *in;
+	FILE *out;
+};
+
+struct client * client_connect( const char *path )
+{
+	struct sockaddr_un address;
+	struct client *c;
+
+	if(strlen(path)>=sizeof(address.sun_path)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+
+	int fd = socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd<0) return 0;
+
+	if(connect(fd,(struct sockaddr *)&address,sizeof(address))!=0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return 0;
+	}
+
+	// One stream each way, since a single stream can't switch between reading and writing freely.
+	c = malloc(sizeof(*c));
+	int other = dup(fd);
+
+	if(!c || other<0 || !(c->in = fdopen(fd,"r"))) {
+		free(c);
+		close(fd);
+		if(other>=0) close(other);
+		return 0;
+	}
+
+	c->out = fdopen(other,"w");
+	if(!c->out) {
+		fclose(c->in);
+		close(other);
+		free(c);
+		return 0;
+	}
+
+	return c;
+}
+
+void client_close( struct client *c )
+{
+	fclose(c->out);
+	fclose(c->in);
+	free(c);
+}
+
+/* Read the answer line, without its newline. Returns 0 if the server went away. */
+
+static int read_line( struct client *c, char *line, int length )
+{
+	if(!fgets(line,length,c->in)) return 0;
+	line[strcspn(line,"\n")] = 0;
+	return 1;
+}
+
+int client_tile( struct client *c, const char *x, const char *y, double scale, int max, int size, int *counts, struct tile_reply *reply )
+{
+	char line[512], hit[8];
+
+	memset(reply,0,sizeof(*reply));
+	errno = 0;
+
+	if(fprintf(c->out,"tile %s %s %.17g %d %d\n",x,y,scale,max,size)<0 || fflush(c->out)!=0 || !read_line(c,line,sizeof(line))) {
+		snprintf(reply->error,sizeof(reply->error),"lost the server: %s",errno ? strerror(errno) : "end of file");
+		return 0;
+	}
+
+	if(!strncmp(line,"error ",6)) {
+		snprintf(reply->error,sizeof(reply->error),"%.250s",line+6);
+		return 0;
+	}
+
+	if(sscanf(line,"ok %d %7s %ld %lf %lf",&reply->size,hit,&reply->microseconds,&reply->x,&reply->y)!=5 || reply->size!=size) {
+		snprintf(reply->error,sizeof(reply->error),"bad answer from the server: %.200s",line);
+		return 0;
+	}
+
+	reply->hit = !strcmp(hit,"hit");
+
+	if(fread(counts,sizeof(int),(size_t)size*size,c->in)!=(size_t)size*size) {
+		snprintf(reply->error,sizeof(reply->error),"the server went away in the middle of a tile");
+		return 0;
+	}
+
+	return 1;
+}
+
+int client_stats( struct client *c, char *line, int length )
+{
+	if(fprintf(c->out,"stats\n")<0 || fflush(c->out)!=0) return 0;
+	return read_line(c,line,length) && !strncmp(line,"stats ",6);
+}
@@ -0,0 +1,58 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+/*
+The protocol of the render server (mandel -U), and the client side of it.
+
+A client connects to the server's UNIX domain socket and sends requests,
+one line each, getting an answer to each before the next is read.
+
+    tile <x> <y> <scale> <max> <size>
+
+asks for the iteration counts of a size x size tile centered on x,y and
+reaching scale either side of it, the same as mandel -x -y -s -m -W -H.
+The server rounds the center to the nearest point of the grid of pixels
+at that scale, so every tile of the same scale lines up, and answers with
+
+    ok <size> <hit|miss> <microseconds> <x> <y>
+
+saying whether the tile came from the cache, how long the server took,
+and the center it used. Then come the size*size counts as native ints, row by row.
+
+    stats
+
+is answered with "stats <tiles> <bytes> <hits> <misses> <evictions>" for the cache.
+Anything else, or a request the server can't do, is answered with
+"error <message>", and the connection stays open.
+*/
+
+// The largest tile the server will render.
+#define SERVER_MAX_SIZE 4096
+
+struct client;
+
+struct tile_reply {
+	int size;
+	int hit;
+	long microseconds;
+	double x;
+	double y;
+
+	// If the request failed, why.
+	char error[256];
+};
+
+/* Connect to the server at path. Returns 0 and sets errno on failure. */
+struct client * client_connect( const char *path );
+void            client_close( struct client *c );
+
+/*
+Ask for a tile, and put its counts (which must have room for size*size) into counts.
+Returns 1 on success, or 0 with reply->error set.
+*/
+int             client_tile( struct client *c, const char *x, const char *y, double scale, int max, int size, int *counts, struct tile_reply *reply );
+
+/* Ask for the cache counters, and put the answer line into line. Returns 0 on failure. */
+int             client_stats( struct client *c, char *line, int length );
+
+#endif
@@ -0,0 +1,368 @@
+#include "deepzoom.h"
+#include "render.h"
+#include "instrument.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+// A point whose iterations are not known yet, because its orbit glitched.
+#define GLITCHED -2
+
+// A point glitches when its orbit comes this close to zero, relative to the reference (Pauldelbrot's test).
+#define GLITCH_TOLERANCE 1e-6
+
+// The series approximation stops once its estimated error is this large compared to the series itself.
+#define SERIES_TOLERANCE 1e-12
+
+// The most new reference orbits to try for glitched points.
+#define MAX_PASSES 32
+
+void deepzoom_delete( struct deepzoom *d )
+{
+	if(!d) return;
+	free(d->dxs);
+	free(d->dys);
+	free(d->zr);
+	free(d->zi);
+	free(d->glitch);
+	free(d);
+}
+
+/* Enough bits to tell neighboring points apart, with some to spare. */
+
+static int limbs_for_view( struct render *r, double scale )
+{
+	return hp_limbs_for(2*scale/(r->width>r->height ? r->width : r->height));
+}
+
+int deepzoom_set_view( struct render *r, const char *x, const char *y, double scale, int max )
+{
+	struct hp xcenter, ycenter;
+	int limbs = limbs_for_view(r,scale);
+
+	if(!hp_from_string(&xcenter,x,limbs)) return 0;
+	if(!hp_from_string(&ycenter,y,limbs)) return 0;
+
+	return deepzoom_set_view_hp(r,&xcenter,&ycenter,scale,max);
+}
+
+int deepzoom_set_view_hp( struct render *r, const struct hp *x, const struct hp *y, double scale, int max )
+{
+	struct deepzoom *d = r->deep;
+	int i;
+
+	if(!d) {
+		d = malloc(sizeof(*d));
+		if(!d) return 0;
+		memset(d,0,sizeof(*d));
+		d->dxs = malloc(r->width*sizeof(double));
+		d->dys = malloc(r->height*sizeof(double));
+		if(!d->dxs || !d->dys) {
+			deepzoom_delete(d);
+			return 0;
+		}
+		r->deep = d;
+	}
+
+	d->limbs = limbs_for_view(r,scale);
+
+	d->xcenter = *x;
+	d->ycenter = *y;
+	hp_set_limbs(&d->xcenter,d->limbs);
+	hp_set_limbs(&d->ycenter,d->limbs);
+
+	d->scale = scale;
+
+	// The plain double view is still used by the other engines, and by mandel -V.
+	render_set_view(r,hp_to_double(&d->xcenter),hp_to_double(&d->ycenter),scale,max);
+
+	// The same grid as render_set_view, but measured from the center, so no digits are lost.
+	for(i=0;i<r->width;i++) {
+		d->dxs[i] = -scale + i*(2*scale)/r->width;
+	}
+
+	for(i=0;i<r->height;i++) {
+		d->dys[i] = -scale + i*(2*scale)/r->height;
+	}
+
+	return 1;
+}
+
+/*
+Compute the reference orbit at (refdx,refdy) from the center in high precision,
+keeping a double copy of each step. If series is set, also work out how many
+iterations the series approximation can skip for every point in the image.
+*/
+
+static int compute_reference( struct deepzoom *d, int max, int series )
+{
+	struct hp cx, cy, zx, zy, x2, y2, t;
+	int n;
+
+	if(d->orbit_size < max+1) {
+		free(d->zr);
+		free(d->zi);
+		free(d->glitch);
+		d->zr = malloc((max+1)*sizeof(double));
+		d->zi = malloc((max+1)*sizeof(double));
+		d->glitch = malloc((max+1)*sizeof(double));
+		d->orbit_size = 0;
+		if(!d->zr || !d->zi || !d->glitch) return 0;
+		d->orbit_size = max+1;
+	}
+
+	hp_from_double(&t,d->refdx,d->limbs);
+	hp_add(&cx,&d->xcenter,&t);
+	hp_from_double(&t,d->refdy,d->limbs);
+	hp_add(&cy,&d->ycenter,&t);
+
+	zx = cx;
+	zy = cy;
+
+	for(n=0;;n++) {
+		double x = hp_to_double(&zx);
+		double y = hp_to_double(&zy);
+
+		d->zr[n] = x;
+		d->zi[n] = y;
+		d->glitch[n] = GLITCH_TOLERANCE*(x*x + y*y);
+
+		if(x*x + y*y > 4 || n==max) break;
+
+		hp_mul(&x2,&zx,&zx);
+		hp_mul(&y2,&zy,&zy);
+		hp_add(&t,&zx,&zx);
+		hp_mul(&zy,&t,&zy);
+		hp_add(&zy,&zy,&cy);
+		hp_sub(&zx,&x2,&y2);
+		hp_add(&zx,&zx,&cx);
+	}
+
+	d->reflen = n;
+
+	d->skip = 0;
+	d->ar = 1; d->ai = 0;
+	d->br = 0; d->bi = 0;
+	d->cr = 0; d->ci = 0;
+
+	if(!series) return 1;
+
+	// The farthest any point in the image is from the reference, which glitch passes move off the center.
+	double radius = hypot(d->scale+fabs(d->refdx),d->scale+fabs(d->refdy));
+	double dr = 0, di = 0;
+
+	// Step the coefficients along the orbit:
+	//   a' = 2za + 1,  b' = 2zb + a^2,  c' = 2zc + 2ab,  d' = 2zd + 2ac + b^2
+	// The series stops at c, so d tells us how large the error is.
+	// Stop just before that error stops being negligible next to the whole series.
+	for(n=0;n+1<d->reflen;n++) {
+		double zr2 = 2*d->zr[n], zi2 = 2*d->zi[n];
+
+		double ar = zr2*d->ar - zi2*d->ai + 1;
+		double ai = zr2*d->ai + zi2*d->ar;
+		double br = zr2*d->br - zi2*d->bi + d->ar*d->ar - d->ai*d->ai;
+		double bi = zr2*d->bi + zi2*d->br + 2*d->ar*d->ai;
+		double cr = zr2*d->cr - zi2*d->ci + 2*(d->ar*d->br - d->ai*d->bi);
+		double ci = zr2*d->ci + zi2*d->cr + 2*(d->ar*d->bi + d->ai*d->br);
+		double drt = zr2*dr - zi2*di + 2*(d->ar*d->cr - d->ai*d->ci) + d->br*d->br - d->bi*d->bi;
+		double dit = zr2*di + zi2*dr + 2*(d->ar*d->ci + d->ai*d->cr) + 2*d->br*d->bi;
+
+		double error = hypot(drt,dit)*radius*radius*radius*radius;
+		double size = hypot(ar,ai)*radius;
+
+		if(!(error <= SERIES_TOLERANCE*size)) break;
+
+		d->ar = ar; d->ai = ai;
+		d->br = br; d->bi = bi;
+		d->cr = cr; d->ci = ci;
+		dr = drt; di = dit;
+		d->skip = n+1;
+	}
+
+	return 1;
+}
+
+/*
+Return the iterations at the point dcx, dcy away from the reference orbit, or GLITCHED.
+*/
+
+static int iterations_perturbed( struct deepzoom *d, double dcx, double dcy, int max, long *skipped )
+{
+	double dx, dy;
+	int n;
+
+	if(d->skip>0) {
+		// Start from the series: dz = a*dc + b*dc^2 + c*dc^3.
+		double dc2x = dcx*dcx - dcy*dcy, dc2y = 2*dcx*dcy;
+		double dc3x = dc2x*dcx - dc2y*dcy, dc3y = dc2x*dcy + dc2y*dcx;
+
+		dx = d->ar*dcx - d->ai*dcy + d->br*dc2x - d->bi*dc2y + d->cr*dc3x - d->ci*dc3y;
+		dy = d->ar*dcy + d->ai*dcx + d->br*dc2y + d->bi*dc2x + d->cr*dc3y + d->ci*dc3x;
+		n = d->skip;
+
+		double x = d->zr[n] + dx;
+		double y = d->zi[n] + dy;
+
+		// If the point has already escaped, the skipped iterations mattered after all.
+		if(x*x + y*y > 4) {
+			dx = dcx;
+			dy = dcy;
+			n = 0;
+		} else {
+			(*skipped)++;
+		}
+	} else {
+		dx = dcx;
+		dy = dcy;
+		n = 0;
+	}
+
+	for(;;) {
+		double zr = d->zr[n];
+		double zi = d->zi[n];
+		double x = zr + dx;
+		double y = zi + dy;
+		double mag = x*x + y*y;
+
+		if(mag > 4) return n;
+		if(n==max) return max;
+
+		// Either the reference ran out before this point escaped,
+		// or the point came so close to zero that dz has lost its precision.
+		// On the last pass we give up, and keep the count so far.
+		if(n==d->reflen) return d->detect ? GLITCHED : n;
+		if(d->detect && mag < d->glitch[n]) return GLITCHED;
+
+		// dz' = 2*Z*dz + dz^2 + dc
+		double dxt = 2*(zr*dx - zi*dy) + dx*dx - dy*dy + dcx;
+		double dyt = 2*(zr*dy + zi*dx) + 2*dx*dy + dcy;
+
+		dx = dxt;
+		dy = dyt;
+		n++;
+	}
+}
+
+/*
+Iterate chunks of rows against the current reference orbit.
+The first pass does every point; later passes only the ones that glitched.
+*/
+
+void * compute_perturb( void *a )
+{
+	int i,j,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	struct deepzoom *d = r->deep;
+	long glitched = 0;
+	long skipped = 0;
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		double started = r->instrument ? instrument_now() : 0;
+		long pixels = 0, iterations = 0;
+
+		for(j = start; j<end; j++) {
+			int *iters = &r->iters[j*r->width];
+			double dcy = d->dys[j] - d->refdy;
+
+			for(i=0;i<r->width;i++) {
+				if(d->pass>0 && iters[i]!=GLITCHED) continue;
+
+				iters[i] = iterations_perturbed(d,d->dxs[i]-d->refdx,dcy,r->max,&skipped);
+
+				if(iters[i]==GLITCHED) {
+					glitched++;
+				} else if(r->instrument) {
+					pixels++;
+					iterations += iters[i];
+				}
+			}
+		}
+
+		if(r->instrument) instrument_unit(r->instrument,args->tnumber,unit,0,start,r->width,end,pixels,iterations,started);
+	}
+
+	__sync_fetch_and_add(&d->glitched,glitched);
+	__sync_fetch_and_add(&d->skipped,skipped);
+
+	return (void *) 1;
+}
+
+/*
+Choose the next reference among the glitched points.
+The middle one in scan order is always a glitched point itself,
+and is usually well inside the glitched area.
+*/
+
+static void choose_reference( struct render *r )
+{
+	struct deepzoom *d = r->deep;
+	long i, seen = 0, want = d->glitched/2;
+
+	for(i=0;i<(long)r->width*r->height;i++) {
+		if(r->iters[i]!=GLITCHED) continue;
+		if(seen++==want) {
+			d->refdx = d->dxs[i % r->width];
+			d->refdy = d->dys[i / r->width];
+			return;
+		}
+	}
+}
+
+int deepzoom_render( struct render *r )
+{
+	struct deepzoom *d = r->deep;
+	int nunits = (r->height+r->chunk-1)/r->chunk;
+	long total = (long)r->width*r->height;
+
+	if(!d) {
+		fprintf(stderr,"mandel: the perturbation engine has no view set\n");
+		return 0;
+	}
+
+	d->refdx = 0;
+	d->refdy = 0;
+	d->pass = 0;
+	d->detect = 1;
+	d->glitched = 0;
+	d->skipped = 0;
+
+	if(!compute_reference(d,r->max,1)) {
+		fprintf(stderr,"mandel: out of memory for the reference orbit\n");
+		return 0;
+	}
+
+	printf("mandel: perturbation with %d bits, reference orbit of %d iterations, series approximation skips %d\n",32*(d->limbs-1),d->reflen,d->skip);
+
+	if(!render_threads(r,compute_perturb,nunits)) return 0;
+
+	long unresolved = 0;
+
+	while(d->glitched>0 && d->pass<MAX_PASSES) {
+		choose_reference(r);
+
+		d->pass++;
+		d->detect = d->pass<MAX_PASSES;
+		if(!d->detect) unresolved = d->glitched;
+
+		printf("mandel: pass %d: %ld of %ld points glitched, new reference at %g,%g from the center\n",d->pass,d->glitched,total,d->refdx,d->refdy);
+
+		d->glitched = 0;
+		if(!compute_reference(d,r->max,1)) return 0;
+		if(!render_threads(r,compute_perturb,nunits)) return 0;
+	}
+
+	// A point that glitched is computed again on every later pass, so this can be more than the number of points.
+	printf("mandel: %d passes, %ld point computations started from the series approximation, %ld glitched points could not be resolved\n",d->pass+1,d->skipped,unresolved);
+
+	return 1;
+}
@@ -0,0 +1,68 @@
+#ifndef DEEPZOOM_H
+#define DEEPZOOM_H
+
+#include "hp.h"
+
+struct render;
+
+/*
+The perturbation engine, for zooms too deep for plain doubles.
+
+One reference orbit is computed in high precision at the center of the image.
+Every point is then iterated in doubles as a small difference from that orbit,
+starting after the iterations that a series approximation can skip.
+Points where the difference stops being accurate ("glitches") are found and
+iterated again against a new reference orbit placed among them.
+*/
+
+struct deepzoom {
+	int limbs;
+	struct hp xcenter;
+	struct hp ycenter;
+	double scale;
+
+	// The offset of every column and row from the center.
+	double *dxs;
+	double *dys;
+
+	// The reference orbit, and its offset from the center.
+	// Z[0..reflen] are valid: either reflen is max, or Z[reflen] has escaped.
+	double *zr;
+	double *zi;
+	double *glitch;
+	int orbit_size;
+	int reflen;
+	double refdx;
+	double refdy;
+
+	// Series approximation: every point starts at iteration skip,
+	// where its difference from the orbit is a*dc + b*dc^2 + c*dc^3.
+	int skip;
+	double ar, ai, br, bi, cr, ci;
+
+	// Which pass over the glitched points this is, and whether to look for more glitches.
+	int pass;
+	int detect;
+
+	long glitched;
+	long skipped;
+};
+
+/*
+Set the view of a render from decimal strings, so that the center keeps all of its digits.
+Returns 0 if the strings are not numbers.
+*/
+int    deepzoom_set_view( struct render *r, const char *x, const char *y, double scale, int max );
+
+/* The same, from a center already in high precision. Returns 0 if out of memory. */
+int    deepzoom_set_view_hp( struct render *r, const struct hp *x, const struct hp *y, double scale, int max );
+
+/* Fill in r->iters with the perturbation engine. Returns 0 on failure. */
+int    deepzoom_render( struct render *r );
+
+void   deepzoom_delete( struct deepzoom *d );
+
+/* The thread body of the perturbation engine. */
+void * compute_perturb( void *a );
+
+#endif
@@ -0,0 +1,239 @@
+#include "hp.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Extra limbs beyond what the pixel spacing needs, to soak up rounding in the orbit.
+#define GUARD_LIMBS 2
+
+int hp_limbs_for( double step )
+{
+	int bits = step>0 ? (int)ceil(-log2(step)) : 0;
+	if(bits<53) bits = 53;
+
+	int n = 1 + (bits+31)/32 + GUARD_LIMBS;
+	if(n>HP_MAX_LIMBS) n = HP_MAX_LIMBS;
+
+	return n;
+}
+
+static void zero( struct hp *a, int n )
+{
+	a->n = n;
+	memset(a->limb,0,sizeof(a->limb));
+}
+
+static int negative( const struct hp *a )
+{
+	return (int32_t)a->limb[0] < 0;
+}
+
+static void negate( struct hp *a )
+{
+	uint64_t carry = 1;
+	int i;
+
+	for(i=a->n-1;i>=0;i--) {
+		carry += (uint32_t)~a->limb[i];
+		a->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+}
+
+void hp_from_double( struct hp *a, double d, int n )
+{
+	int i;
+	int sign = d<0;
+	double f = fabs(d);
+
+	zero(a,n);
+
+	// Peel off 32 bits at a time. Every step is exact, since a double has only 53 bits.
+	a->limb[0] = (uint32_t)floor(f);
+	f -= floor(f);
+
+	for(i=1;i<n && f>0;i++) {
+		f *= 4294967296.0;
+		a->limb[i] = (uint32_t)floor(f);
+		f -= floor(f);
+	}
+
+	if(sign) negate(a);
+}
+
+void hp_split( const struct hp *a, double *hi, double *lo )
+{
+	struct hp b;
+
+	*hi = hp_to_double(a);
+	hp_from_double(&b,*hi,a->n);
+	hp_sub(&b,a,&b);
+	*lo = hp_to_double(&b);
+}
+
+void hp_set_limbs( struct hp *a, int n )
+{
+	int i;
+	for(i=a->n;i<n;i++) a->limb[i] = 0;
+	a->n = n;
+}
+
+double hp_to_double( const struct hp *a )
+{
+	struct hp m = *a;
+	double d = 0;
+	int i;
+
+	if(negative(a)) negate(&m);
+
+	for(i=m.n-1;i>=0;i--) {
+		d = d/4294967296.0 + m.limb[i];
+	}
+
+	return negative(a) ? -d : d;
+}
+
+void hp_add( struct hp *r, const struct hp *a, const struct hp *b )
+{
+	uint64_t carry = 0;
+	int i;
+
+	for(i=a->n-1;i>=0;i--) {
+		carry += (uint64_t)a->limb[i] + b->limb[i];
+		r->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+
+	r->n = a->n;
+}
+
+void hp_sub( struct hp *r, const struct hp *a, const struct hp *b )
+{
+	struct hp nb = *b;
+	negate(&nb);
+	hp_add(r,a,&nb);
+}
+
+/*
+Multiply the magnitudes of a and b with the schoolbook method,
+keeping the most significant limbs of the product.
+*/
+
+void hp_mul( struct hp *r, const struct hp *a, const struct hp *b )
+{
+	struct hp ma = *a, mb = *b;
+	uint32_t p[2*HP_MAX_LIMBS];
+	int n = a->n;
+	int sign = negative(a) != negative(b);
+	int i, j;
+
+	if(negative(&ma)) negate(&ma);
+	if(negative(&mb)) negate(&mb);
+
+	memset(p,0,sizeof(uint32_t)*2*n);
+
+	for(i=n-1;i>=0;i--) {
+		uint64_t carry = 0;
+		for(j=n-1;j>=0;j--) {
+			carry += (uint64_t)ma.limb[i]*mb.limb[j] + p[i+j+1];
+			p[i+j+1] = (uint32_t)carry;
+			carry >>= 32;
+		}
+		p[i] = (uint32_t)carry;
+	}
+
+	// p[1] holds the integer part of the product, and p[0] anything bigger than 2^32.
+	r->n = n;
+	for(i=0;i<n;i++) r->limb[i] = p[i+1];
+
+	if(sign) negate(r);
+}
+
+/* Multiply the magnitude a by a small number m, then add d to its integer part. */
+
+static void mul_small( struct hp *a, uint32_t m, uint32_t d )
+{
+	uint64_t carry = 0;
+	int i;
+
+	for(i=a->n-1;i>=0;i--) {
+		carry += (uint64_t)a->limb[i]*m;
+		a->limb[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+
+	a->limb[0] += d;
+}
+
+/* Divide the magnitude a by a small number m, after first adding d to its integer part. */
+
+static void div_small( struct hp *a, uint32_t m, uint32_t d )
+{
+	uint64_t rem = 0;
+	int i;
+
+	a->limb[0] += d;
+
+	for(i=0;i<a->n;i++) {
+		rem = (rem<<32) | a->limb[i];
+		a->limb[i] = (uint32_t)(rem/m);
+		rem %= m;
+	}
+}
+
+int hp_from_string( struct hp *a, const char *s, int n )
+{
+	struct hp frac;
+	const char *p = s;
+	const char *point;
+	int sign = 0;
+	int exponent = 0;
+	int digits = 0;
+
+	zero(a,n);
+	zero(&frac,n);
+
+	while(isspace((unsigned char)*p)) p++;
+	if(*p=='-' || *p=='+') sign = *p++ == '-';
+
+	// The integer part is read from left to right, multiplying by ten as we go.
+	while(isdigit((unsigned char)*p)) {
+		mul_small(a,10,*p-'0');
+		p++;
+		digits++;
+	}
+
+	// The fraction is read from right to left, dividing by ten as we go.
+	if(*p=='.') {
+		point = ++p;
+		while(isdigit((unsigned char)*p)) p++;
+
+		const char *q;
+		for(q=p-1;q>=point;q--) div_small(&frac,10,*q-'0');
+
+		digits += p-point;
+	}
+
+	if(!digits) return 0;
+
+	if(*p=='e' || *p=='E') {
+		char *end;
+		exponent = strtol(p+1,&end,10);
+		if(end==p+1) return 0;
+		p = end;
+	}
+
+	while(isspace((unsigned char)*p)) p++;
+	if(*p) return 0;
+
+	hp_add(a,a,&frac);
+
+	for(;exponent>0;exponent--) mul_small(a,10,0);
+	for(;exponent<0;exponent++) div_small(a,10,0);
+
+	if(sign) negate(a);
+
+	return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef HP_H
+#define HP_H
+
+#include <stdint.h>
+
+/*
+High precision fixed point numbers, used for the reference orbit of a deep zoom.
+
+A number is held in two's complement as n 32-bit limbs, most significant first.
+limb[0] is the (signed) integer part, and limb[i] is worth 2^(-32*i).
+That is plenty of range for Mandelbrot coordinates, which never get much past 4,
+and n limbs give 32*(n-1) bits after the point.
+All of the numbers in one computation must have the same number of limbs.
+*/
+
+#define HP_MAX_LIMBS 64
+
+struct hp {
+	int n;
+	uint32_t limb[HP_MAX_LIMBS];
+};
+
+/* Return the number of limbs needed to resolve steps of size "step". */
+int    hp_limbs_for( double step );
+
+void   hp_from_double( struct hp *a, double d, int n );
+double hp_to_double( const struct hp *a );
+
+/* Split a into the nearest double and what that double leaves out. */
+void   hp_split( const struct hp *a, double *hi, double *lo );
+
+/* Change the number of limbs, dropping low limbs or adding zero ones. */
+void   hp_set_limbs( struct hp *a, int n );
+
+/* Parse a decimal number such as "-0.75", ".5" or "1.25e-3". Returns 0 if it isn't one. */
+int    hp_from_string( struct hp *a, const char *s, int n );
+
+/* r = a+b, r = a-b, r = a*b. r may be the same as a or b. */
+void   hp_add( struct hp *r, const struct hp *a, const struct hp *b );
+void   hp_sub( struct hp *r, const struct hp *a, const struct hp *b );
+void   hp_mul( struct hp *r, const struct hp *a, const struct hp *b );
+
+#endif
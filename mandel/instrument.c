@@ -0,0 +1,209 @@
+#include "instrument.h"
+#include "render.h"
+#include "bitmap.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+struct instrument * instrument_create( void )
+{
+	struct instrument *in = malloc(sizeof(*in));
+	if(!in) return 0;
+	memset(in,0,sizeof(*in));
+	return in;
+}
+
+void instrument_delete( struct instrument *in )
+{
+	if(!in) return;
+	free(in->threads);
+	free(in->units);
+	free(in);
+}
+
+void instrument_reset( struct instrument *in )
+{
+	if(in->threads) memset(in->threads,0,in->nthreads*sizeof(struct thread_counters));
+	if(in->units) memset(in->units,0,in->nunits*sizeof(struct unit_counters));
+}
+
+int instrument_prepare( struct instrument *in, int nthreads, int nunits )
+{
+	// A render may run its threads more than once (the perturbation engine does),
+	// and the counters add up over all of them, so they are only cleared when they change size.
+	if(in->nthreads!=nthreads) {
+		free(in->threads);
+		in->nthreads = 0;
+		if(posix_memalign((void **)&in->threads,64,nthreads*sizeof(struct thread_counters))) {
+			in->threads = 0;
+			return 0;
+		}
+		memset(in->threads,0,nthreads*sizeof(struct thread_counters));
+		in->nthreads = nthreads;
+	}
+
+	if(in->nunits!=nunits) {
+		free(in->units);
+		in->nunits = 0;
+		in->units = calloc(nunits,sizeof(struct unit_counters));
+		if(!in->units) return 0;
+		in->nunits = nunits;
+	}
+
+	return 1;
+}
+
+double instrument_now( void )
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+void instrument_unit( struct instrument *in, int thread, int unit, int x0, int y0, int x1, int y1, long pixels, long iterations, double start )
+{
+	struct unit_counters *u = &in->units[unit];
+	struct thread_counters *t = &in->threads[thread];
+
+	// Only one thread works on a unit in any one pass, so none of this needs locking.
+	u->thread = thread;
+	u->x0 = x0;
+	u->y0 = y0;
+	u->x1 = x1;
+	u->y1 = y1;
+	u->pixels += pixels;
+	u->iterations += iterations;
+	u->seconds += instrument_now()-start;
+
+	t->pixels += pixels;
+	t->iterations += iterations;
+}
+
+long instrument_sum( const int *iters, int n )
+{
+	long sum = 0;
+	int i;
+	for(i=0;i<n;i++) sum += iters[i];
+	return sum;
+}
+
+void * instrument_thread( void *a )
+{
+	struct thread_args *args = a;
+	struct instrument *in = args->r->instrument;
+	struct thread_counters *t = &in->threads[args->tnumber];
+
+	double start = instrument_now();
+	void *result = in->body(a);
+	t->finished = instrument_now();
+	t->busy += t->finished-start;
+
+	return result;
+}
+
+void instrument_finish( struct instrument *in )
+{
+	double last = 0;
+	int i;
+
+	for(i=0;i<in->nthreads;i++) {
+		if(in->threads[i].finished>last) last = in->threads[i].finished;
+	}
+
+	for(i=0;i<in->nthreads;i++) {
+		in->threads[i].idle += last-in->threads[i].finished;
+	}
+}
+
+void instrument_report( struct instrument *in )
+{
+	double busy = 0, maxbusy = 0;
+	long iterations = 0, maxiterations = 0;
+	int i;
+
+	for(i=0;i<in->nthreads;i++) {
+		struct thread_counters *t = &in->threads[i];
+
+		printf("mandel: thread %d computed %ld points, %ld iterations, busy %.3fs, idle at join %.3fs\n",i+1,t->pixels,t->iterations,t->busy,t->idle);
+
+		busy += t->busy;
+		iterations += t->iterations;
+		if(t->busy>maxbusy) maxbusy = t->busy;
+		if(t->iterations>maxiterations) maxiterations = t->iterations;
+	}
+
+	if(in->nthreads<1 || busy<=0) return;
+
+	// 1.0 is a perfect balance; n means one thread did all of the work.
+	double meanbusy = busy/in->nthreads;
+	double meaniterations = (double)iterations/in->nthreads;
+
+	printf("mandel: imbalance: busiest thread %.2fx the mean time, %.2fx the mean iterations\n",maxbusy/meanbusy,meaniterations>0 ? maxiterations/meaniterations : 1.0);
+}
+
+/* From black through red and yellow to white, for t from 0 to 1. */
+
+static int heat( double t )
+{
+	if(t<0) t = 0;
+	if(t>1) t = 1;
+
+	int r = t<1.0/3 ? 255*3*t : 255;
+	int g = t<1.0/3 ? 0 : t<2.0/3 ? 255*(3*t-1) : 255;
+	int b = t<2.0/3 ? 0 : 255*(3*t-2);
+
+	return MAKE_RGBA(r,g,b,0);
+}
+
+int instrument_heatmap( struct instrument *in, const char *file, int width, int height )
+{
+	int k, i, j;
+	size_t len = strlen(file);
+
+	if(len>4 && !strcmp(file+len-4,".csv")) {
+		FILE *f = fopen(file,"w");
+		if(!f) return 0;
+
+		fprintf(f,"unit,thread,x0,y0,x1,y1,pixels,iterations,seconds\n");
+		for(k=0;k<in->nunits;k++) {
+			struct unit_counters *u = &in->units[k];
+			fprintf(f,"%d,%d,%d,%d,%d,%d,%ld,%ld,%.6f\n",k,u->thread+1,u->x0,u->y0,u->x1,u->y1,u->pixels,u->iterations,u->seconds);
+		}
+
+		return fclose(f)==0;
+	}
+
+	struct bitmap *bm = bitmap_create(width,height);
+	if(!bm) return 0;
+
+	bitmap_reset(bm,0);
+
+	// Iterations per point of each unit, on a log scale so the cheap units still show.
+	double most = 0;
+	for(k=0;k<in->nunits;k++) {
+		struct unit_counters *u = &in->units[k];
+		long area = (long)(u->x1-u->x0)*(u->y1-u->y0);
+		if(area>0 && log1p((double)u->iterations/area)>most) most = log1p((double)u->iterations/area);
+	}
+
+	for(k=0;k<in->nunits;k++) {
+		struct unit_counters *u = &in->units[k];
+		long area = (long)(u->x1-u->x0)*(u->y1-u->y0);
+		if(area<=0) continue;
+
+		int color = heat(most>0 ? log1p((double)u->iterations/area)/most : 0);
+		for(j=u->y0;j<u->y1;j++) {
+			for(i=u->x0;i<u->x1;i++) {
+				bitmap_set(bm,i,j,color);
+			}
+		}
+	}
+
+	int ok = bitmap_save(bm,file);
+	bitmap_delete(bm);
+
+	return ok;
+}
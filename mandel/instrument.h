@@ -0,0 +1,79 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/*
+Per-thread and per-unit counters for a render, to see where the time goes
+and how evenly the work was shared. They are only collected when r->instrument
+is set, and then only once per unit of work, so leaving them compiled in costs
+one test per unit when they are off.
+
+For each thread: the points it computed, the iterations they took,
+the time it spent working, and the time it then sat idle until the last thread finished.
+For each unit: which thread took it, the same counts, and how long it took.
+*/
+
+struct render;
+
+struct thread_counters {
+	long pixels;
+	long iterations;
+	double busy;
+	double idle;
+	double finished;
+} __attribute__((aligned(64)));
+
+struct unit_counters {
+	int thread;
+	int x0, y0, x1, y1;
+	long pixels;
+	long iterations;
+	double seconds;
+};
+
+struct instrument {
+	int nthreads;
+	struct thread_counters *threads;
+	int nunits;
+	struct unit_counters *units;
+
+	// The engine's body, while the pool runs the timing wrapper around it.
+	void * (*body)( void *a );
+};
+
+struct instrument * instrument_create( void );
+void                instrument_delete( struct instrument *in );
+
+/* Clear the counters before a render. */
+void                instrument_reset( struct instrument *in );
+
+/* Make room for nthreads threads and nunits units. Returns 0 if out of memory. */
+int                 instrument_prepare( struct instrument *in, int nthreads, int nunits );
+
+/* Return the current time in seconds. */
+double              instrument_now( void );
+
+/*
+Record one unit of work done by thread "thread" since time "start",
+covering the points x0..x1-1, y0..y1-1, of which "pixels" were actually iterated.
+*/
+void                instrument_unit( struct instrument *in, int thread, int unit, int x0, int y0, int x1, int y1, long pixels, long iterations, double start );
+
+/* Return the sum of n counts, as the number of iterations it took to find them. */
+long                instrument_sum( const int *iters, int n );
+
+/* Run r's thread body under a timer. Used by render_threads in place of the body itself. */
+void *              instrument_thread( void *a );
+
+/* Work out the idle times once every thread has finished. */
+void                instrument_finish( struct instrument *in );
+
+/* Print a line per thread, and how far the busiest thread was from the average. */
+void                instrument_report( struct instrument *in );
+
+/*
+Write the cost of every unit of the last render, either as CSV (if file ends in .csv)
+or as a width x height BMP heatmap of iterations per point. Returns 0 on failure.
+*/
+int                 instrument_heatmap( struct instrument *in, const char *file, int width, int height );
+
+#endif
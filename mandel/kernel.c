@@ -0,0 +1,866 @@
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "kernel.h"
+
+/*
+All of the kernels must evaluate exactly the same expressions in the same order,
+so that they agree on every iteration count. This file must be compiled with
+-ffp-contract=off, otherwise the compiler may fuse the multiplies and adds
+in one kernel and not in another.
+*/
+
+/*
+The fractional part of a smooth iteration count, from the squared magnitude
+of the orbit at the iteration where it escaped. With an escape radius of 2,
+that magnitude lies between 4 and 16 for any point in view, which maps to 1..0.
+*/
+
+static float smooth_fraction( double mag )
+{
+	double f = 1 - log2(0.5*log2(mag));
+	if(f<0) f = 0;
+	if(f>1) f = 1;
+	return f;
+}
+
+int iterations_at_point( double x, double y, int max )
+{
+	double x0 = x;
+	double y0 = y;
+
+	int iter = 0;
+
+	while( (x*x + y*y <= 4) && iter < max ) {
+
+		double xt = x*x - y*y + x0;
+		double yt = 2*x*y + y0;
+
+		x = xt;
+		y = yt;
+
+		iter++;
+	}
+
+	return iter;
+}
+
+/*
+Return true if x, y lies inside the main cardioid or the period-2 bulb.
+Those points never escape, so there is no need to iterate them at all.
+*/
+
+static int interior( double x, double y, struct kernel_stats *stats )
+{
+	double xq = x - 0.25;
+	double q = xq*xq + y*y;
+
+	if(q*(q+xq) <= 0.25*y*y) {
+		stats->cardioid++;
+		return 1;
+	}
+
+	if((x+1)*(x+1) + y*y <= 0.0625) {
+		stats->bulb++;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+The first checkpoint for periodicity detection.
+The orbit is compared against the value it had at the last checkpoint,
+and the distance between checkpoints doubles each time (Brent's method).
+If the orbit ever comes back exactly to a previous value, it is caught in
+a cycle and will never escape, so the answer is max. Because the test is
+exact equality, the result is always the same as iterating all the way.
+*/
+
+#define FIRST_CHECKPOINT 8
+
+/*
+Double-double numbers: the unevaluated sum hi+lo of two doubles, with |lo| at most
+half an ulp of hi, which gives about 106 bits. These are the usual error-free
+transformations (Dekker and Knuth), which only work because nothing here is fused.
+*/
+
+struct dd {
+	double hi;
+	double lo;
+};
+
+static inline struct dd dd_quick_two_sum( double a, double b )
+{
+	struct dd r;
+	r.hi = a + b;
+	r.lo = b - (r.hi - a);
+	return r;
+}
+
+static inline struct dd dd_two_sum( double a, double b )
+{
+	struct dd r;
+	r.hi = a + b;
+	double v = r.hi - a;
+	r.lo = (a - (r.hi - v)) + (b - v);
+	return r;
+}
+
+static inline struct dd dd_two_prod( double a, double b )
+{
+	struct dd r;
+	double c = 134217729.0*a;
+	double ah = c - (c - a), al = a - ah;
+	c = 134217729.0*b;
+	double bh = c - (c - b), bl = b - bh;
+
+	r.hi = a*b;
+	r.lo = ((ah*bh - r.hi) + ah*bl + al*bh) + al*bl;
+	return r;
+}
+
+static inline struct dd dd_make( double hi, double lo )
+{
+	return dd_two_sum(hi,lo);
+}
+
+static inline struct dd dd_add( struct dd a, struct dd b )
+{
+	struct dd s = dd_two_sum(a.hi,b.hi);
+	struct dd t = dd_two_sum(a.lo,b.lo);
+	s.lo += t.hi;
+	s = dd_quick_two_sum(s.hi,s.lo);
+	s.lo += t.lo;
+	return dd_quick_two_sum(s.hi,s.lo);
+}
+
+static inline struct dd dd_sub( struct dd a, struct dd b )
+{
+	b.hi = -b.hi;
+	b.lo = -b.lo;
+	return dd_add(a,b);
+}
+
+static inline struct dd dd_mul( struct dd a, struct dd b )
+{
+	struct dd p = dd_two_prod(a.hi,b.hi);
+	p.lo += a.hi*b.lo + a.lo*b.hi;
+	return dd_quick_two_sum(p.hi,p.lo);
+}
+
+/*
+Fixed point numbers: a 64-bit integer counting units of 2^-56, so from -128 to 128.
+An orbit that has not escaped stays within (4+extent)^2 of zero, so views
+reaching no further than FIXED_EXTENT from the origin never overflow.
+*/
+
+#define FIXED_BITS 56
+#define FIXED_EXTENT 4.0
+
+typedef int64_t fixed;
+
+static inline fixed fixed_make( double hi, double lo )
+{
+	return llrint(ldexp(hi,FIXED_BITS)) + llrint(ldexp(lo,FIXED_BITS));
+}
+
+static inline fixed fixed_mul( fixed a, fixed b )
+{
+	return (fixed)(((__int128)a*b) >> FIXED_BITS);
+}
+
+/* One scalar kernel for each precision, from kernel_scalar.h. */
+
+#define SCALAR_NAME       points_scalar
+#define REAL              double
+#define R_LOAD(hi,lo)     (hi)
+#define R_ADD(a,b)        ((a)+(b))
+#define R_SUB(a,b)        ((a)-(b))
+#define R_MUL(a,b)        ((a)*(b))
+#define R_ESCAPED(m)      (!((m)<=4))
+#define R_EQUAL(a,b)      ((a)==(b))
+#define R_DOUBLE(a)       (a)
+#include "kernel_scalar.h"
+
+#define SCALAR_NAME       points_scalar_float
+#define REAL              float
+#define R_LOAD(hi,lo)     ((float)(hi))
+#define R_ADD(a,b)        ((a)+(b))
+#define R_SUB(a,b)        ((a)-(b))
+#define R_MUL(a,b)        ((a)*(b))
+#define R_ESCAPED(m)      (!((m)<=4))
+#define R_EQUAL(a,b)      ((a)==(b))
+#define R_DOUBLE(a)       ((double)(a))
+#include "kernel_scalar.h"
+
+#define SCALAR_NAME       points_scalar_fixed
+#define REAL              fixed
+#define R_LOAD(hi,lo)     fixed_make(hi,lo)
+#define R_ADD(a,b)        ((a)+(b))
+#define R_SUB(a,b)        ((a)-(b))
+#define R_MUL(a,b)        fixed_mul(a,b)
+#define R_ESCAPED(m)      ((m) > ((fixed)4 << FIXED_BITS))
+#define R_EQUAL(a,b)      ((a)==(b))
+#define R_DOUBLE(a)       ldexp((double)(a),-FIXED_BITS)
+#include "kernel_scalar.h"
+
+#define SCALAR_NAME       points_scalar_dd
+#define REAL              struct dd
+#define R_LOAD(hi,lo)     dd_make(hi,lo)
+#define R_ADD(a,b)        dd_add(a,b)
+#define R_SUB(a,b)        dd_sub(a,b)
+#define R_MUL(a,b)        dd_mul(a,b)
+#define R_ESCAPED(m)      ((m).hi > 4 || ((m).hi==4 && (m).lo>0))
+#define R_EQUAL(a,b)      ((a).hi==(b).hi && (a).lo==(b).lo)
+#define R_DOUBLE(a)       ((a).hi + (a).lo)
+#include "kernel_scalar.h"
+
+/*
+A point that is already outside the escape radius.
+Used to pad out a partial vector at the end of a run of points, and to stand in for
+points already resolved by interior(), so that those lanes drop out on
+the very first iteration.
+*/
+
+#define PAD_X 4.0
+
+/*
+Fill in the coordinates for one vector, padding where needed.
+Returns a bit mask of the lanes that are already known to be inside the set.
+*/
+
+static int load_lanes( const double *xs, int xstride, const double *ys, int ystride, int lanes, int width, double *padx, double *pady, struct kernel_stats *stats )
+{
+	int j, inside = 0;
+
+	for(j=0;j<width;j++) {
+		double x = j<lanes ? xs[j*xstride] : PAD_X;
+		double y = j<lanes ? ys[j*ystride] : 0;
+
+		if(j<lanes && stats && interior(x,y,stats)) {
+			x = PAD_X;
+			y = 0;
+			inside |= 1<<j;
+		}
+
+		padx[j] = x;
+		pady[j] = y;
+	}
+
+	return inside;
+}
+
+/*
+Store the counts for one vector.
+Lanes found inside the set, either up front or because they were caught in a cycle, get max.
+*/
+
+static void store_lanes( const double *counts, const double *mags, int lanes, int inside, int cycled, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	int j;
+
+	for(j=0;j<lanes;j++) {
+		if(inside & (1<<j)) {
+			iters[j] = max;
+		} else if(cycled & (1<<j)) {
+			iters[j] = max;
+			stats->periodic++;
+		} else {
+			iters[j] = counts[j];
+		}
+		if(frac) frac[j] = iters[j]<max ? smooth_fraction(mags[j]) : 0;
+	}
+}
+
+/*
+Each vector kernel keeps a mask of the lanes still iterating.
+A lane drops out when it escapes or when it is caught in a cycle,
+and from then on stops counting but keeps iterating with the others.
+Periodicity detection only runs when stats is given,
+and the magnitude of each lane as it escapes is only kept when frac is given.
+*/
+
+__attribute__((target("sse2")))
+static void points_sse2( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m128d four = _mm_set1_pd(4.0);
+	const __m128d one = _mm_set1_pd(1.0);
+	double padx[2], pady[2], counts[2], mags[2];
+	int i, k;
+
+	for(i=0;i<n;i+=2) {
+		int lanes = n-i < 2 ? n-i : 2;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,2,padx,pady,stats);
+
+		__m128d x0 = _mm_loadu_pd(padx);
+		__m128d y0 = _mm_loadu_pd(pady);
+		__m128d x = x0;
+		__m128d yy = y0;
+		__m128d xsave = x, ysave = yy;
+		__m128d count = _mm_setzero_pd();
+		__m128d active = _mm_castsi128_pd(_mm_set1_epi32(-1));
+		__m128d cycled = _mm_setzero_pd();
+		__m128d mag = _mm_setzero_pd();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m128d x2 = _mm_mul_pd(x,x);
+			__m128d y2 = _mm_mul_pd(yy,yy);
+			__m128d m = _mm_add_pd(x2,y2);
+			__m128d was = active;
+			active = _mm_and_pd(active,_mm_cmple_pd(m,four));
+			if(frac) {
+				__m128d escaped = _mm_andnot_pd(active,was);
+				mag = _mm_or_pd(_mm_andnot_pd(escaped,mag),_mm_and_pd(escaped,m));
+			}
+			if(!_mm_movemask_pd(active)) break;
+
+			count = _mm_add_pd(count,_mm_and_pd(active,one));
+
+			__m128d xt = _mm_add_pd(_mm_sub_pd(x2,y2),x0);
+			__m128d yt = _mm_add_pd(_mm_mul_pd(_mm_add_pd(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__m128d same = _mm_and_pd(active,_mm_and_pd(_mm_cmpeq_pd(x,xsave),_mm_cmpeq_pd(yy,ysave)));
+				cycled = _mm_or_pd(cycled,same);
+				active = _mm_andnot_pd(same,active);
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm_storeu_pd(counts,count);
+		_mm_storeu_pd(mags,mag);
+		store_lanes(counts,mags,lanes,inside,_mm_movemask_pd(cycled),max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+__attribute__((target("avx2")))
+static void points_avx2( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m256d four = _mm256_set1_pd(4.0);
+	const __m256d one = _mm256_set1_pd(1.0);
+	double padx[4], pady[4], counts[4], mags[4];
+	int i, k;
+
+	for(i=0;i<n;i+=4) {
+		int lanes = n-i < 4 ? n-i : 4;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,4,padx,pady,stats);
+
+		__m256d x0 = _mm256_loadu_pd(padx);
+		__m256d y0 = _mm256_loadu_pd(pady);
+		__m256d x = x0;
+		__m256d yy = y0;
+		__m256d xsave = x, ysave = yy;
+		__m256d count = _mm256_setzero_pd();
+		__m256d active = _mm256_castsi256_pd(_mm256_set1_epi32(-1));
+		__m256d cycled = _mm256_setzero_pd();
+		__m256d mag = _mm256_setzero_pd();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m256d x2 = _mm256_mul_pd(x,x);
+			__m256d y2 = _mm256_mul_pd(yy,yy);
+			__m256d m = _mm256_add_pd(x2,y2);
+			__m256d was = active;
+			active = _mm256_and_pd(active,_mm256_cmp_pd(m,four,_CMP_LE_OQ));
+			if(frac) mag = _mm256_blendv_pd(mag,m,_mm256_andnot_pd(active,was));
+			if(!_mm256_movemask_pd(active)) break;
+
+			count = _mm256_add_pd(count,_mm256_and_pd(active,one));
+
+			__m256d xt = _mm256_add_pd(_mm256_sub_pd(x2,y2),x0);
+			__m256d yt = _mm256_add_pd(_mm256_mul_pd(_mm256_add_pd(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__m256d same = _mm256_and_pd(active,_mm256_and_pd(_mm256_cmp_pd(x,xsave,_CMP_EQ_OQ),_mm256_cmp_pd(yy,ysave,_CMP_EQ_OQ)));
+				cycled = _mm256_or_pd(cycled,same);
+				active = _mm256_andnot_pd(same,active);
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm256_storeu_pd(counts,count);
+		_mm256_storeu_pd(mags,mag);
+		store_lanes(counts,mags,lanes,inside,_mm256_movemask_pd(cycled),max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void points_avx512( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m512d four = _mm512_set1_pd(4.0);
+	const __m512d one = _mm512_set1_pd(1.0);
+	double padx[8], pady[8], counts[8], mags[8];
+	int i, k;
+
+	for(i=0;i<n;i+=8) {
+		int lanes = n-i < 8 ? n-i : 8;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,8,padx,pady,stats);
+
+		// With AVX-512 the padding and interior lanes are simply masked off from the start.
+		__mmask8 active = (__mmask8)(((1<<lanes)-1) & ~inside);
+		__mmask8 cycled = 0;
+
+		__m512d x0 = _mm512_loadu_pd(padx);
+		__m512d y0 = _mm512_loadu_pd(pady);
+		__m512d x = x0;
+		__m512d yy = y0;
+		__m512d xsave = x, ysave = yy;
+		__m512d count = _mm512_setzero_pd();
+		__m512d mag = _mm512_setzero_pd();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m512d x2 = _mm512_mul_pd(x,x);
+			__m512d y2 = _mm512_mul_pd(yy,yy);
+			__m512d m = _mm512_add_pd(x2,y2);
+			__mmask8 was = active;
+			active &= _mm512_cmp_pd_mask(m,four,_CMP_LE_OQ);
+			if(frac) mag = _mm512_mask_mov_pd(mag,was & ~active,m);
+			if(!active) break;
+
+			count = _mm512_mask_add_pd(count,active,count,one);
+
+			__m512d xt = _mm512_add_pd(_mm512_sub_pd(x2,y2),x0);
+			__m512d yt = _mm512_add_pd(_mm512_mul_pd(_mm512_add_pd(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__mmask8 same = _mm512_mask_cmp_pd_mask(active,x,xsave,_CMP_EQ_OQ) & _mm512_cmp_pd_mask(yy,ysave,_CMP_EQ_OQ);
+				cycled |= same;
+				active &= ~same;
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm512_storeu_pd(counts,count);
+		_mm512_storeu_pd(mags,mag);
+		store_lanes(counts,mags,lanes,inside,cycled,max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+/*
+The float kernels are the same as the ones above, with twice as many lanes.
+They count in integers, since a float only counts exactly to 2^24.
+The lanes are loaded and stored through the double versions of load_lanes and store_lanes.
+*/
+
+static void narrow_lanes( const double *d, float *f, int width )
+{
+	int j;
+	for(j=0;j<width;j++) f[j] = d[j];
+}
+
+static void widen_lanes( const int *icounts, const float *fmags, double *counts, double *mags, int width )
+{
+	int j;
+	for(j=0;j<width;j++) {
+		counts[j] = icounts[j];
+		mags[j] = fmags[j];
+	}
+}
+
+__attribute__((target("sse2")))
+static void points_sse2_float( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m128 four = _mm_set1_ps(4.0f);
+	double padx[4], pady[4], counts[4], mags[4];
+	float fx[4], fy[4], fmags[4];
+	int icounts[4];
+	int i, k;
+
+	for(i=0;i<n;i+=4) {
+		int lanes = n-i < 4 ? n-i : 4;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,4,padx,pady,stats);
+
+		narrow_lanes(padx,fx,4);
+		narrow_lanes(pady,fy,4);
+
+		__m128 x0 = _mm_loadu_ps(fx);
+		__m128 y0 = _mm_loadu_ps(fy);
+		__m128 x = x0;
+		__m128 yy = y0;
+		__m128 xsave = x, ysave = yy;
+		__m128i count = _mm_setzero_si128();
+		__m128 active = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 cycled = _mm_setzero_ps();
+		__m128 mag = _mm_setzero_ps();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m128 x2 = _mm_mul_ps(x,x);
+			__m128 y2 = _mm_mul_ps(yy,yy);
+			__m128 m = _mm_add_ps(x2,y2);
+			__m128 was = active;
+			active = _mm_and_ps(active,_mm_cmple_ps(m,four));
+			if(frac) {
+				__m128 escaped = _mm_andnot_ps(active,was);
+				mag = _mm_or_ps(_mm_andnot_ps(escaped,mag),_mm_and_ps(escaped,m));
+			}
+			if(!_mm_movemask_ps(active)) break;
+
+			// An active lane is all ones, which is -1.
+			count = _mm_sub_epi32(count,_mm_castps_si128(active));
+
+			__m128 xt = _mm_add_ps(_mm_sub_ps(x2,y2),x0);
+			__m128 yt = _mm_add_ps(_mm_mul_ps(_mm_add_ps(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__m128 same = _mm_and_ps(active,_mm_and_ps(_mm_cmpeq_ps(x,xsave),_mm_cmpeq_ps(yy,ysave)));
+				cycled = _mm_or_ps(cycled,same);
+				active = _mm_andnot_ps(same,active);
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm_storeu_si128((__m128i *)icounts,count);
+		_mm_storeu_ps(fmags,mag);
+		widen_lanes(icounts,fmags,counts,mags,4);
+		store_lanes(counts,mags,lanes,inside,_mm_movemask_ps(cycled),max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+__attribute__((target("avx2")))
+static void points_avx2_float( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m256 four = _mm256_set1_ps(4.0f);
+	double padx[8], pady[8], counts[8], mags[8];
+	float fx[8], fy[8], fmags[8];
+	int icounts[8];
+	int i, k;
+
+	for(i=0;i<n;i+=8) {
+		int lanes = n-i < 8 ? n-i : 8;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,8,padx,pady,stats);
+
+		narrow_lanes(padx,fx,8);
+		narrow_lanes(pady,fy,8);
+
+		__m256 x0 = _mm256_loadu_ps(fx);
+		__m256 y0 = _mm256_loadu_ps(fy);
+		__m256 x = x0;
+		__m256 yy = y0;
+		__m256 xsave = x, ysave = yy;
+		__m256i count = _mm256_setzero_si256();
+		__m256 active = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		__m256 cycled = _mm256_setzero_ps();
+		__m256 mag = _mm256_setzero_ps();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m256 x2 = _mm256_mul_ps(x,x);
+			__m256 y2 = _mm256_mul_ps(yy,yy);
+			__m256 m = _mm256_add_ps(x2,y2);
+			__m256 was = active;
+			active = _mm256_and_ps(active,_mm256_cmp_ps(m,four,_CMP_LE_OQ));
+			if(frac) mag = _mm256_blendv_ps(mag,m,_mm256_andnot_ps(active,was));
+			if(!_mm256_movemask_ps(active)) break;
+
+			count = _mm256_sub_epi32(count,_mm256_castps_si256(active));
+
+			__m256 xt = _mm256_add_ps(_mm256_sub_ps(x2,y2),x0);
+			__m256 yt = _mm256_add_ps(_mm256_mul_ps(_mm256_add_ps(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__m256 same = _mm256_and_ps(active,_mm256_and_ps(_mm256_cmp_ps(x,xsave,_CMP_EQ_OQ),_mm256_cmp_ps(yy,ysave,_CMP_EQ_OQ)));
+				cycled = _mm256_or_ps(cycled,same);
+				active = _mm256_andnot_ps(same,active);
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm256_storeu_si256((__m256i *)icounts,count);
+		_mm256_storeu_ps(fmags,mag);
+		widen_lanes(icounts,fmags,counts,mags,8);
+		store_lanes(counts,mags,lanes,inside,_mm256_movemask_ps(cycled),max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+__attribute__((target("avx512f")))
+static void points_avx512_float( const double *xs, int xstride, const double *ys, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	const __m512 four = _mm512_set1_ps(4.0f);
+	const __m512i one = _mm512_set1_epi32(1);
+	double padx[16], pady[16], counts[16], mags[16];
+	float fx[16], fy[16], fmags[16];
+	int icounts[16];
+	int i, k;
+
+	for(i=0;i<n;i+=16) {
+		int lanes = n-i < 16 ? n-i : 16;
+		int inside = load_lanes(xs+i*xstride,xstride,ys+i*ystride,ystride,lanes,16,padx,pady,stats);
+
+		narrow_lanes(padx,fx,16);
+		narrow_lanes(pady,fy,16);
+
+		__mmask16 active = (__mmask16)(((1<<lanes)-1) & ~inside);
+		__mmask16 cycled = 0;
+
+		__m512 x0 = _mm512_loadu_ps(fx);
+		__m512 y0 = _mm512_loadu_ps(fy);
+		__m512 x = x0;
+		__m512 yy = y0;
+		__m512 xsave = x, ysave = yy;
+		__m512i count = _mm512_setzero_si512();
+		__m512 mag = _mm512_setzero_ps();
+		int checkpoint = FIRST_CHECKPOINT;
+
+		for(k=0;k<max;k++) {
+			__m512 x2 = _mm512_mul_ps(x,x);
+			__m512 y2 = _mm512_mul_ps(yy,yy);
+			__m512 m = _mm512_add_ps(x2,y2);
+			__mmask16 was = active;
+			active &= _mm512_cmp_ps_mask(m,four,_CMP_LE_OQ);
+			if(frac) mag = _mm512_mask_mov_ps(mag,was & ~active,m);
+			if(!active) break;
+
+			count = _mm512_mask_add_epi32(count,active,count,one);
+
+			__m512 xt = _mm512_add_ps(_mm512_sub_ps(x2,y2),x0);
+			__m512 yt = _mm512_add_ps(_mm512_mul_ps(_mm512_add_ps(x,x),yy),y0);
+			x = xt;
+			yy = yt;
+
+			if(stats) {
+				__mmask16 same = _mm512_mask_cmp_ps_mask(active,x,xsave,_CMP_EQ_OQ) & _mm512_cmp_ps_mask(yy,ysave,_CMP_EQ_OQ);
+				cycled |= same;
+				active &= ~same;
+
+				if(k+1==checkpoint) {
+					xsave = x;
+					ysave = yy;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		_mm512_storeu_si512(icounts,count);
+		_mm512_storeu_ps(fmags,mag);
+		widen_lanes(icounts,fmags,counts,mags,16);
+		store_lanes(counts,mags,lanes,inside,cycled,max,iters+i,frac ? frac+i : 0,stats);
+	}
+}
+
+kernel_t kernel_select( kernel_t k )
+{
+	__builtin_cpu_init();
+
+	int avx512 = __builtin_cpu_supports("avx512f");
+	int avx2 = __builtin_cpu_supports("avx2");
+	int sse2 = __builtin_cpu_supports("sse2");
+
+	if(k==KERNEL_AUTO) {
+		if(avx512) return KERNEL_AVX512;
+		if(avx2) return KERNEL_AVX2;
+		if(sse2) return KERNEL_SSE2;
+		return KERNEL_SCALAR;
+	}
+
+	// If a kernel was asked for that this CPU can't run, step down to the next one.
+	if(k==KERNEL_AVX512 && !avx512) k = KERNEL_AVX2;
+	if(k==KERNEL_AVX2 && !avx2) k = KERNEL_SSE2;
+	if(k==KERNEL_SSE2 && !sse2) k = KERNEL_SCALAR;
+
+	return k;
+}
+
+static void kernel_points( kernel_t k, precision_t p, const double *xs, const double *xlo, int xstride, const double *ys, const double *ylo, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	if(k==KERNEL_AUTO) k = kernel_select(k);
+
+	// Only float and double have vector kernels.
+	switch(p) {
+		case PRECISION_FIXED:
+			points_scalar_fixed(xs,xlo,xstride,ys,ylo,ystride,n,max,iters,frac,stats);
+			return;
+		case PRECISION_DOUBLE_DOUBLE:
+			points_scalar_dd(xs,xlo,xstride,ys,ylo,ystride,n,max,iters,frac,stats);
+			return;
+		case PRECISION_FLOAT:
+			switch(k) {
+				case KERNEL_AUTO:
+				case KERNEL_SCALAR:
+					points_scalar_float(xs,0,xstride,ys,0,ystride,n,max,iters,frac,stats);
+					break;
+				case KERNEL_SSE2:
+					points_sse2_float(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+					break;
+				case KERNEL_AVX2:
+					points_avx2_float(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+					break;
+				case KERNEL_AVX512:
+					points_avx512_float(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+					break;
+			}
+			return;
+		case PRECISION_AUTO:
+		case PRECISION_DOUBLE:
+			break;
+	}
+
+	switch(k) {
+		case KERNEL_AUTO:
+		case KERNEL_SCALAR:
+			points_scalar(xs,0,xstride,ys,0,ystride,n,max,iters,frac,stats);
+			break;
+		case KERNEL_SSE2:
+			points_sse2(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+			break;
+		case KERNEL_AVX2:
+			points_avx2(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+			break;
+		case KERNEL_AVX512:
+			points_avx512(xs,xstride,ys,ystride,n,max,iters,frac,stats);
+			break;
+	}
+}
+
+void kernel_row( kernel_t k, precision_t p, const double *xs, const double *xlo, double y, double ylo, int n, int max, int *iters, struct kernel_stats *stats )
+{
+	kernel_points(k,p,xs,xlo,1,&y,&ylo,0,n,max,iters,0,stats);
+}
+
+void kernel_row_smooth( kernel_t k, precision_t p, const double *xs, const double *xlo, double y, double ylo, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	kernel_points(k,p,xs,xlo,1,&y,&ylo,0,n,max,iters,frac,stats);
+}
+
+void kernel_column( kernel_t k, precision_t p, double x, double xlo, const double *ys, const double *ylo, int n, int max, int *iters, struct kernel_stats *stats )
+{
+	kernel_points(k,p,&x,&xlo,0,ys,ylo,1,n,max,iters,0,stats);
+}
+
+// Bits to spare beyond telling neighboring points apart.
+#define GUARD_BITS 8
+
+double precision_limit( precision_t p, double extent, int max )
+{
+	// Every orbit reaches a magnitude of 2 before it escapes, whatever the view.
+	if(extent<2) extent = 2;
+
+	// Rounding errors build up along the orbit, roughly with the square root of its length.
+	int guard = GUARD_BITS + (max>1 ? log2(max)/2 : 0);
+
+	switch(p) {
+		case PRECISION_FLOAT:
+			return ldexp(extent,guard-24);
+		case PRECISION_AUTO:
+		case PRECISION_DOUBLE:
+			return ldexp(extent,guard-53);
+		case PRECISION_FIXED:
+			return extent<=FIXED_EXTENT ? ldexp(1,guard-FIXED_BITS) : INFINITY;
+		case PRECISION_DOUBLE_DOUBLE:
+			return ldexp(extent,guard-104);
+	}
+	return INFINITY;
+}
+
+precision_t precision_select( precision_t p, double extent, double step, int max )
+{
+	if(p!=PRECISION_AUTO) return p;
+
+	// Float only has to tell neighboring points apart, and still gets many more
+	// points wrong than double wherever the orbits are long, so it is never picked.
+	if(step>=precision_limit(PRECISION_DOUBLE,extent,max)) return PRECISION_DOUBLE;
+	if(step>=precision_limit(PRECISION_FIXED,extent,max)) return PRECISION_FIXED;
+
+	// Past this, only the perturbation engine will do.
+	return PRECISION_DOUBLE_DOUBLE;
+}
+
+int precision_from_name( const char *name, precision_t *p )
+{
+	if(!strcmp(name,"auto")) {
+		*p = PRECISION_AUTO;
+	} else if(!strcmp(name,"float")) {
+		*p = PRECISION_FLOAT;
+	} else if(!strcmp(name,"double")) {
+		*p = PRECISION_DOUBLE;
+	} else if(!strcmp(name,"fixed")) {
+		*p = PRECISION_FIXED;
+	} else if(!strcmp(name,"double-double") || !strcmp(name,"dd")) {
+		*p = PRECISION_DOUBLE_DOUBLE;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * precision_name( precision_t p )
+{
+	switch(p) {
+		case PRECISION_AUTO:          return "auto";
+		case PRECISION_FLOAT:         return "float";
+		case PRECISION_DOUBLE:        return "double";
+		case PRECISION_FIXED:         return "fixed";
+		case PRECISION_DOUBLE_DOUBLE: return "double-double";
+	}
+	return "unknown";
+}
+
+int kernel_from_name( const char *name, kernel_t *k )
+{
+	if(!strcmp(name,"auto")) {
+		*k = KERNEL_AUTO;
+	} else if(!strcmp(name,"scalar")) {
+		*k = KERNEL_SCALAR;
+	} else if(!strcmp(name,"sse2")) {
+		*k = KERNEL_SSE2;
+	} else if(!strcmp(name,"avx2")) {
+		*k = KERNEL_AVX2;
+	} else if(!strcmp(name,"avx512")) {
+		*k = KERNEL_AVX512;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * kernel_name( kernel_t k )
+{
+	switch(k) {
+		case KERNEL_AUTO:   return "auto";
+		case KERNEL_SCALAR: return "scalar";
+		case KERNEL_SSE2:   return "sse2";
+		case KERNEL_AVX2:   return "avx2";
+		case KERNEL_AVX512: return "avx512";
+	}
+	return "unknown";
+}
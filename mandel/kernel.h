@@ -0,0 +1,88 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+/*
+Escape-time kernels for the Mandelbrot set.
+The scalar kernel is the reference; the vector kernels iterate
+2 (SSE2), 4 (AVX2) or 8 (AVX-512) points at once and must return
+exactly the same iteration counts.
+*/
+
+typedef enum {
+	KERNEL_AUTO,
+	KERNEL_SCALAR,
+	KERNEL_SSE2,
+	KERNEL_AVX2,
+	KERNEL_AVX512
+} kernel_t;
+
+/*
+The arithmetic the kernels iterate in. Float doubles the width of every vector
+but only resolves shallow views; double is the usual choice; fixed point (a
+64-bit integer with 56 bits after the point) resolves a few bits more than
+double over the range of the set; double-double (an unevaluated sum of two
+doubles) about twice as many, at many times the cost, and only in the scalar kernel.
+*/
+
+typedef enum {
+	PRECISION_AUTO,
+	PRECISION_FLOAT,
+	PRECISION_DOUBLE,
+	PRECISION_FIXED,
+	PRECISION_DOUBLE_DOUBLE
+} precision_t;
+
+/* The number of points each shortcut resolved without iterating all the way to max. */
+struct kernel_stats {
+	long cardioid;
+	long bulb;
+	long periodic;
+};
+
+/* Return the number of iterations at point x, y, up to a maximum of max. */
+int          iterations_at_point( double x, double y, int max );
+
+/*
+Compute the iterations at the n points (xs[i],y) in precision p, storing them in iters.
+AUTO picks the widest kernel the CPU supports, and the precision should already be
+resolved with precision_select; AUTO there means double.
+xlo and ylo are the low parts of the coordinates, which only double-double and fixed
+point are precise enough to use. xlo may be null if they are all zero.
+If stats is not null, points inside the main cardioid and period-2 bulb are
+skipped and orbits are checked for cycles, and stats counts how often each
+of these shortcuts was taken. The counts are the same either way.
+*/
+void         kernel_row( kernel_t k, precision_t p, const double *xs, const double *xlo, double y, double ylo, int n, int max, int *iters, struct kernel_stats *stats );
+
+/*
+The same as kernel_row, but also store the fractional part of a smooth
+(continuous) iteration count in frac, between 0 and 1. Points that reach max get 0.
+*/
+void         kernel_row_smooth( kernel_t k, precision_t p, const double *xs, const double *xlo, double y, double ylo, int n, int max, int *iters, float *frac, struct kernel_stats *stats );
+
+/* The same as kernel_row, but for the n points (x,ys[i]) down a column. ylo may be null. */
+void         kernel_column( kernel_t k, precision_t p, double x, double xlo, const double *ys, const double *ylo, int n, int max, int *iters, struct kernel_stats *stats );
+
+/* Resolve AUTO to a concrete kernel, and fall back to one the CPU actually supports. */
+kernel_t     kernel_select( kernel_t k );
+
+/* Convert between a kernel and its name. Returns 0 if the name is unknown. */
+int          kernel_from_name( const char *name, kernel_t *k );
+const char * kernel_name( kernel_t k );
+
+/*
+Resolve AUTO to the cheapest precision, no less than double, that can still tell apart
+points "step" apart, in a view whose coordinates reach "extent", with orbits up to max
+iterations long.
+Any other precision is returned as it is.
+*/
+precision_t  precision_select( precision_t p, double extent, double step, int max );
+
+/* The smallest step that precision p resolves in a view whose coordinates reach "extent". */
+double       precision_limit( precision_t p, double extent, int max );
+
+/* Convert between a precision and its name. Returns 0 if the name is unknown. */
+int          precision_from_name( const char *name, precision_t *p );
+const char * precision_name( precision_t p );
+
+#endif
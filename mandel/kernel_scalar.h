@@ -0,0 +1,93 @@
+/*
+The scalar kernel, written once for every precision.
+
+kernel.c includes this file once per precision, so it has no include guard.
+Before each inclusion it defines:
+
+SCALAR_NAME       the name of the function to define
+REAL              the type of a coordinate
+R_LOAD(hi,lo)     a REAL from a coordinate and its low part
+R_ADD(a,b)        a+b
+R_SUB(a,b)        a-b
+R_MUL(a,b)        a*b
+R_ESCAPED(m)      true if the squared magnitude m is more than 4
+R_EQUAL(a,b)      true if a and b are exactly the same
+R_DOUBLE(a)       a rounded to a double
+
+In double this evaluates exactly the same expressions as iterations_at_point,
+so the vector kernels still have to agree with it.
+*/
+
+static void SCALAR_NAME( const double *xs, const double *xlo, int xstride, const double *ys, const double *ylo, int ystride, int n, int max, int *iters, float *frac, struct kernel_stats *stats )
+{
+	int i;
+
+	for(i=0;i<n;i++) {
+		double xd = xs[i*xstride];
+		double yd = ys[i*ystride];
+
+		if(stats && interior(xd,yd,stats)) {
+			iters[i] = max;
+			if(frac) frac[i] = 0;
+			continue;
+		}
+
+		REAL x0 = R_LOAD(xd,xlo ? xlo[i*xstride] : 0);
+		REAL y0 = R_LOAD(yd,ylo ? ylo[i*ystride] : 0);
+		REAL x = x0;
+		REAL y = y0;
+		REAL xsave = x;
+		REAL ysave = y;
+		int checkpoint = FIRST_CHECKPOINT;
+		double mag = 0;
+		int iter = 0;
+
+		for(;;) {
+			REAL x2 = R_MUL(x,x);
+			REAL y2 = R_MUL(y,y);
+			REAL m = R_ADD(x2,y2);
+
+			if(R_ESCAPED(m)) {
+				mag = R_DOUBLE(m);
+				break;
+			}
+			if(iter==max) break;
+
+			REAL xt = R_ADD(R_SUB(x2,y2),x0);
+			REAL yt = R_ADD(R_MUL(R_ADD(x,x),y),y0);
+
+			x = xt;
+			y = yt;
+
+			iter++;
+
+			// Periodicity detection, as described at FIRST_CHECKPOINT.
+			if(stats) {
+				if(R_EQUAL(x,xsave) && R_EQUAL(y,ysave)) {
+					stats->periodic++;
+					iter = max;
+					break;
+				}
+
+				if(iter==checkpoint) {
+					xsave = x;
+					ysave = y;
+					checkpoint *= 2;
+				}
+			}
+		}
+
+		iters[i] = iter;
+		if(frac) frac[i] = iter<max ? smooth_fraction(mag) : 0;
+	}
+}
+
+#undef SCALAR_NAME
+#undef REAL
+#undef R_LOAD
+#undef R_ADD
+#undef R_SUB
+#undef R_MUL
+#undef R_ESCAPED
+#undef R_EQUAL
+#undef R_DOUBLE
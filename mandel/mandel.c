@@ -1,5 +1,18 @@
 
 #include "bitmap.h"
+#include "render.h"
+#include "deepzoom.h"
+#include "batch.h"
+#include "reproject.h"
+#include "palette.h"
+#include "stream.h"
+#include "instrument.h"
+#include "tilequeue.h"
+#include "tileworker.h"
+#include "antialias.h"
+#include "pool.h"
+#include "server.h"
+#include "progressive.h"
 
 #include <getopt.h>
 #include <stdlib.h>
@@ -7,22 +20,10 @@
 #include <math.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <pthread.h>
-
-struct thread_args {
-	struct bitmap *bm;
-	double xmin; 
-	double xmax; 
-	double ymin; 
-	double ymax;
-	double max;
-	int threads;
-	int tnumber;
-};
-
-int iteration_to_color( int i, int max );
-int iterations_at_point( double x, double y, int max );
-void * compute_image( void *a );
+#include <signal.h>
+#include <sys/time.h>
 
 void show_help()
 {
@@ -36,39 +37,190 @@ void show_help()
 	printf("-H <pixels> Height of the image in pixels. (default=500)\n");
 	printf("-o <file>   Set output file. (default=mandel.bmp)\n");
 	printf("-n <threads>Maximum number of threads to use. (default=1)\n");
+	printf("-S <mode>   How rows are divided among threads: static, dynamic or steal. (default=dynamic)\n");
+	printf("-c <rows>   Number of rows in each unit of work. (default=4)\n");
+	printf("-e <engine> How the image is computed: brute, subdivide or perturb. (default=brute)\n");
+	printf("-T <pixels> Size of the tiles used by the subdivide engine. (default=64)\n");
+	printf("-V          Verify the image pixel for pixel against the brute force engine.\n");
+	printf("-k <kernel> Escape-time kernel: auto, scalar, sse2, avx2 or avx512. (default=auto)\n");
+	printf("-p <prec>   Arithmetic of the kernels: auto, float, double, fixed or double-double. auto picks the cheapest\n");
+	printf("            that can tell neighboring pixels apart at this scale, starting from double. (default=auto)\n");
+	printf("            float is faster, but gets about 20 times as many pixels wrong as double where orbits are long.\n");
+	printf("-C          Check every point against the scalar kernel.\n");
+	printf("-B          Brute force: don't skip interior points or detect cycles.\n");
+	printf("-F <frames> Render a zoom of this many frames in one process, into files named by -o. (default=mandel%%d.bmp)\n");
+	printf("-X <coord>  X coordinate of the center of the last frame. (default=-x)\n");
+	printf("-Y <coord>  Y coordinate of the center of the last frame. (default=-y)\n");
+	printf("-Z <scale>  Scale of the last frame. (default=-s)\n");
+	printf("-E <easing> How the zoom speeds up and slows down: linear, in, out or inout. (default=linear)\n");
+	printf("-R <pixels> In a zoom, reuse points of the previous frame that are this close to a point of the new one.\n");
+	printf("            -R 0 only reuses points at exactly the same place, so the frames are identical to a full render.\n");
+	printf("-P <palette>How counts are colored: gray, lut or histogram. (default=gray)\n");
+	printf("-f          Keep smooth (fractional) counts, to color without banding. Brute force engine only.\n");
+	printf("-D <file>   Dump the iteration counts to a file, as well as the image.\n");
+	printf("-L <file>   Load the iteration counts from a file made with -D, and only color them.\n");
+	printf("-M <MB>     Stream the image to the output file in bands of rows, using about this much memory.\n");
+	printf("            For images too big to fit in memory. Not with -e perturb, -F, -f, -D, -L, -V or -P histogram.\n");
+	printf("            With -U, the memory for the tile cache instead. (default=256)\n");
+	printf("-b <cpus>   Pin thread i to the i-th of these CPUs, such as 0-7 or 0,2,4,6, or all for every CPU we may use.\n");
+	printf("-i          Have each thread first touch the rows it will compute, and its band of the image,\n");
+	printf("            so their memory is allocated on its own NUMA node. Best with -S static and -b.\n");
+	printf("-d <bits>   Keep the image as 8 or 16-bit indices into its colors, rather than 32-bit colors.\n");
+	printf("            8-bit images are saved as 8-bit BMPs. Not with -f or -A, nor -d 8 with -M. (default=32)\n");
+	printf("-z          With -d 8, save the BMPs run-length encoded (BI_RLE8).\n");
+	printf("-g          Render progressively: 1/16 of the points, then 1/4, then all of them, writing the image\n");
+	printf("            so far to the output file after each stage. Interrupting it stops after the current stage.\n");
+	printf("            Brute force engine only, and not with -F, -M, -L, -I, -Q or -U.\n");
+	printf("-I          Count the points, iterations, busy and idle time of every thread, and report the imbalance.\n");
+	printf("-G <file>   With -I, write the cost of every unit of work as a heatmap BMP, or as CSV if the file ends in .csv.\n");
+	printf("-A <n>      Anti-alias: supersample pixels on an edge with n x n samples each.\n");
+	printf("-a <count>  With -A, a pixel is on an edge if a neighbor's count differs by more than this.\n");
+	printf("            Below zero, every pixel is supersampled. (default=1)\n");
+	printf("-Q <name>   Work on the shared tile queue of a multi-process movie, set up by mandelmovie -t.\n");
+	printf("            The size, view and output files all come from the queue. Not with -e perturb, -F, -f, -D, -L, -M or -V.\n");
+	printf("-U <socket> Run as a server, rendering tiles for clients on this UNIX socket until killed.\n");
+	printf("            See client.h for the requests, and mandelclient and mandelload for clients. Not with -e perturb,\n");
+	printf("            -F, -f, -D, -L, -V, -A or -Q. The threads, kernel, precision and engine apply to every tile.\n");
 	printf("-h          Show this help text.\n");
 	printf("\nSome examples are:\n");
 	printf("mandel -x -0.5 -y -0.5 -s 0.2\n");
 	printf("mandel -x -.38 -y -.665 -s .05 -m 100\n");
-	printf("mandel -x 0.286932 -y 0.014287 -s .0005 -m 1000\n\n");
+	printf("mandel -x 0.286932 -y 0.014287 -s .0005 -m 1000\n");
+	printf("mandel -x -1.999985882 -y 0 -s 1e-30 -m 5000 -e perturb\n");
+	printf("mandel -x 0.286932 -y 0.014287 -s 2 -Z .000001 -F 50 -m 2000 -W 800 -H 600\n");
+	printf("mandel -x -.5 -s 1.3 -m 2000 -f -D mandel.it; mandel -L mandel.it -P histogram\n");
+	printf("mandel -x -.5 -s 1.3 -W 65536 -H 65536 -M 256 -e subdivide -n 8\n");
+	printf("mandel -U mandel.sock -n 8 -M 512\n");
+	printf("mandel -x -.743643 -y .131825 -s .00001 -m 20000 -W 2000 -H 2000 -n 8 -g\n\n");
+}
+
+// What the stages of a progressive render need to write out the image so far.
+struct preview {
+	struct bitmap *bm;
+	palette_t palette;
+	const char *outfile;
+	int threads;
+	struct timeval start;
+};
+
+// The progressive render to stop when interrupted, if any.
+static struct progressive *running = 0;
+
+static void cancel( int sig )
+{
+	if(running) progressive_cancel(running);
+}
+
+/*
+Save the image under a temporary name and then rename it over the output file,
+so that anything watching the file never sees half of an image.
+*/
+
+static int save_whole( struct bitmap *bm, const char *outfile, int threads )
+{
+	char temporary[4096];
+
+	if(snprintf(temporary,sizeof(temporary),"%s.part",outfile)>=sizeof(temporary)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	if(!bitmap_save_threads(bm,temporary,threads)) {
+		unlink(temporary);
+		return 0;
+	}
+
+	return rename(temporary,outfile)==0;
+}
+
+/* Color and write the image after a coarse stage of a progressive render. */
+
+static int show_stage( struct render *r, int stride, void *arg )
+{
+	struct preview *preview = arg;
+	struct timeval now;
+
+	if(!palette_apply_bitmap(preview->palette,r->iters,r->frac,r->width*r->height,r->max,preview->bm,r->pool)) {
+		fprintf(stderr,"mandel: couldn't color the image\n");
+		return 0;
+	}
+
+	if(!save_whole(preview->bm,preview->outfile,preview->threads)) {
+		fprintf(stderr,"mandel: couldn't write to %s: %s\n",preview->outfile,strerror(errno));
+		return 0;
+	}
+
+	gettimeofday(&now,0);
+	printf("mandel: 1/%d of the points written to %s after %.3fs\n",stride*stride,preview->outfile,(now.tv_sec-preview->start.tv_sec)+(now.tv_usec-preview->start.tv_usec)/1000000.0);
+	fflush(stdout);
+
+	return 1;
 }
 
 int main( int argc, char *argv[] )
 {
-	char c;
+	int c;
 
 	// These are the default configuration values used
 	// if no command line arguments are given.
 
-	const char *outfile = "mandel.bmp";
+	const char *outfile = 0;
 	double xcenter = 0;
 	double ycenter = 0;
+	const char *xtext = "0";
+	const char *ytext = "0";
 	double scale = 4;
 	int    image_width = 500;
 	int    image_height = 500;
 	int    max = 1000;
 	int    threads = 1;
+	int    chunk = 4;
+	schedule_t schedule = SCHEDULE_DYNAMIC;
+	kernel_t kernel = KERNEL_AUTO;
+	precision_t precision = PRECISION_AUTO;
+	int    check = 0;
+	int    shortcuts = 1;
+	engine_t engine = ENGINE_BRUTE;
+	int    tile = 64;
+	int    verify = 0;
+	int    frames = 0;
+	double xend = NAN;
+	double yend = NAN;
+	const char *xendtext = 0;
+	const char *yendtext = 0;
+	double scale_end = NAN;
+	easing_t easing = EASING_LINEAR;
+	double reuse = -1;
+	palette_t palette = PALETTE_GRAY;
+	int    smooth = 0;
+	const char *dumpfile = 0;
+	const char *loadfile = 0;
+	long   budget = 0;
+	int    instrument = 0;
+	const char *heatmap = 0;
+	const char *queuename = 0;
+	int    samples = 0;
+	int    threshold = 1;
+	int   *cpus = 0;
+	int    ncpus = 0;
+	int    first_touch = 0;
+	int    depth = 32;
+	const char *socketpath = 0;
+	int    rle = 0;
+	int    progressive = 0;
 
 	// For each command line argument given,
 	// override the appropriate configuration value.
 
-	while((c = getopt(argc,argv,"x:y:s:W:H:m:o:n:h"))!=-1) {
+	while((c = getopt(argc,argv,"x:y:s:W:H:m:o:n:S:c:e:T:Vk:CBF:X:Y:Z:E:R:P:fD:L:M:IG:p:Q:A:a:b:id:zU:gh"))!=-1) {
 		switch(c) {
 			case 'x':
 				xcenter = atof(optarg);
+				xtext = optarg;
 				break;
 			case 'y':
 				ycenter = atof(optarg);
+				ytext = optarg;
 				break;
 			case 's':
 				scale = atof(optarg);
@@ -88,6 +240,131 @@ int main( int argc, char *argv[] )
 			case 'n':
 				threads = atoi(optarg);
 				break;
+			case 'S':
+				if(!schedule_from_name(optarg,&schedule)) {
+					fprintf(stderr,"mandel: unknown schedule %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'c':
+				chunk = atoi(optarg);
+				break;
+			case 'e':
+				if(!engine_from_name(optarg,&engine)) {
+					fprintf(stderr,"mandel: unknown engine %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'T':
+				tile = atoi(optarg);
+				break;
+			case 'V':
+				verify = 1;
+				break;
+			case 'k':
+				if(!kernel_from_name(optarg,&kernel)) {
+					fprintf(stderr,"mandel: unknown kernel %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'p':
+				if(!precision_from_name(optarg,&precision)) {
+					fprintf(stderr,"mandel: unknown precision %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'C':
+				check = 1;
+				break;
+			case 'B':
+				shortcuts = 0;
+				break;
+			case 'F':
+				frames = atoi(optarg);
+				break;
+			case 'X':
+				xend = atof(optarg);
+				xendtext = optarg;
+				break;
+			case 'Y':
+				yend = atof(optarg);
+				yendtext = optarg;
+				break;
+			case 'Z':
+				scale_end = atof(optarg);
+				break;
+			case 'E':
+				if(!easing_from_name(optarg,&easing)) {
+					fprintf(stderr,"mandel: unknown easing %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'R':
+				reuse = atof(optarg);
+				if(reuse<0) reuse = 0;
+				break;
+			case 'P':
+				if(!palette_from_name(optarg,&palette)) {
+					fprintf(stderr,"mandel: unknown palette %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'f':
+				smooth = 1;
+				break;
+			case 'D':
+				dumpfile = optarg;
+				break;
+			case 'L':
+				loadfile = optarg;
+				break;
+			case 'M':
+				budget = atol(optarg)*1024*1024;
+				if(budget<1) budget = 1;
+				break;
+			case 'I':
+				instrument = 1;
+				break;
+			case 'G':
+				heatmap = optarg;
+				instrument = 1;
+				break;
+			case 'Q':
+				queuename = optarg;
+				break;
+			case 'A':
+				samples = atoi(optarg);
+				break;
+			case 'a':
+				threshold = atoi(optarg);
+				break;
+			case 'b':
+				free(cpus);
+				ncpus = pool_parse_cpus(optarg,&cpus);
+				if(!ncpus) {
+					fprintf(stderr,"mandel: bad list of cpus %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'i':
+				first_touch = 1;
+				break;
+			case 'd':
+				depth = atoi(optarg);
+				if(depth!=8 && depth!=16 && depth!=32) {
+					fprintf(stderr,"mandel: the depth must be 8, 16 or 32 bits\n");
+					exit(1);
+				}
+				break;
+			case 'z':
+				rle = 1;
+				break;
+			case 'U':
+				socketpath = optarg;
+				break;
+			case 'g':
+				progressive = 1;
+				break;
 			case 'h':
 				show_help();
 				exit(1);
@@ -95,139 +372,398 @@ int main( int argc, char *argv[] )
 		}
 	}
 
-	// Display the configuration of the image.
-	printf("mandel: x=%lf y=%lf scale=%lf max=%d outfile=%s threads=%d\n",xcenter,ycenter,scale,max,outfile, threads);
+	if(threads<1) threads = 1;
+	if(chunk<1) chunk = 1;
+	if(tile<2) tile = 2;
+	kernel = kernel_select(kernel);
 
-	// Create a bitmap of the appropriate size.
-	struct bitmap *bm = bitmap_create(image_width,image_height);
+	if(!outfile) outfile = frames>0 ? "mandel%d.bmp" : "mandel.bmp";
+
+	if(frames>0 && !strstr(outfile,"%d")) {
+		fprintf(stderr,"mandel: with -F, the output file must contain %%d for the frame number\n");
+		exit(1);
+	}
 
-	// Fill it with a dark blue, for debugging
-	bitmap_reset(bm,MAKE_RGBA(0,0,255,0));
+	if(smooth && (engine!=ENGINE_BRUTE || frames>0)) {
+		fprintf(stderr,"mandel: -f only works for single images with the brute force engine\n");
+		exit(1);
+	}
 
-	// Compute the Mandelbrot image
-	int activeThreads = 0;
-	struct thread_args args[threads];
-	pthread_t tid[threads];
-	pthread_attr_t attr;
-	pthread_attr_init(&attr);
+	if(samples>0 && (engine==ENGINE_PERTURB || frames>0 || budget || queuename)) {
+		fprintf(stderr,"mandel: -A only works for single images, and not with -e perturb or -M\n");
+		exit(1);
+	}
+
+	if(depth<32 && (smooth || samples>0 || (depth==8 && budget))) {
+		fprintf(stderr,"mandel: -d can't be used with -f or -A, and -d 8 can't be used with -M\n");
+		exit(1);
+	}
+
+	if(rle && depth!=8) {
+		fprintf(stderr,"mandel: -z only works with -d 8\n");
+		exit(1);
+	}
+
+	if(progressive && (engine!=ENGINE_BRUTE || frames>0 || budget || loadfile || instrument || queuename || socketpath)) {
+		fprintf(stderr,"mandel: -g only works with the brute force engine, and not with -F, -M, -L, -I, -Q or -U\n");
+		exit(1);
+	}
+
+	// A server takes its views from its clients, and uses -M for its cache.
+	if(socketpath) {
+		if(engine==ENGINE_PERTURB || frames>0 || smooth || dumpfile || loadfile || verify || samples>0 || queuename) {
+			fprintf(stderr,"mandel: -U can't be used with -e perturb, -F, -f, -D, -L, -V, -A or -Q\n");
+			exit(1);
+		}
+
+		struct render *r = render_create(image_width,image_height);
+		if(!r) {
+			fprintf(stderr,"mandel: out of memory\n");
+			exit(1);
+		}
+
+		r->threads = threads;
+		r->schedule = schedule;
+		r->chunk = chunk;
+		r->tile = tile;
+		r->kernel = kernel;
+		r->precision = precision;
+		r->shortcuts = shortcuts;
+		r->check = check;
+		r->cpus = cpus;
+		r->ncpus = ncpus;
 
-	//Find the scale that each thread will handle
-	double yscale = scale / threads;
-	ycenter = ycenter - yscale;
+		printf("mandel: server threads=%d schedule=%s chunk=%d kernel=%s precision=%s engine=%s\n",threads,schedule_name(schedule),chunk,kernel_name(kernel),precision_name(precision),engine_name(engine));
 
-	//Start the loop to create all threads
-	while(activeThreads < threads) {
-		activeThreads++;
-		
-		//set all the arguments
-		args[activeThreads].bm = bm;
-		args[activeThreads].xmin = xcenter-scale;
-		args[activeThreads].xmax = xcenter+scale;
-		args[activeThreads].ymin = ycenter-yscale;
-		args[activeThreads].ymax = ycenter+yscale;
-		args[activeThreads].max = max;
-		args[activeThreads].threads = threads;
-		args[activeThreads].tnumber = activeThreads;
+		int ok = server_run(r,engine,socketpath,budget ? budget : 256L<<20);
 
-		//create a new thread
-		printf("Creating thread %d\n", activeThreads);
-		if(pthread_create(&tid[activeThreads], &attr, compute_image, &args[activeThreads]) != 0){
-			printf("mandel: couldn't create new thread %d: %s\n", activeThreads,strerror(errno));
+		render_delete(r);
+
+		return ok ? 0 : 1;
+	}
+
+	// When streaming, the render and the bitmap only hold one band of rows.
+	int rows = image_height;
+
+	if(budget) {
+		if(engine==ENGINE_PERTURB || frames>0 || smooth || dumpfile || loadfile || verify || palette==PALETTE_HISTOGRAM) {
+			fprintf(stderr,"mandel: -M can't be used with -e perturb, -F, -f, -D, -L, -V or -P histogram\n");
+			exit(1);
 		}
+		rows = stream_band_rows(image_width,budget);
+		if(rows>image_height) rows = image_height;
 	}
 
-	//Start the loop to join all threads
-	while(activeThreads > 0) {
-		printf("Joining thread %d\n", activeThreads);
-		if(pthread_join(tid[activeThreads], NULL) != 0){
-			printf("mandel: couldn't join thread %d: %s\n", activeThreads,strerror(errno));
+	// A worker of a movie gets everything about the frames from the queue, and renders them a band at a time.
+	struct tilequeue *queue = 0;
+
+	if(queuename) {
+		if(engine==ENGINE_PERTURB || frames>0 || smooth || dumpfile || loadfile || budget || verify) {
+			fprintf(stderr,"mandel: -Q can't be used with -e perturb, -F, -f, -D, -L, -M or -V\n");
+			exit(1);
+		}
+		queue = tilequeue_open(queuename);
+		if(!queue) {
+			fprintf(stderr,"mandel: couldn't open the queue %s: %s\n",queuename,strerror(errno));
+			exit(1);
+		}
+		image_width = queue->header->width;
+		image_height = queue->header->height;
+		max = queue->header->max;
+		rows = queue->header->band_rows;
+	}
+
+	struct render *r;
+
+	if(loadfile) {
+		// The counts, and so the size of the image, come from the file.
+		r = render_load(loadfile);
+		if(!r) {
+			fprintf(stderr,"mandel: couldn't load %s: %s\n",loadfile,strerror(errno));
+			return 1;
+		}
+		image_width = r->width;
+		image_height = r->height;
+		max = r->max;
+
+		printf("mandel: loaded %dx%d counts with max=%d from %s outfile=%s palette=%s\n",image_width,image_height,max,loadfile,outfile,palette_name(palette));
+	} else {
+		// Display the configuration of the image.
+		if(queue) {
+			printf("mandel: worker %d on %s: %d frames of %dx%d with max=%d in bands of %d rows threads=%d kernel=%s engine=%s palette=%s\n",(int)getpid(),queuename,queue->header->frames,image_width,image_height,max,rows,threads,kernel_name(kernel),engine_name(engine),palette_name(palette));
+		} else {
+			printf("mandel: x=%s y=%s scale=%g max=%d outfile=%s threads=%d schedule=%s chunk=%d kernel=%s engine=%s palette=%s\n",xtext,ytext,scale,max,outfile,threads,schedule_name(schedule),chunk,kernel_name(kernel),engine_name(engine),palette_name(palette));
 		}
 
-		activeThreads--;
+		// Set up the render, which holds the iteration count of every point.
+		r = render_create(image_width,rows);
 	}
 
-	// Save the image in the stated file.
-	if(!bitmap_save(bm,outfile)) {
-		fprintf(stderr,"mandel: couldn't write to %s: %s\n",outfile,strerror(errno));
+	// Create a bitmap of the appropriate size.
+	struct bitmap *bm = depth<32 ? bitmap_create_indexed(image_width,queue ? image_height : rows,depth) : bitmap_create(image_width,queue ? image_height : rows);
+	if(bm) bitmap_set_rle(bm,rle);
+
+	if(!bm || !r || (smooth && !render_enable_smooth(r))) {
+		fprintf(stderr,"mandel: couldn't allocate a %dx%d image: %s\n",image_width,image_height,strerror(errno));
 		return 1;
 	}
 
-	return 0;
-}
+	if(loadfile) {
+		// Nothing to compute.
+	} else if(engine==ENGINE_PERTURB) {
+		// Keep every digit of the center, not just what fits in a double.
+		if(!deepzoom_set_view(r,xtext,ytext,scale,max)) {
+			fprintf(stderr,"mandel: couldn't use %s,%s as a center point\n",xtext,ytext);
+			return 1;
+		}
+	} else if(!render_set_view_text(r,xtext,ytext,scale,max)) {
+		fprintf(stderr,"mandel: couldn't use %s,%s as a center point\n",xtext,ytext);
+		return 1;
+	}
+	r->threads = threads;
+	r->schedule = schedule;
+	r->chunk = chunk;
+	r->tile = tile;
+	r->kernel = kernel;
+	r->precision = precision;
+	r->shortcuts = shortcuts;
+	r->check = check;
+	r->cpus = cpus;
+	r->ncpus = ncpus;
+	r->first_touch = first_touch;
+
+	if(ncpus>0) {
+		printf("mandel: threads pinned to cpus %d",cpus[0]);
+		for(c=1;c<ncpus && c<threads;c++) printf(",%d",cpus[c]);
+		printf("\n");
+	}
 
-/*
-Compute an entire Mandelbrot image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax), limiting iterations to "max"
-*/
+	// Fill it with a dark blue, for debugging.
+	// With -i, the threads do it, so each one's band of the image starts out on its own node.
+	if(first_touch) {
+		if(!render_pool(r)) return 1;
+		bitmap_reset_threads(bm,MAKE_RGBA(0,0,255,0),r->pool);
+	} else {
+		bitmap_reset(bm,MAKE_RGBA(0,0,255,0));
+	}
 
-void * compute_image( void *a )
-{
-	int i,j;
+	struct preview preview = { bm, palette, outfile, threads };
+
+	if(progressive) {
+		r->progressive = progressive_create(show_stage,&preview);
+		if(!r->progressive) {
+			fprintf(stderr,"mandel: out of memory\n");
+			return 1;
+		}
+
+		// Stop cleanly after the stage being computed, leaving the image so far in the output file.
+		struct sigaction action;
+		memset(&action,0,sizeof(action));
+		action.sa_handler = cancel;
+		running = r->progressive;
+		sigaction(SIGINT,&action,0);
+		sigaction(SIGTERM,&action,0);
+	}
+
+	if(instrument && !loadfile) {
+		r->instrument = instrument_create();
+		if(!r->instrument) {
+			fprintf(stderr,"mandel: out of memory\n");
+			return 1;
+		}
+	}
 
-	struct thread_args *args = a;
+	if(queue) {
+		int ok = tileworker_run(r,bm,queue,engine,palette);
 
-	int width = bitmap_width(args->bm);
-	int height = bitmap_height(args->bm) / args->threads;
+		tilequeue_close(queue);
+		render_delete(r);
+		bitmap_delete(bm);
 
-	// For every pixel in the image...
-	int start = height * (args->tnumber - 1);
+		return ok ? 0 : 1;
+	}
 
-	for(j = start; j<start + height; j++) {
+	if(budget) {
+		printf("mandel: streaming in bands of %d rows\n",rows);
 
-		for(i=0;i<width;i++) {
+		int ok = stream_run(r,bm,engine,palette,xtext,ytext,scale,max,image_height,outfile);
 
-			// Determine the point in x,y space for that pixel.
-			double x = args->xmin + i*(args->xmax - args->xmin)/width;
-			double y = args->ymin + j*(args->ymax - args->ymin)/height;
+		render_delete(r);
+		bitmap_delete(bm);
 
-			// Compute the iterations at that point.
-			int iters = iterations_at_point(x,y, args->max);
+		return ok ? 0 : 1;
+	}
 
-			// Set the pixel in the bitmap.
-			bitmap_set(args->bm,i,j,iters);
+	if(frames>0) {
+		// Render the whole zoom here, reusing the render and its threads for every frame.
+		struct zoom_path path = {
+			xcenter, ycenter, scale,
+			isnan(xend) ? xcenter : xend,
+			isnan(yend) ? ycenter : yend,
+			isnan(scale_end) ? scale : scale_end,
+			frames, easing,
+			xtext, ytext,
+			xendtext ? xendtext : xtext,
+			yendtext ? yendtext : ytext
+		};
+
+		printf("mandel: %d frames to x=%lf y=%lf scale=%g easing=%s\n",frames,path.xend,path.yend,path.scale_end,easing_name(easing));
+
+		if(reuse>=0) {
+			if(engine!=ENGINE_BRUTE) {
+				fprintf(stderr,"mandel: -R only works with the brute force engine\n");
+				return 1;
+			}
+			r->reproject = reproject_create(image_width,image_height,reuse);
+			if(!r->reproject) {
+				fprintf(stderr,"mandel: out of memory\n");
+				return 1;
+			}
 		}
+
+		int ok = batch_run(r,bm,engine,palette,&path,max,outfile);
+
+		render_delete(r);
+		bitmap_delete(bm);
+
+		return ok ? 0 : 1;
 	}
-	pthread_exit((void *) 1);
-}
 
-/*
-Return the number of iterations at point x, y
-in the Mandelbrot space, up to a maximum of max.
-*/
+	struct timeval start, end;
 
-int iterations_at_point( double x, double y, int max )
-{
-	double x0 = x;
-	double y0 = y;
+	// Compute the Mandelbrot image
+	if(!loadfile) {
+		gettimeofday(&start,0);
+		preview.start = start;
+		if(!render_run(r,engine)) return 1;
+		gettimeofday(&end,0);
+
+		if(r->progressive) {
+			int finished = r->progressive->finished;
+
+			// Nothing else is rendered progressively, and nothing is left to cancel.
+			signal(SIGINT,SIG_DFL);
+			signal(SIGTERM,SIG_DFL);
+			running = 0;
+			progressive_delete(r->progressive);
+			r->progressive = 0;
+
+			if(finished>1) {
+				printf("mandel: cancelled, leaving 1/%d of the points in %s\n",finished*finished,outfile);
+				render_delete(r);
+				bitmap_delete(bm);
+				return 1;
+			}
+		}
 
-	int iter = 0;
+		// The sum of the counts is the work a plain escape-time loop would do, whatever shortcuts were taken.
+		long iterations = 0;
+		int i;
+		for(i=0;i<image_width*image_height;i++) iterations += r->iters[i];
 
-	while( (x*x + y*y <= 4) && iter < max ) {
+		printf("mandel: %ld iterations over %d points computed in %.3fs\n",iterations,image_width*image_height,(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1000000.0);
 
-		double xt = x*x - y*y + x0;
-		double yt = 2*x*y + y0;
+		if(engine!=ENGINE_PERTURB) {
+			printf("mandel: %s precision for points %g apart\n",precision_name(r->chosen),r->step);
+			if(r->step<precision_limit(r->chosen,r->extent,r->max)) {
+				printf("mandel: warning: %s precision can't resolve this view, try %s\n",precision_name(r->chosen),precision==PRECISION_AUTO ? "-e perturb" : "-p auto");
+			}
+		}
 
-		x = xt;
-		y = yt;
+		if(r->instrument) {
+			instrument_report(r->instrument);
 
-		iter++;
+			if(heatmap && !instrument_heatmap(r->instrument,heatmap,image_width,image_height)) {
+				fprintf(stderr,"mandel: couldn't write to %s: %s\n",heatmap,strerror(errno));
+				return 1;
+			}
+		}
 	}
 
-	return iteration_to_color(iter,max);
-}
+	if(shortcuts && !loadfile) {
+		printf("mandel: shortcuts resolved %ld points in the cardioid, %ld in the period-2 bulb, %ld by periodicity\n",r->stats.cardioid,r->stats.bulb,r->stats.periodic);
+	}
 
-/*
-Convert a iteration number to an RGBA color.
-Here, we just scale to gray with a maximum of imax.
-Modify this function to make more interesting colors.
-*/
+	if(engine==ENGINE_SUBDIVIDE && !loadfile) {
+		printf("mandel: subdivision filled %ld of %d points without iterating\n",r->filled,image_width*image_height);
+	}
 
-int iteration_to_color( int i, int max )
-{
-	int gray = 255*i/max;
-	return MAKE_RGBA(gray,gray,gray,0);
-}
+	if(check && engine==ENGINE_BRUTE && !loadfile) {
+		printf("mandel: %ld of %d points differ from the scalar kernel\n",r->mismatches,image_width*image_height);
+		if(r->mismatches) return 1;
+	}
+
+	if(verify && !loadfile) {
+		// Render the image again by brute force, and compare every point.
+		int *result = r->iters;
+		int i, wrong = 0;
+
+		r->iters = malloc(image_width*image_height*sizeof(int));
+		if(!r->iters) {
+			fprintf(stderr,"mandel: out of memory\n");
+			return 1;
+		}
+
+		if(!render_run(r,ENGINE_BRUTE)) return 1;
 
+		for(i=0;i<image_width*image_height;i++) {
+			if(result[i]!=r->iters[i]) wrong++;
+		}
+
+		free(r->iters);
+		r->iters = result;
 
+		printf("mandel: %d of %d points differ from the brute force engine\n",wrong,image_width*image_height);
+		if(wrong) return 1;
+	}
 
+	if(dumpfile) {
+		if(!render_save(r,dumpfile)) {
+			fprintf(stderr,"mandel: couldn't write to %s: %s\n",dumpfile,strerror(errno));
+			return 1;
+		}
+	}
 
+	// Convert the iteration counts into colors.
+	gettimeofday(&start,0);
+
+	if(!render_pool(r) || !palette_apply_bitmap(palette,r->iters,r->frac,image_width*image_height,max,bm,r->pool)) {
+		fprintf(stderr,"mandel: couldn't color the image\n");
+		return 1;
+	}
+
+	gettimeofday(&end,0);
+	printf("mandel: %s palette applied in %.3fs\n",palette_name(palette),(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1000000.0);
+
+	if(samples>0) {
+		r->antialias = antialias_create(samples,threshold);
+		if(!r->antialias) {
+			fprintf(stderr,"mandel: out of memory\n");
+			return 1;
+		}
+
+		gettimeofday(&start,0);
+		if(!antialias_run(r,palette,bitmap_data(bm))) return 1;
+		gettimeofday(&end,0);
+
+		long npoints = (long)image_width*image_height;
+		struct antialias *a = r->antialias;
+		printf("mandel: anti-aliasing took %ld extra samples at %ld edge pixels (%.1f%% of the image, %.1f%% of the samples to supersample it all) in %.3fs\n",a->extra,a->edges,100.0*a->edges/npoints,100.0*a->extra/(npoints*samples*samples),(end.tv_sec-start.tv_sec)+(end.tv_usec-start.tv_usec)/1000000.0);
+
+		if(shortcuts && !loadfile) {
+			printf("mandel: with the extra samples, shortcuts resolved %ld points in the cardioid, %ld in the period-2 bulb, %ld by periodicity\n",r->stats.cardioid,r->stats.bulb,r->stats.periodic);
+		}
+	}
+
+	// Save the image in the stated file.
+	// A progressive render replaces the preview in one go, the same as each stage did.
+	if(progressive ? !save_whole(bm,outfile,threads) : !bitmap_save_threads(bm,outfile,threads)) {
+		fprintf(stderr,"mandel: couldn't write to %s: %s\n",outfile,strerror(errno));
+		return 1;
+	}
+
+	render_delete(r);
+	bitmap_delete(bm);
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+A small client for the render server (mandel -U): ask for one tile,
+color it, and save it, or show what is in the server's cache.
+*/
+
+#include "client.h"
+#include "bitmap.h"
+#include "palette.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+void show_help()
+{
+	printf("Use: mandelclient [options]\n");
+	printf("Where options are:\n");
+	printf("-U <socket> The socket of the server. (default=mandel.sock)\n");
+	printf("-x <coord>  X coordinate of the center of the tile. (default=0)\n");
+	printf("-y <coord>  Y coordinate of the center of the tile. (default=0)\n");
+	printf("-s <scale>  Scale of the tile in Mandlebrot coordinates. (default=4)\n");
+	printf("-m <max>    The maximum number of iterations per point. (default=1000)\n");
+	printf("-T <pixels> Width and height of the tile. (default=256)\n");
+	printf("-P <palette>How counts are colored: gray, lut or histogram. (default=gray)\n");
+	printf("-o <file>   Set output file. (default=mandelclient.bmp)\n");
+	printf("-r <count>  Ask for the tile this many times, and show how long each took. (default=1)\n");
+	printf("-q          Only show the server's cache counters.\n");
+	printf("-h          Show this help text.\n");
+}
+
+int main( int argc, char *argv[] )
+{
+	const char *socketpath = "mandel.sock";
+	const char *xtext = "0";
+	const char *ytext = "0";
+	const char *outfile = "mandelclient.bmp";
+	double scale = 4;
+	int max = 1000;
+	int size = 256;
+	int repeats = 1;
+	int statsonly = 0;
+	palette_t palette = PALETTE_GRAY;
+	int c, i;
+
+	while((c = getopt(argc,argv,"U:x:y:s:m:T:P:o:r:qh"))!=-1) {
+		switch(c) {
+			case 'U':
+				socketpath = optarg;
+				break;
+			case 'x':
+				xtext = optarg;
+				break;
+			case 'y':
+				ytext = optarg;
+				break;
+			case 's':
+				scale = atof(optarg);
+				break;
+			case 'm':
+				max = atoi(optarg);
+				break;
+			case 'T':
+				size = atoi(optarg);
+				break;
+			case 'P':
+				if(!palette_from_name(optarg,&palette)) {
+					fprintf(stderr,"mandelclient: unknown palette %s\n",optarg);
+					exit(1);
+				}
+				break;
+			case 'o':
+				outfile = optarg;
+				break;
+			case 'r':
+				repeats = atoi(optarg);
+				break;
+			case 'q':
+				statsonly = 1;
+				break;
+			default:
+				show_help();
+				exit(1);
+		}
+	}
+
+	if(size<1 || size>SERVER_MAX_SIZE) {
+		fprintf(stderr,"mandelclient: the tile must be from 1 to %d pixels\n",SERVER_MAX_SIZE);
+		exit(1);
+	}
+
+	struct client *client = client_connect(socketpath);
+	if(!client) {
+		fprintf(stderr,"mandelclient: couldn't connect to %s: %s\n",socketpath,strerror(errno));
+		exit(1);
+	}
+
+	if(statsonly) {
+		char line[256];
+		if(!client_stats(client,line,sizeof(line))) {
+			fprintf(stderr,"mandelclient: no answer from the server\n");
+			exit(1);
+		}
+		long tiles, hits, misses, evictions;
+		size_t bytes;
+		sscanf(line,"stats %ld %zu %ld %ld %ld",&tiles,&bytes,&hits,&misses,&evictions);
+		printf("mandelclient: %ld tiles in %.1fMB of cache, %ld hits, %ld misses, %ld evicted\n",tiles,bytes/1048576.0,hits,misses,evictions);
+		client_close(client);
+		return 0;
+	}
+
+	int *counts = malloc((size_t)size*size*sizeof(int));
+	struct bitmap *bm = bitmap_create(size,size);
+	if(!counts || !bm) {
+		fprintf(stderr,"mandelclient: out of memory\n");
+		exit(1);
+	}
+
+	struct tile_reply reply;
+
+	for(i=0;i<repeats;i++) {
+		if(!client_tile(client,xtext,ytext,scale,max,size,counts,&reply)) {
+			fprintf(stderr,"mandelclient: %s\n",reply.error);
+			exit(1);
+		}
+		printf("mandelclient: %dx%d tile at x=%.17g y=%.17g %s in %.3fms\n",size,size,reply.x,reply.y,reply.hit ? "from the cache" : "rendered",reply.microseconds/1000.0);
+	}
+
+	client_close(client);
+
+	if(!palette_apply(palette,counts,0,size*size,max,bitmap_data(bm),0)) {
+		fprintf(stderr,"mandelclient: couldn't color the tile\n");
+		exit(1);
+	}
+
+	if(!bitmap_save(bm,outfile)) {
+		fprintf(stderr,"mandelclient: couldn't write to %s: %s\n",outfile,strerror(errno));
+		exit(1);
+	}
+
+	free(counts);
+	bitmap_delete(bm);
+
+	return 0;
+}
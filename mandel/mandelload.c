@@ -0,0 +1,307 @@
+/*
+A load generator for the render server (mandel -U).
+
+Each client is a thread with its own connection, acting like someone
+exploring the set: it looks at a viewport of tiles, then pans by a tile
+or zooms in or out by a level, and asks the server for every tile of the
+new viewport. The zoom levels share one grid, so level L has tiles of
+scale s/2^L centered on x0 + i*2*scale, y0 + j*2*scale. At the end the
+throughput, the hit rate, and the latency percentiles are shown, for all
+of the tiles and split by whether they came from the cache.
+*/
+
+#include "client.h"
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+struct settings {
+	const char *socketpath;
+	double x;
+	double y;
+	double scale;
+	int max;
+	int size;
+	int requests;
+	int levels;
+	int viewport;
+	unsigned seed;
+};
+
+struct explorer {
+	struct settings *settings;
+	int number;
+
+	// Latency of each request in seconds, and whether it was a hit.
+	double *latency;
+	char *hit;
+	int done;
+	int failed;
+};
+
+void show_help()
+{
+	printf("Use: mandelload [options]\n");
+	printf("Where options are:\n");
+	printf("-U <socket> The socket of the server. (default=mandel.sock)\n");
+	printf("-c <count>  The number of clients at once. (default=4)\n");
+	printf("-N <count>  The number of tiles each client asks for. (default=200)\n");
+	printf("-x <coord>  X coordinate where the clients start. (default=-0.5)\n");
+	printf("-y <coord>  Y coordinate where the clients start. (default=0)\n");
+	printf("-s <scale>  Scale of the tiles at the outermost zoom level. (default=1)\n");
+	printf("-m <max>    The maximum number of iterations per point. (default=1000)\n");
+	printf("-T <pixels> Width and height of the tiles. (default=128)\n");
+	printf("-L <levels> The number of zoom levels to wander over. (default=4)\n");
+	printf("-v <tiles>  Width and height of the viewport in tiles. (default=3)\n");
+	printf("-e <seed>   Seed for the random walks. (default=1)\n");
+	printf("-h          Show this help text.\n");
+}
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+/* Ask for every tile of the viewport, recording each one. Returns 0 if the server failed. */
+
+static int view( struct explorer *e, struct client *c, int *counts, int level, long i, long j )
+{
+	struct settings *s = e->settings;
+	double scale = s->scale/(1L<<level);
+	struct tile_reply reply;
+	char xtext[64], ytext[64];
+	int a, b;
+
+	for(b=0;b<s->viewport;b++) {
+		for(a=0;a<s->viewport;a++) {
+			if(e->done>=s->requests) return 1;
+
+			snprintf(xtext,sizeof(xtext),"%.17g",s->x+(i+a)*2*scale);
+			snprintf(ytext,sizeof(ytext),"%.17g",s->y+(j+b)*2*scale);
+
+			double start = now();
+			if(!client_tile(c,xtext,ytext,scale,s->max,s->size,counts,&reply)) {
+				fprintf(stderr,"mandelload: client %d: %s\n",e->number,reply.error);
+				return 0;
+			}
+			e->latency[e->done] = now()-start;
+			e->hit[e->done] = reply.hit;
+			e->done++;
+		}
+	}
+
+	return 1;
+}
+
+static void * explore( void *a )
+{
+	struct explorer *e = a;
+	struct settings *s = e->settings;
+	unsigned seed = s->seed*7919+e->number;
+	int level = 0;
+	long i = -s->viewport/2;
+	long j = -s->viewport/2;
+
+	struct client *c = client_connect(s->socketpath);
+	int *counts = malloc((size_t)s->size*s->size*sizeof(int));
+
+	if(!c || !counts) {
+		fprintf(stderr,"mandelload: client %d couldn't connect to %s: %s\n",e->number,s->socketpath,strerror(errno));
+		e->failed = 1;
+		free(counts);
+		if(c) client_close(c);
+		return 0;
+	}
+
+	while(e->done<s->requests) {
+		if(!view(e,c,counts,level,i,j)) {
+			e->failed = 1;
+			break;
+		}
+
+		// Pan more often than zoom, the way people tend to look around.
+		int move = rand_r(&seed)%6;
+		if(move==4 && level+1<s->levels) {
+			// Zoom in on the middle of the viewport.
+			level++;
+			i = 2*(i+s->viewport/2)-s->viewport/2;
+			j = 2*(j+s->viewport/2)-s->viewport/2;
+		} else if(move==5 && level>0) {
+			level--;
+			i = (i+s->viewport/2)/2-s->viewport/2;
+			j = (j+s->viewport/2)/2-s->viewport/2;
+		} else {
+			// Step to one of the eight neighbouring viewports.
+			static const int pan[8][2] = { {-1,-1}, {0,-1}, {1,-1}, {-1,0}, {1,0}, {-1,1}, {0,1}, {1,1} };
+			int d = rand_r(&seed)%8;
+			i += pan[d][0];
+			j += pan[d][1];
+		}
+	}
+
+	free(counts);
+	client_close(c);
+	return 0;
+}
+
+static int compare_doubles( const void *a, const void *b )
+{
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return x<y ? -1 : x>y;
+}
+
+/* Show the latency percentiles of n requests, taking the nearest rank. */
+
+static void show_latency( const char *name, double *latency, long n )
+{
+	if(n==0) {
+		printf("%-6s %8d\n",name,0);
+		return;
+	}
+
+	qsort(latency,n,sizeof(double),compare_doubles);
+
+	double p50 = latency[(long)ceil(0.50*n)-1];
+	double p90 = latency[(long)ceil(0.90*n)-1];
+	double p99 = latency[(long)ceil(0.99*n)-1];
+
+	printf("%-6s %8ld %9.3f %9.3f %9.3f %9.3f\n",name,n,p50*1000,p90*1000,p99*1000,latency[n-1]*1000);
+}
+
+int main( int argc, char *argv[] )
+{
+	struct settings s = { "mandel.sock", -0.5, 0, 1, 1000, 128, 200, 4, 3, 1 };
+	int clients = 4;
+	int c, k;
+	long n;
+
+	while((c = getopt(argc,argv,"U:c:N:x:y:s:m:T:L:v:e:h"))!=-1) {
+		switch(c) {
+			case 'U':
+				s.socketpath = optarg;
+				break;
+			case 'c':
+				clients = atoi(optarg);
+				break;
+			case 'N':
+				s.requests = atoi(optarg);
+				break;
+			case 'x':
+				s.x = atof(optarg);
+				break;
+			case 'y':
+				s.y = atof(optarg);
+				break;
+			case 's':
+				s.scale = atof(optarg);
+				break;
+			case 'm':
+				s.max = atoi(optarg);
+				break;
+			case 'T':
+				s.size = atoi(optarg);
+				break;
+			case 'L':
+				s.levels = atoi(optarg);
+				break;
+			case 'v':
+				s.viewport = atoi(optarg);
+				break;
+			case 'e':
+				s.seed = atoi(optarg);
+				break;
+			default:
+				show_help();
+				exit(1);
+		}
+	}
+
+	if(clients<1 || s.requests<1 || s.levels<1 || s.levels>40 || s.viewport<1 || s.size<1 || s.size>SERVER_MAX_SIZE) {
+		fprintf(stderr,"mandelload: the counts must be positive, with up to 40 levels and tiles of up to %d pixels\n",SERVER_MAX_SIZE);
+		exit(1);
+	}
+
+	struct explorer *explorers = calloc(clients,sizeof(struct explorer));
+	pthread_t *tids = malloc(clients*sizeof(pthread_t));
+	if(!explorers || !tids) {
+		fprintf(stderr,"mandelload: out of memory\n");
+		exit(1);
+	}
+
+	for(k=0;k<clients;k++) {
+		explorers[k].settings = &s;
+		explorers[k].number = k;
+		explorers[k].latency = malloc(s.requests*sizeof(double));
+		explorers[k].hit = malloc(s.requests);
+		if(!explorers[k].latency || !explorers[k].hit) {
+			fprintf(stderr,"mandelload: out of memory\n");
+			exit(1);
+		}
+	}
+
+	double start = now();
+
+	for(k=0;k<clients;k++) {
+		if(pthread_create(&tids[k],0,explore,&explorers[k])!=0) {
+			fprintf(stderr,"mandelload: couldn't start client %d\n",k);
+			exit(1);
+		}
+	}
+
+	int failed = 0;
+	for(k=0;k<clients;k++) {
+		pthread_join(tids[k],0);
+		failed |= explorers[k].failed;
+	}
+
+	double elapsed = now()-start;
+
+	// Gather the latencies, all together and split by hit and miss.
+	long total = 0, hits = 0;
+	for(k=0;k<clients;k++) total += explorers[k].done;
+
+	double *all = malloc((total+1)*sizeof(double));
+	double *hit = malloc((total+1)*sizeof(double));
+	double *miss = malloc((total+1)*sizeof(double));
+	long nmisses = 0;
+
+	if(!all || !hit || !miss) {
+		fprintf(stderr,"mandelload: out of memory\n");
+		exit(1);
+	}
+
+	total = 0;
+	for(k=0;k<clients;k++) {
+		for(n=0;n<explorers[k].done;n++) {
+			double t = explorers[k].latency[n];
+			all[total++] = t;
+			if(explorers[k].hit[n]) hit[hits++] = t;
+			else miss[nmisses++] = t;
+		}
+		free(explorers[k].latency);
+		free(explorers[k].hit);
+	}
+
+	printf("mandelload: %d clients asked for %ld %dx%d tiles in %.3fs, %.1f tiles/s, %.1f%% from the cache\n",clients,total,s.size,s.size,elapsed,total/elapsed,total ? 100.0*hits/total : 0.0);
+	printf("%-6s %8s %9s %9s %9s %9s\n","","tiles","p50 ms","p90 ms","p99 ms","max ms");
+	show_latency("all",all,total);
+	show_latency("hit",hit,hits);
+	show_latency("miss",miss,nmisses);
+
+	free(all);
+	free(hit);
+	free(miss);
+	free(explorers);
+	free(tids);
+
+	return failed ? 1 : 0;
+}
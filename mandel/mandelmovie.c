@@ -7,20 +7,130 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <math.h>
+#include "tilequeue.h"
 #define _GNU_SOURCE
 
+//The movie: 50 frames zooming from scale 2 to .000001
+#define FRAMES 50
+#define WIDTH 800
+#define HEIGHT 600
+#define MAX 2000
+#define XCENTER 0.286932
+#define YCENTER 0.014287
+#define FIRSTSCALE 2
+#define LASTSCALE .000001
+
+//The text of a macro's value, to pass on to mandel
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
+//Give up on the tile queue after this many workers have died
+#define MAX_FAILURES 10
+
+//Options for how every mandel process saves its frames, such as -d 8 -z, ending in a null
+static char *saveOptions[4];
+
+//Start a worker on the tile queue, returning its pid
+static pid_t start_worker(const char *name) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if(pid == 0) {
+		char *args[] = { "mandel", "-Q", (char *) name, "-n", "1", saveOptions[0], saveOptions[1], saveOptions[2], (char *) NULL };
+		execvp("./mandel", args);
+		printf("Could not start ./mandel: %s\n", strerror(errno));
+		exit(1);
+	} else if(pid < 0) {
+		printf("Could not fork worker: %s\n\n", strerror(errno));
+	}
+	return pid;
+}
+
+//Render the movie with every process sharing one queue of (frame, band of rows) tiles,
+//so nobody sits idle while the deepest frames are finished.
+//A worker that dies has its tiles given back to the queue and is replaced.
+static int run_tiles(int numProcesses, int bandRows, double *scales) {
+	char name[64];
+	snprintf(name, sizeof(name), "/mandelmovie.%d", (int) getpid());
+
+	struct tilequeue *q = tilequeue_create(name, WIDTH, HEIGHT, MAX, FRAMES, bandRows, XSTR(XCENTER), XSTR(YCENTER), scales, "mandel%d.bmp");
+	if(!q) {
+		printf("Could not create the tile queue %s: %s\n", name, strerror(errno));
+		return 1;
+	}
+
+	printf("Sharing %d frames in bands of %d rows among %d processes\n", FRAMES, bandRows, numProcesses);
+
+	int runningProcesses = 0;
+	int failures = 0;
+
+	for(;;) {
+		//Keep every process busy while there is work nobody has claimed
+		while(runningProcesses < numProcesses && failures < MAX_FAILURES && tilequeue_pending(q)) {
+			if(start_worker(name) < 0) break;
+			runningProcesses++;
+		}
+
+		if(runningProcesses == 0) break;
+
+		int status;
+		pid_t pid = wait(&status);
+		if(pid < 0) break;
+		runningProcesses--;
+
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			int reclaimed = tilequeue_reclaim(q, pid);
+			failures++;
+			if(WIFSIGNALED(status)) {
+				printf("Worker %d died with signal %d: %s, reclaimed %d tiles\n", (int) pid, WTERMSIG(status), strsignal(WTERMSIG(status)), reclaimed);
+			} else {
+				printf("Worker %d failed, reclaimed %d tiles\n", (int) pid, reclaimed);
+			}
+		}
+	}
+
+	int finished = tilequeue_finished(q);
+	if(!finished) printf("Gave up after %d workers failed\n", failures);
+
+	tilequeue_close(q);
+	tilequeue_unlink(name);
+
+	return finished ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
 
 	int numProcesses;
+	int bandRows = 0;
+	char *depth = NULL;
+	int rle = 0;
+	int c;
+
+	while((c = getopt(argc, argv, "t:d:z")) != -1) {
+		if(c == 't') {
+			bandRows = atoi(optarg);
+		} else if(c == 'd') {
+			depth = optarg;
+		} else if(c == 'z') {
+			rle = 1;
+		} else {
+			return 1;
+		}
+	}
+
+	int n = 0;
+	if(depth) {
+		saveOptions[n++] = "-d";
+		saveOptions[n++] = depth;
+	}
+	if(rle) saveOptions[n++] = "-z";
 
 	//Get the number of processes to use or return error
-	if(argc != 2) { 
-		printf("usage: mandelmovie <numberOfProcesses>\n");
+	if(argc - optind != 1 || bandRows < 0) { 
+		printf("usage: mandelmovie [-t <rowsPerTile>] [-d <bits>] [-z] <numberOfProcesses>\n");
+		printf("-d and -z are passed to mandel, to save the frames as 8-bit or run-length encoded BMPs\n");
 		return 1;
-//	} else if (argc == 1) {
-//		numProcesses = 1;
 	} else {
-		numProcesses = atoi(argv[1]);
+		numProcesses = atoi(argv[optind]);
 	}
 
 	//Create an integer to keep track of running processes
@@ -32,30 +142,46 @@ int main(int argc, char *argv[]) {
 	commands[0] = "./mandel";
 	commands[1] = " ";
 	commands[2] = "-x";
-	commands[3] = "0.286932";
+	commands[3] = XSTR(XCENTER);
 	commands[4] = "-y";
-	commands[5] = "0.014287";
+	commands[5] = XSTR(YCENTER);
 	commands[6] = "-m";
-	commands[7] = "2000";
+	commands[7] = XSTR(MAX);
 	commands[8] = "-H";
-	commands[9] = "600";
+	commands[9] = XSTR(HEIGHT);
 	commands[10] = "-W";
-	commands[11] = "800";
+	commands[11] = XSTR(WIDTH);
 	commands[12] = "-s";
-	commands[13] = ".000001";
+	commands[13] = XSTR(LASTSCALE);
 	commands[14] = "-o";
-	commands[15] = "mandel50.bmp";
+	commands[15] = "mandel" XSTR(FRAMES) ".bmp";
 	commands[16] = "-n";
 	commands[17] = "1";
-	commands[18] = (char *) NULL;
+	commands[18] = saveOptions[0];
+	commands[19] = saveOptions[1];
+	commands[20] = saveOptions[2];
+	commands[21] = (char *) NULL;
 	
-	double targetZoom = .000001;
-	double initialZoom = 2;
+	double targetZoom = LASTSCALE;
+	double initialZoom = FIRSTSCALE;
 	double zoom = initialZoom;
-	double delatZoom = exp(log(zoom/targetZoom)/50);
+	double delatZoom = exp(log(zoom/targetZoom)/FRAMES);
+
+	if(bandRows > 0) {
+		//The same scales the frame at a time processes are given, down to the text
+		double scales[FRAMES];
+		int i;
+		for(i = 0; i < FRAMES; i++) {
+			char text[32];
+			sprintf(text, "%lf", zoom);
+			scales[i] = atof(text);
+			zoom /= delatZoom;
+		}
+		return run_tiles(numProcesses, bandRows, scales);
+	}
 
 	//Enter the loop to do the work
-	while (moviesCompleted <= 50) {
+	while (moviesCompleted <= FRAMES) {
 		
 		//fork a new process
 		if(runningProcesses >= numProcesses){
@@ -112,6 +238,13 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	//Wait for the last processes to finish, so the whole movie is done when we exit
+	while (runningProcesses > 0) {
+		int signal;
+		if(wait(&signal) < 0) break;
+		runningProcesses--;
+	}
+
 	return 0;
 	
 }
@@ -0,0 +1,420 @@
+#include "palette.h"
+#include "pool.h"
+#include "bitmap.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <immintrin.h>
+
+// How many counts it takes the LUT palette to go once around its gradient.
+#define LUT_PERIOD 64
+
+// The gradient is sampled this finely before it is spread over the counts.
+#define GRADIENT_SIZE 256
+
+// The colors the gradient passes through, evenly spaced, coming back around to the first.
+static const int stops[][3] = {
+	{   0,   7, 100 },
+	{  32, 107, 203 },
+	{ 237, 255, 255 },
+	{ 255, 170,   0 },
+	{   0,   2,   0 },
+};
+
+#define NSTOPS (int)(sizeof(stops)/sizeof(stops[0]))
+
+/* Return the color a fraction t of the way around the gradient. */
+
+static int gradient_at( double t )
+{
+	double p = (t - floor(t)) * NSTOPS;
+	int a = (int)p % NSTOPS;
+	int b = (a+1) % NSTOPS;
+	double f = p - floor(p);
+
+	return MAKE_RGBA(
+		(int)(stops[a][0] + f*(stops[b][0]-stops[a][0])),
+		(int)(stops[a][1] + f*(stops[b][1]-stops[a][1])),
+		(int)(stops[a][2] + f*(stops[b][2]-stops[a][2])),
+		0);
+}
+
+/*
+Convert a iteration number to an RGBA color.
+Here, we just scale to gray with a maximum of imax.
+*/
+
+int iteration_to_color( int i, int max )
+{
+	int gray = 255*i/max;
+	return MAKE_RGBA(gray,gray,gray,0);
+}
+
+/* Blend two colors, a fraction f of the way from a to b. */
+
+static int blend( int a, int b, float f )
+{
+	return MAKE_RGBA(
+		GET_RED(a)   + (int)(f*(GET_RED(b)-GET_RED(a))),
+		GET_GREEN(a) + (int)(f*(GET_GREEN(b)-GET_GREEN(a))),
+		GET_BLUE(a)  + (int)(f*(GET_BLUE(b)-GET_BLUE(a))),
+		0);
+}
+
+// The number of points in a cache line. Every band but the first starts on one,
+// so that no two threads write to the same line of the image.
+#define LINE_POINTS (64/sizeof(int))
+
+// Each thread colors one contiguous band of points.
+struct palette_job {
+	const int *iters;
+	const float *frac;
+	int start;
+	int end;
+	int max;
+	int *rgba;
+	const int *table;
+	int *histogram;
+};
+
+static void * count_band( void *a )
+{
+	struct palette_job *job = a;
+	int i;
+
+	memset(job->histogram,0,(job->max+1)*sizeof(int));
+
+	for(i=job->start;i<job->end;i++) {
+		int n = job->iters[i];
+		if(n>=0 && n<=job->max) job->histogram[n]++;
+	}
+
+	return (void *) 1;
+}
+
+static void lookup_scalar( const int *iters, int n, const int *table, int max, int *rgba )
+{
+	int i;
+	for(i=0;i<n;i++) {
+		int k = iters[i];
+		if(k<0) k = 0;
+		if(k>max) k = max;
+		rgba[i] = table[k];
+	}
+}
+
+/* Eight table lookups at a time, with the AVX2 gather instruction. */
+
+__attribute__((target("avx2")))
+static void lookup_avx2( const int *iters, int n, const int *table, int max, int *rgba )
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i top = _mm256_set1_epi32(max);
+	int i;
+
+	for(i=0;i+8<=n;i+=8) {
+		__m256i k = _mm256_loadu_si256((const __m256i *)(iters+i));
+		k = _mm256_min_epi32(_mm256_max_epi32(k,zero),top);
+		_mm256_storeu_si256((__m256i *)(rgba+i),_mm256_i32gather_epi32(table,k,4));
+	}
+
+	lookup_scalar(iters+i,n-i,table,max,rgba+i);
+}
+
+static void * color_band( void *a )
+{
+	struct palette_job *job = a;
+	int i;
+
+	if(!job->frac) {
+		if(__builtin_cpu_supports("avx2")) {
+			lookup_avx2(job->iters+job->start,job->end-job->start,job->table,job->max,job->rgba+job->start);
+		} else {
+			lookup_scalar(job->iters+job->start,job->end-job->start,job->table,job->max,job->rgba+job->start);
+		}
+		return (void *) 1;
+	}
+
+	for(i=job->start;i<job->end;i++) {
+		job->rgba[i] = palette_color(job->table,job->max,job->iters[i],job->frac[i]);
+	}
+
+	return (void *) 1;
+}
+
+int palette_color( const int *table, int max, int n, float frac )
+{
+	if(n<0) n = 0;
+	if(n>=max) return table[max];
+
+	int next = n+1<max ? n+1 : n;
+	return blend(table[n],table[next],frac);
+}
+
+/* Fill in the color of every count from 0 to max. */
+
+static void make_table( palette_t palette, int max, const int *histogram, int *table )
+{
+	int gradient[GRADIENT_SIZE];
+	int i;
+
+	for(i=0;i<GRADIENT_SIZE;i++) gradient[i] = gradient_at((double)i/GRADIENT_SIZE);
+
+	switch(palette) {
+		case PALETTE_LUT:
+			for(i=0;i<max;i++) {
+				table[i] = gradient[(i % LUT_PERIOD) * GRADIENT_SIZE / LUT_PERIOD];
+			}
+			table[max] = MAKE_RGBA(0,0,0,0);
+			break;
+
+		case PALETTE_HISTOGRAM: {
+			// Each count gets the color at the fraction of escaping points below it.
+			long total = 0, below = 0;
+			for(i=0;i<max;i++) total += histogram[i];
+
+			for(i=0;i<max;i++) {
+				table[i] = gradient[total ? (int)(below*(GRADIENT_SIZE-1)/total) : 0];
+				below += histogram[i];
+			}
+			table[max] = MAKE_RGBA(0,0,0,0);
+			break;
+		}
+
+		case PALETTE_GRAY:
+		default:
+			for(i=0;i<=max;i++) table[i] = iteration_to_color(i,max);
+			break;
+	}
+}
+
+int * palette_table( palette_t palette, const int *iters, int npoints, int max, struct pool *pool )
+{
+	int nthreads = pool ? pool_size(pool) : 1;
+	struct palette_job jobs[nthreads];
+	void *args[nthreads];
+	int i, k, ok = 1;
+
+	int *table = malloc((max+1)*sizeof(int));
+	if(!table) return 0;
+
+	if(palette!=PALETTE_HISTOGRAM) {
+		make_table(palette,max,0,table);
+		return table;
+	}
+
+	// Each thread counts its own band, and then the counts are added up here.
+	for(i=0;i<nthreads;i++) {
+		jobs[i].iters = iters;
+		jobs[i].start = pool_split(npoints,nthreads,i,LINE_POINTS);
+		jobs[i].end = pool_split(npoints,nthreads,i+1,LINE_POINTS);
+		jobs[i].max = max;
+		jobs[i].histogram = malloc((max+1)*sizeof(int));
+		if(!jobs[i].histogram) ok = 0;
+		args[i] = &jobs[i];
+	}
+
+	if(ok) {
+		if(pool) {
+			pool_run(pool,count_band,args);
+		} else {
+			count_band(args[0]);
+		}
+
+		for(i=1;i<nthreads;i++) {
+			for(k=0;k<=max;k++) jobs[0].histogram[k] += jobs[i].histogram[k];
+		}
+
+		make_table(palette,max,jobs[0].histogram,table);
+	}
+
+	for(i=0;i<nthreads;i++) free(jobs[i].histogram);
+
+	if(!ok) {
+		free(table);
+		return 0;
+	}
+
+	return table;
+}
+
+int palette_apply( palette_t palette, const int *iters, const float *frac, int npoints, int max, int *rgba, struct pool *pool )
+{
+	int nthreads = pool ? pool_size(pool) : 1;
+	struct palette_job jobs[nthreads];
+	void *args[nthreads];
+	int i;
+
+	int *table = palette_table(palette,iters,npoints,max,pool);
+	if(!table) return 0;
+
+	for(i=0;i<nthreads;i++) {
+		jobs[i].iters = iters;
+		jobs[i].frac = frac;
+		jobs[i].start = pool_split(npoints,nthreads,i,LINE_POINTS);
+		jobs[i].end = pool_split(npoints,nthreads,i+1,LINE_POINTS);
+		jobs[i].max = max;
+		jobs[i].rgba = rgba;
+		jobs[i].table = table;
+		jobs[i].histogram = 0;
+		args[i] = &jobs[i];
+	}
+
+	if(pool) {
+		pool_run(pool,color_band,args);
+	} else {
+		color_band(args[0]);
+	}
+
+	free(table);
+
+	return 1;
+}
+
+// Each thread of palette_apply_bitmap stores the indices of one band of points.
+struct index_job {
+	const int *iters;
+	long start;
+	long end;
+	int max;
+	const unsigned short *index;
+	void *indices;
+	int bits;
+};
+
+static void * index_band( void *a )
+{
+	struct index_job *job = a;
+	long i;
+
+	for(i=job->start;i<job->end;i++) {
+		int k = job->iters[i];
+		if(k<0) k = 0;
+		if(k>job->max) k = job->max;
+
+		if(job->bits==8) {
+			((unsigned char *)job->indices)[i] = job->index[k];
+		} else {
+			((unsigned short *)job->indices)[i] = job->index[k];
+		}
+	}
+
+	return (void *) 1;
+}
+
+static int compare_colors( const void *a, const void *b )
+{
+	int x = *(const int *)a, y = *(const int *)b;
+	return x<y ? -1 : x>y;
+}
+
+/*
+Put the different colors of a table of max+1 colors in order into "colors",
+and the index of each count's color among them into "index".
+Returns how many colors there are, or 0 if there are more than "most".
+*/
+
+static int distinct_colors( const int *table, int max, int *colors, int most, unsigned short *index )
+{
+	int *sorted = malloc((max+1)*sizeof(int));
+	int i, n = 0;
+
+	if(!sorted) return 0;
+
+	memcpy(sorted,table,(max+1)*sizeof(int));
+	qsort(sorted,max+1,sizeof(int),compare_colors);
+
+	for(i=0;i<=max;i++) {
+		if(n>0 && sorted[i]==colors[n-1]) continue;
+		if(n==most) {
+			free(sorted);
+			return 0;
+		}
+		colors[n++] = sorted[i];
+	}
+
+	for(i=0;i<=max;i++) {
+		index[i] = (int *)bsearch(&table[i],colors,n,sizeof(int),compare_colors) - colors;
+	}
+
+	free(sorted);
+	return n;
+}
+
+int palette_apply_bitmap( palette_t palette, const int *iters, const float *frac, int npoints, int max, struct bitmap *bm, struct pool *pool )
+{
+	int bits = bitmap_bits(bm);
+
+	if(bits==32) return palette_apply(palette,iters,frac,npoints,max,bitmap_data(bm),pool);
+
+	// A blend of two colors isn't in any table.
+	if(frac) return 0;
+
+	int nthreads = pool ? pool_size(pool) : 1;
+	struct index_job jobs[nthreads];
+	void *args[nthreads];
+	int i, ncolors = 0;
+
+	int *table = palette_table(palette,iters,npoints,max,pool);
+	int *colors = malloc((1<<bits)*sizeof(int));
+	unsigned short *index = malloc((max+1)*sizeof(unsigned short));
+
+	if(table && colors && index) {
+		ncolors = distinct_colors(table,max,colors,1<<bits,index);
+		if(!ncolors) fprintf(stderr,"mandel: the %s palette has too many colors for %d-bit pixels\n",palette_name(palette),bits);
+	}
+
+	if(ncolors) {
+		bitmap_set_colors(bm,colors,ncolors);
+
+		// The bands start on cache lines, whatever the size of an index.
+		for(i=0;i<nthreads;i++) {
+			jobs[i].iters = iters;
+			jobs[i].start = pool_split(npoints,nthreads,i,64*8/bits);
+			jobs[i].end = pool_split(npoints,nthreads,i+1,64*8/bits);
+			jobs[i].max = max;
+			jobs[i].index = index;
+			jobs[i].indices = bitmap_indices(bm);
+			jobs[i].bits = bits;
+			args[i] = &jobs[i];
+		}
+
+		if(pool) {
+			pool_run(pool,index_band,args);
+		} else {
+			index_band(args[0]);
+		}
+	}
+
+	free(table);
+	free(colors);
+	free(index);
+
+	return ncolors>0;
+}
+
+int palette_from_name( const char *name, palette_t *palette )
+{
+	if(!strcmp(name,"gray")) {
+		*palette = PALETTE_GRAY;
+	} else if(!strcmp(name,"lut")) {
+		*palette = PALETTE_LUT;
+	} else if(!strcmp(name,"histogram")) {
+		*palette = PALETTE_HISTOGRAM;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * palette_name( palette_t palette )
+{
+	switch(palette) {
+		case PALETTE_GRAY:      return "gray";
+		case PALETTE_LUT:       return "lut";
+		case PALETTE_HISTOGRAM: return "histogram";
+	}
+	return "unknown";
+}
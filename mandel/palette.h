@@ -0,0 +1,61 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+/*
+The palette pass turns iteration counts into colors, separately from computing them,
+so that an image can be recolored without iterating again.
+
+Every palette is first made into a table with one color for each count from 0 to max,
+and then each point is a single lookup in that table.
+PALETTE_GRAY      scales the count to a gray level, as mandel always has.
+PALETTE_LUT       cycles through a fixed gradient of colors as the count goes up.
+PALETTE_HISTOGRAM spreads the gradient over the counts that actually occur in the image
+                  (histogram equalization), so that every color gets about the same area.
+Points that reach max are black in the last two.
+
+If smooth fractions are given (see kernel_row_smooth), each point is blended
+between the colors of its count and the next one.
+*/
+
+struct pool;
+struct bitmap;
+
+typedef enum {
+	PALETTE_GRAY,
+	PALETTE_LUT,
+	PALETTE_HISTOGRAM
+} palette_t;
+
+/*
+Color the npoints counts in iters (and frac, if not null) into rgba.
+The work is split across the threads of pool, or done in this thread if pool is null.
+Returns 0 if out of memory.
+*/
+int          palette_apply( palette_t palette, const int *iters, const float *frac, int npoints, int max, int *rgba, struct pool *pool );
+
+/*
+The same as palette_apply, into the first npoints pixels of a bitmap of any depth.
+An indexed bitmap (see bitmap_create_indexed) gets the different colors of the
+palette as its table, and frac must be null, since blends aren't in any table.
+Returns 0 if out of memory, or if the palette has more colors than the indices can hold.
+*/
+int          palette_apply_bitmap( palette_t palette, const int *iters, const float *frac, int npoints, int max, struct bitmap *bm, struct pool *pool );
+
+/*
+Make the table of colors palette_apply uses, with one entry for every count from 0 to max.
+The histogram palette needs all of the counts of the image to do it.
+Returns 0 if out of memory; otherwise the caller frees the table.
+*/
+int *        palette_table( palette_t palette, const int *iters, int npoints, int max, struct pool *pool );
+
+/* Return the color of one point from the table, the same as palette_apply with smooth fractions. */
+int          palette_color( const int *table, int max, int n, float frac );
+
+/* Convert an iteration count to an RGBA gray level, with a maximum of max. */
+int          iteration_to_color( int i, int max );
+
+/* Convert between a palette and its name. Returns 0 if the name is unknown. */
+int          palette_from_name( const char *name, palette_t *palette );
+const char * palette_name( palette_t palette );
+
+#endif
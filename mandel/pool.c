@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "pool.h"
+
+struct pool {
+	int nthreads;
+	pthread_t *tid;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+
+	// Each job has a new generation number, which is how the workers know to start.
+	long generation;
+	int running;
+	int quit;
+
+	void * (*body)( void *a );
+	void **args;
+};
+
+struct worker {
+	struct pool *p;
+	int tnumber;
+};
+
+static void * worker_main( void *a )
+{
+	struct worker *w = a;
+	struct pool *p = w->p;
+	int tnumber = w->tnumber;
+	long seen = 0;
+
+	free(w);
+
+	pthread_mutex_lock(&p->lock);
+
+	for(;;) {
+		while(p->generation==seen && !p->quit) pthread_cond_wait(&p->start,&p->lock);
+		if(p->quit) break;
+
+		seen = p->generation;
+
+		pthread_mutex_unlock(&p->lock);
+		p->body(p->args[tnumber]);
+		pthread_mutex_lock(&p->lock);
+
+		if(--p->running==0) pthread_cond_signal(&p->done);
+	}
+
+	pthread_mutex_unlock(&p->lock);
+
+	return 0;
+}
+
+struct pool * pool_create( int nthreads )
+{
+	return pool_create_pinned(nthreads,0,0);
+}
+
+struct pool * pool_create_pinned( int nthreads, const int *cpus, int ncpus )
+{
+	struct pool *p;
+	pthread_attr_t attr;
+
+	if(nthreads<1) nthreads = 1;
+
+	p = malloc(sizeof(*p));
+	if(!p) return 0;
+
+	memset(p,0,sizeof(*p));
+
+	p->tid = malloc(nthreads*sizeof(pthread_t));
+	if(!p->tid) {
+		free(p);
+		return 0;
+	}
+
+	pthread_mutex_init(&p->lock,0);
+	pthread_cond_init(&p->start,0);
+	pthread_cond_init(&p->done,0);
+
+	//Start the loop to create all threads
+	while(p->nthreads < nthreads) {
+		struct worker *w = malloc(sizeof(*w));
+		if(!w) break;
+
+		w->p = p;
+		w->tnumber = p->nthreads;
+
+		// A pinned thread starts out on its own CPU, so that even its stack is allocated there.
+		pthread_attr_init(&attr);
+		if(ncpus>0) {
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(cpus[p->nthreads % ncpus],&set);
+			pthread_attr_setaffinity_np(&attr,sizeof(set),&set);
+		}
+
+		//create a new thread
+		printf("Creating thread %d\n", p->nthreads+1);
+		int result = pthread_create(&p->tid[p->nthreads], &attr, worker_main, w);
+		pthread_attr_destroy(&attr);
+
+		if(result != 0){
+			printf("mandel: couldn't create new thread %d: %s\n", p->nthreads+1,strerror(result));
+			free(w);
+			break;
+		}
+
+		p->nthreads++;
+	}
+
+	if(p->nthreads < nthreads) {
+		pool_delete(p);
+		return 0;
+	}
+
+	return p;
+}
+
+void pool_delete( struct pool *p )
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->lock);
+
+	//Start the loop to join all threads
+	for(i=p->nthreads-1;i>=0;i--) {
+		printf("Joining thread %d\n", i+1);
+		if(pthread_join(p->tid[i], NULL) != 0){
+			printf("mandel: couldn't join thread %d: %s\n", i+1,strerror(errno));
+		}
+	}
+
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->start);
+	pthread_mutex_destroy(&p->lock);
+
+	free(p->tid);
+	free(p);
+}
+
+int pool_run( struct pool *p, void * (*body)( void *a ), void **args )
+{
+	pthread_mutex_lock(&p->lock);
+
+	p->body = body;
+	p->args = args;
+	p->running = p->nthreads;
+	p->generation++;
+	pthread_cond_broadcast(&p->start);
+
+	while(p->running>0) pthread_cond_wait(&p->done,&p->lock);
+
+	pthread_mutex_unlock(&p->lock);
+
+	return 1;
+}
+
+int pool_size( struct pool *p )
+{
+	return p->nthreads;
+}
+
+int pool_parse_cpus( const char *text, int **cpus )
+{
+	cpu_set_t set;
+	int n = 0, i;
+
+	CPU_ZERO(&set);
+
+	if(!strcmp(text,"all")) {
+		if(sched_getaffinity(0,sizeof(set),&set)!=0) return 0;
+	} else {
+		const char *s = text;
+
+		for(;;) {
+			char *end;
+			long first = strtol(s,&end,10);
+			long last = first;
+
+			if(end==s) return 0;
+			if(*end=='-') {
+				s = end+1;
+				last = strtol(s,&end,10);
+				if(end==s) return 0;
+			}
+			if(first<0 || last<first || last>=CPU_SETSIZE) return 0;
+
+			for(i=first;i<=last;i++) CPU_SET(i,&set);
+
+			if(*end==0) break;
+			if(*end!=',') return 0;
+			s = end+1;
+		}
+	}
+
+	*cpus = malloc(CPU_COUNT(&set)*sizeof(int));
+	if(!*cpus) return 0;
+
+	for(i=0;i<CPU_SETSIZE;i++) {
+		if(CPU_ISSET(i,&set)) (*cpus)[n++] = i;
+	}
+
+	return n;
+}
+
+long pool_split( long n, int nparts, int i, int align )
+{
+	if(i<=0) return 0;
+	if(i>=nparts) return n;
+
+	long start = n*i/nparts;
+	return start - start%align;
+}
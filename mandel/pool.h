@@ -0,0 +1,37 @@
+#ifndef POOL_H
+#define POOL_H
+
+/*
+A pool of threads that are created once and reused for every render,
+instead of being created and joined again each time.
+pool_run has thread i call body(args[i]) and waits until all of them return.
+A body must return rather than call pthread_exit, or its thread is lost.
+*/
+
+struct pool * pool_create( int nthreads );
+void          pool_delete( struct pool *p );
+
+/* The same as pool_create, with thread i only allowed to run on CPU cpus[i % ncpus]. */
+struct pool * pool_create_pinned( int nthreads, const int *cpus, int ncpus );
+
+/*
+Parse a list of CPUs such as "0-3,8,10" into a new array, which the caller frees.
+"all" means every CPU this process may run on. The CPUs come out in increasing order.
+Returns the number of CPUs, or 0 if the list is not valid.
+*/
+int           pool_parse_cpus( const char *text, int **cpus );
+
+/*
+Split n items into nparts parts as evenly as possible, with every part but the
+first starting on a multiple of align, and return where part i starts.
+Part i ends where part i+1 starts, and part nparts starts at n.
+Work split the same way for every pass over a buffer stays with the same thread.
+*/
+long          pool_split( long n, int nparts, int i, int align );
+
+/* Run body on every thread of the pool, with its own argument. Returns 0 on failure. */
+int           pool_run( struct pool *p, void * (*body)( void *a ), void **args );
+
+int           pool_size( struct pool *p );
+
+#endif
@@ -0,0 +1,181 @@
+#include "progressive.h"
+#include "render.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct progressive * progressive_create( int (*stage_done)( struct render *r, int stride, void *arg ), void *arg )
+{
+	struct progressive *p = malloc(sizeof(*p));
+	if(!p) return 0;
+
+	memset(p,0,sizeof(*p));
+	p->stage_done = stage_done;
+	p->arg = arg;
+
+	return p;
+}
+
+void progressive_delete( struct progressive *p )
+{
+	free(p);
+}
+
+void progressive_cancel( struct progressive *p )
+{
+	p->cancelled = 1;
+}
+
+int progressive_run( struct render *r )
+{
+	struct progressive *p = r->progressive;
+	int stride;
+
+	p->finished = 0;
+
+	for(stride=PROGRESSIVE_FIRST;stride>=1;stride/=2) {
+		p->stride = stride;
+
+		if(!render_threads(r,compute_progressive,((r->height+stride-1)/stride+r->chunk-1)/r->chunk)) return 0;
+
+		if(stride>1) {
+			if(!render_threads(r,fill_progressive,(r->height+r->chunk-1)/r->chunk)) return 0;
+			if(p->stage_done && !p->stage_done(r,stride,p->arg)) return 0;
+		}
+
+		p->finished = stride;
+		if(p->cancelled && stride>1) break;
+	}
+
+	return 1;
+}
+
+/*
+Compute the points of one stage, taking chunks of the stage's rows from the work queue.
+A row that an earlier stage went through already has every other point of this stage,
+so only the ones in between are computed. The points are gathered into a short row,
+so that the kernels still get whole rows to work on.
+*/
+
+void * compute_progressive( void *a )
+{
+	int i,j,k,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	int stride = r->progressive->stride;
+
+	double *xs = malloc(r->width*sizeof(double));
+	double *xlo = malloc(r->width*sizeof(double));
+	int *iters = malloc(r->width*sizeof(int));
+	int *reference = malloc(r->width*sizeof(int));
+	float *frac = malloc(r->width*sizeof(float));
+	struct kernel_stats stats = {0,0,0};
+
+	if(!xs || !xlo || !iters || !reference || !frac) {
+		fprintf(stderr,"mandel: out of memory in thread %d\n",args->tnumber+1);
+		exit(1);
+	}
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		for(k = unit*r->chunk; k<(unit+1)*r->chunk; k++) {
+			j = k*stride;
+			if(j>=r->height) break;
+
+			// Which points of the row this stage computes.
+			int first = 0;
+			int step = stride;
+			if(stride<PROGRESSIVE_FIRST && j%(2*stride)==0) {
+				first = stride;
+				step = 2*stride;
+			}
+
+			int n = 0;
+			for(i=first;i<r->width;i+=step) {
+				xs[n] = r->xs[i];
+				xlo[n] = r->xlo[i];
+				n++;
+			}
+			if(n==0) continue;
+
+			double y = render_y(r,j);
+
+			if(r->frac) {
+				kernel_row_smooth(r->kernel,r->chosen,xs,xlo,y,r->ylo[j],n,r->max,iters,frac,r->shortcuts ? &stats : 0);
+			} else {
+				kernel_row(r->kernel,r->chosen,xs,xlo,y,r->ylo[j],n,r->max,iters,r->shortcuts ? &stats : 0);
+			}
+
+			if(r->check) {
+				int wrong = 0;
+				kernel_row(KERNEL_SCALAR,r->chosen,xs,xlo,y,r->ylo[j],n,r->max,reference,0);
+				for(i=0;i<n;i++) {
+					if(iters[i]!=reference[i]) wrong++;
+				}
+				if(wrong) __sync_fetch_and_add(&r->mismatches,wrong);
+			}
+
+			int *row = &r->iters[j*r->width];
+			for(i=0;i<n;i++) row[first+i*step] = iters[i];
+
+			if(r->frac) {
+				float *fracs = &r->frac[j*r->width];
+				for(i=0;i<n;i++) fracs[first+i*step] = frac[i];
+			}
+		}
+	}
+
+	free(xs);
+	free(xlo);
+	free(iters);
+	free(reference);
+	free(frac);
+
+	render_add_stats(r,&stats);
+
+	return (void *) 1;
+}
+
+/*
+Give every point the current stage hasn't reached the count of the computed point
+above and to the left of it, a chunk of rows at a time. Only points that a later
+stage computes are written, and only computed points are read, so the threads
+never touch the same point.
+*/
+
+void * fill_progressive( void *a )
+{
+	int i,j,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	int stride = r->progressive->stride;
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		for(j=start;j<end;j++) {
+			int *row = &r->iters[j*r->width];
+			const int *from = &r->iters[(j-j%stride)*r->width];
+
+			for(i=0;i<r->width;i++) {
+				if(i%stride || j%stride) row[i] = from[i-i%stride];
+			}
+
+			if(r->frac) {
+				float *fracs = &r->frac[j*r->width];
+				const float *fromfracs = &r->frac[(j-j%stride)*r->width];
+
+				for(i=0;i<r->width;i++) {
+					if(i%stride || j%stride) fracs[i] = fromfracs[i-i%stride];
+				}
+			}
+		}
+	}
+
+	return (void *) 1;
+}
@@ -0,0 +1,57 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <signal.h>
+
+struct render;
+
+/*
+Progressive rendering, for a usable image long before the whole render is done.
+
+The brute force engine computes the image in stages: first every 4th point of
+every 4th row (1/16 of the points), then the points of every 2nd row and column
+that are still missing (bringing it to 1/4), and then the rest. No point is
+computed twice, so the last stage leaves exactly the counts of a plain render.
+
+After each coarse stage, every point not yet computed is given the count of
+the computed point above and to the left of it, and stage_done is called, so
+the caller can color and write the image so far. The last stage is just
+the finished render, which the caller colors like any other.
+
+A render can be cancelled between stages, from a signal handler or another thread.
+*/
+
+// The spacing of the points computed by the first stage.
+#define PROGRESSIVE_FIRST 4
+
+struct progressive {
+	// Called with the spacing of the points computed so far. Returns 0 to fail the render.
+	int (*stage_done)( struct render *r, int stride, void *arg );
+	void *arg;
+
+	// Set to stop after the stage being computed.
+	volatile sig_atomic_t cancelled;
+
+	// The spacing of the stage being computed, and of the last one finished (0 if none).
+	int stride;
+	int finished;
+};
+
+struct progressive * progressive_create( int (*stage_done)( struct render *r, int stride, void *arg ), void *arg );
+void                 progressive_delete( struct progressive *p );
+
+/* Stop the render after the current stage. Safe to call from a signal handler. */
+void                 progressive_cancel( struct progressive *p );
+
+/*
+Compute the render r->progressive stage by stage, with the render's threads.
+Returns 0 on failure. A cancelled render still returns 1, with p->finished
+telling how far it got.
+*/
+int                  progressive_run( struct render *r );
+
+/* The thread bodies of progressive_run. */
+void *               compute_progressive( void *a );
+void *               fill_progressive( void *a );
+
+#endif
@@ -0,0 +1,560 @@
+#include "render.h"
+#include "deepzoom.h"
+#include "pool.h"
+#include "reproject.h"
+#include "instrument.h"
+#include "antialias.h"
+#include "progressive.h"
+#include "hp.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+
+// The counts start on a page, so that every band of rows can belong to one thread.
+#define PAGE_SIZE 4096
+
+struct render * render_create( int width, int height )
+{
+	struct render *r;
+
+	r = malloc(sizeof *r);
+	if(!r) return 0;
+
+	memset(r,0,sizeof(*r));
+
+	if(posix_memalign((void**)&r->iters,PAGE_SIZE,(size_t)width*height*sizeof(int))) r->iters = 0;
+	r->xs = malloc(width*sizeof(double));
+	r->ys = malloc(height*sizeof(double));
+	r->xlo = malloc(width*sizeof(double));
+	r->ylo = malloc(height*sizeof(double));
+	if(!r->iters || !r->xs || !r->ys || !r->xlo || !r->ylo) {
+		free(r->iters);
+		free(r->xs);
+		free(r->ys);
+		free(r->xlo);
+		free(r->ylo);
+		free(r);
+		return 0;
+	}
+
+	r->width = width;
+	r->height = height;
+
+	r->threads = 1;
+	r->schedule = SCHEDULE_DYNAMIC;
+	r->chunk = 4;
+	r->tile = 64;
+	r->kernel = kernel_select(KERNEL_AUTO);
+	r->precision = PRECISION_AUTO;
+	r->shortcuts = 1;
+
+	render_set_view(r,0,0,4,1000);
+
+	return r;
+}
+
+void render_delete( struct render *r )
+{
+	free(r->iters);
+	free(r->xs);
+	free(r->ys);
+	free(r->xlo);
+	free(r->ylo);
+	free(r->frac);
+	deepzoom_delete(r->deep);
+	reproject_delete(r->reproject);
+	instrument_delete(r->instrument);
+	antialias_delete(r->antialias);
+	progressive_delete(r->progressive);
+	if(r->pool) pool_delete(r->pool);
+	free(r->cpus);
+	free(r);
+}
+
+int render_resize( struct render *r, int width, int height )
+{
+	int *iters = 0;
+	float *frac = 0;
+
+	if(width==r->width && height==r->height) return 1;
+
+	double *xs = malloc(width*sizeof(double));
+	double *ys = malloc(height*sizeof(double));
+	double *xlo = malloc(width*sizeof(double));
+	double *ylo = malloc(height*sizeof(double));
+	if(posix_memalign((void**)&iters,PAGE_SIZE,(size_t)width*height*sizeof(int))) iters = 0;
+	if(r->frac && posix_memalign((void**)&frac,PAGE_SIZE,(size_t)width*height*sizeof(float))) frac = 0;
+
+	if(!xs || !ys || !xlo || !ylo || !iters || (r->frac && !frac)) {
+		free(xs);
+		free(ys);
+		free(xlo);
+		free(ylo);
+		free(iters);
+		free(frac);
+		return 0;
+	}
+
+	free(r->iters);
+	free(r->xs);
+	free(r->ys);
+	free(r->xlo);
+	free(r->ylo);
+	free(r->frac);
+
+	r->iters = iters;
+	r->frac = frac;
+	r->xs = xs;
+	r->ys = ys;
+	r->xlo = xlo;
+	r->ylo = ylo;
+	r->width = width;
+	r->height = height;
+	r->touched = 0;
+
+	// Everything else that depends on the size starts over.
+	deepzoom_delete(r->deep);
+	reproject_delete(r->reproject);
+	r->deep = 0;
+	r->reproject = 0;
+
+	render_set_view(r,0,0,4,r->max);
+
+	return 1;
+}
+
+/*
+Work out the low part of coordinate i of n, where the exact coordinate is
+center+centerlo + (-scale + i*2*scale/n), and the double one is "rounded".
+The offset is exact enough, since it is no bigger than scale,
+and two_sum recovers what is lost adding it to the center.
+*/
+
+static double low_part( double center, double centerlo, double scale, int i, int n, double rounded )
+{
+	double offset = -scale + i*(2*scale)/n;
+	double hi = center + offset;
+	double v = hi - center;
+	double lo = (center - (hi - v)) + (offset - v);
+
+	// hi and rounded are within a few ulps of each other, so this subtraction is exact.
+	return (hi - rounded) + (lo + centerlo);
+}
+
+static double largest( double a, double b )
+{
+	return fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+}
+
+static void set_view( struct render *r, double xcenter, double xcenterlo, double ycenter, double ycenterlo, double scale, int max )
+{
+	int i;
+
+	r->xmin = xcenter-scale;
+	r->xmax = xcenter+scale;
+	r->ymin = ycenter-scale;
+	r->ymax = ycenter+scale;
+	r->max = max;
+
+	// The coordinates are the same for every row and column, so work them out once.
+	for(i=0;i<r->width;i++) {
+		r->xs[i] = r->xmin + i*(r->xmax - r->xmin)/r->width;
+		r->xlo[i] = low_part(xcenter,xcenterlo,scale,i,r->width,r->xs[i]);
+	}
+
+	for(i=0;i<r->height;i++) {
+		r->ys[i] = r->ymin + i*(r->ymax - r->ymin)/r->height;
+		r->ylo[i] = low_part(ycenter,ycenterlo,scale,i,r->height,r->ys[i]);
+	}
+
+	r->step = 2*scale/(r->width > r->height ? r->width : r->height);
+	r->extent = largest(largest(r->xmin,r->xmax),largest(r->ymin,r->ymax));
+}
+
+void render_set_view( struct render *r, double xcenter, double ycenter, double scale, int max )
+{
+	set_view(r,xcenter,0,ycenter,0,scale,max);
+}
+
+void render_set_view_parts( struct render *r, double xcenter, double xcenterlo, double ycenter, double ycenterlo, double scale, int max )
+{
+	set_view(r,xcenter,xcenterlo,ycenter,ycenterlo,scale,max);
+}
+
+int render_parse_center( const char *text, double *hi, double *lo )
+{
+	struct hp a;
+
+	if(!hp_from_string(&a,text,hp_limbs_for(ldexp(1,-160)))) return 0;
+
+	hp_split(&a,hi,lo);
+	return 1;
+}
+
+int render_set_view_text( struct render *r, const char *xcenter, const char *ycenter, double scale, int max )
+{
+	double x, xlo, y, ylo;
+
+	if(!render_parse_center(xcenter,&x,&xlo) || !render_parse_center(ycenter,&y,&ylo)) return 0;
+
+	set_view(r,x,xlo,y,ylo,scale,max);
+
+	return 1;
+}
+
+void render_set_rows( struct render *r, double ycenter, double ycenterlo, double scale, int first, int total )
+{
+	int i;
+	double ymin = ycenter-scale;
+	double ymax = ycenter+scale;
+
+	// Exactly the same arithmetic as render_set_view, so a band matches the whole image.
+	for(i=0;i<r->height;i++) {
+		r->ys[i] = ymin + (first+i)*(ymax - ymin)/total;
+		r->ylo[i] = low_part(ycenter,ycenterlo,scale,first+i,total,r->ys[i]);
+	}
+
+	r->ymin = r->ys[0];
+	r->ymax = ymin + (first+r->height)*(ymax - ymin)/total;
+
+	// The precision depends on the whole image, not the band, so every band gets the same one.
+	r->step = 2*scale/(r->width > total ? r->width : total);
+	r->extent = largest(largest(r->xmin,r->xmax),largest(ymin,ymax));
+}
+
+int render_enable_smooth( struct render *r )
+{
+	if(!r->frac && posix_memalign((void**)&r->frac,PAGE_SIZE,(size_t)r->width*r->height*sizeof(float))) r->frac = 0;
+	return r->frac!=0;
+}
+
+// The header of a file of iteration counts, followed by the counts and then the fractions, if any.
+#pragma pack(1)
+struct iters_header {
+	char	magic[8];
+	int	width;
+	int	height;
+	int	max;
+	int	smooth;
+	double	xmin;
+	double	xmax;
+	double	ymin;
+	double	ymax;
+};
+#pragma pack()
+
+#define ITERS_MAGIC "MANDITR1"
+
+int render_save( struct render *r, const char *path )
+{
+	FILE *file;
+	struct iters_header header;
+	size_t npoints = (size_t)r->width*r->height;
+	int ok = 1;
+
+	file = fopen(path,"wb");
+	if(!file) return 0;
+
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,ITERS_MAGIC,8);
+	header.width = r->width;
+	header.height = r->height;
+	header.max = r->max;
+	header.smooth = r->frac!=0;
+	header.xmin = r->xmin;
+	header.xmax = r->xmax;
+	header.ymin = r->ymin;
+	header.ymax = r->ymax;
+
+	if(fwrite(&header,sizeof(header),1,file)!=1) ok = 0;
+	if(ok && fwrite(r->iters,sizeof(int),npoints,file)!=npoints) ok = 0;
+	if(ok && r->frac && fwrite(r->frac,sizeof(float),npoints,file)!=npoints) ok = 0;
+
+	if(fclose(file)!=0) ok = 0;
+
+	return ok;
+}
+
+struct render * render_load( const char *path )
+{
+	FILE *file;
+	struct iters_header header;
+	struct render *r;
+	size_t npoints;
+	size_t i;
+
+	file = fopen(path,"rb");
+	if(!file) return 0;
+
+	if(fread(&header,sizeof(header),1,file)!=1 || memcmp(header.magic,ITERS_MAGIC,8) || header.width<1 || header.height<1 || header.max<1) {
+		fprintf(stderr,"mandel: %s is not a file of iteration counts\n",path);
+		fclose(file);
+		return 0;
+	}
+
+	r = render_create(header.width,header.height);
+	if(!r || (header.smooth && !render_enable_smooth(r))) {
+		if(r) render_delete(r);
+		fclose(file);
+		return 0;
+	}
+
+	render_set_view(r,(header.xmin+header.xmax)/2,(header.ymin+header.ymax)/2,(header.xmax-header.xmin)/2,header.max);
+
+	npoints = (size_t)r->width*r->height;
+
+	if(fread(r->iters,sizeof(int),npoints,file)!=npoints || (r->frac && fread(r->frac,sizeof(float),npoints,file)!=npoints)) {
+		fprintf(stderr,"mandel: %s is too short\n",path);
+		render_delete(r);
+		fclose(file);
+		return 0;
+	}
+
+	fclose(file);
+
+	// The palette pass trusts every count to be between 0 and max.
+	for(i=0;i<npoints;i++) {
+		if(r->iters[i]<0 || r->iters[i]>r->max) r->iters[i] = r->max;
+	}
+
+	return r;
+}
+
+double render_y( struct render *r, int j )
+{
+	return r->ys[j];
+}
+
+void render_add_stats( struct render *r, struct kernel_stats *stats )
+{
+	__sync_fetch_and_add(&r->stats.cardioid,stats->cardioid);
+	__sync_fetch_and_add(&r->stats.bulb,stats->bulb);
+	__sync_fetch_and_add(&r->stats.periodic,stats->periodic);
+}
+
+/* Write zeros over the counts (and fractions) of each unit of rows this thread is given. */
+
+static void * touch_rows( void *a )
+{
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	int unit;
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		size_t offset = (size_t)start*r->width;
+		size_t npoints = (size_t)(end-start)*r->width;
+
+		memset(r->iters+offset,0,npoints*sizeof(int));
+		if(r->frac) memset(r->frac+offset,0,npoints*sizeof(float));
+	}
+
+	return (void *) 1;
+}
+
+/*
+Touch the rows each thread will be given before anything else does,
+so that the kernel places their pages on that thread's node.
+This isn't part of any render, so it is not instrumented.
+*/
+
+static int first_touch( struct render *r )
+{
+	struct instrument *instrument = r->instrument;
+	schedule_t schedule = r->schedule;
+
+	r->instrument = 0;
+	r->schedule = SCHEDULE_STATIC;
+
+	r->touched = render_threads(r,touch_rows,(r->height+r->chunk-1)/r->chunk);
+
+	r->instrument = instrument;
+	r->schedule = schedule;
+
+	return r->touched;
+}
+
+int render_run( struct render *r, engine_t engine )
+{
+	if(r->first_touch && !r->touched && !first_touch(r)) return 0;
+
+	r->mismatches = 0;
+	r->filled = 0;
+	memset(&r->stats,0,sizeof(r->stats));
+	if(r->instrument) instrument_reset(r->instrument);
+
+	r->chosen = precision_select(r->precision,r->extent,r->step,r->max);
+
+	// Each engine divides the image into its own kind of unit.
+	switch(engine) {
+		case ENGINE_SUBDIVIDE:
+			return render_threads(r,compute_subdivide,((r->width+r->tile-1)/r->tile) * ((r->height+r->tile-1)/r->tile));
+		case ENGINE_PERTURB:
+			return deepzoom_render(r);
+		case ENGINE_BRUTE:
+		default:
+			if(r->reproject && reproject_prepare(r->reproject,r)) {
+				return render_threads(r,compute_reproject,(r->height+r->chunk-1)/r->chunk);
+			}
+			if(r->progressive) return progressive_run(r);
+			return render_threads(r,compute_image,(r->height+r->chunk-1)/r->chunk);
+	}
+}
+
+struct pool * render_pool( struct render *r )
+{
+	// The threads are started on first use, and kept until the render is deleted.
+	if(r->pool && pool_size(r->pool)!=r->threads) {
+		pool_delete(r->pool);
+		r->pool = 0;
+	}
+
+	if(!r->pool) {
+		r->pool = pool_create_pinned(r->threads,r->cpus,r->ncpus);
+		if(!r->pool) {
+			fprintf(stderr,"mandel: couldn't create %d threads\n",r->threads);
+		}
+	}
+
+	return r->pool;
+}
+
+int render_threads( struct render *r, void * (*body)( void *a ), int nunits )
+{
+	int i;
+
+	if(!render_pool(r)) return 0;
+
+	r->queue = workqueue_create(nunits,r->threads,r->schedule);
+	if(!r->queue) {
+		fprintf(stderr,"mandel: couldn't create work queue: %s\n",strerror(errno));
+		return 0;
+	}
+
+	// With instrumentation on, each thread runs the body under a timer.
+	if(r->instrument) {
+		if(!instrument_prepare(r->instrument,r->threads,nunits)) {
+			fprintf(stderr,"mandel: out of memory for the thread counters\n");
+			workqueue_delete(r->queue);
+			r->queue = 0;
+			return 0;
+		}
+		r->instrument->body = body;
+		body = instrument_thread;
+	}
+
+	// Compute the Mandelbrot image
+	struct thread_args args[r->threads];
+	void *argp[r->threads];
+
+	for(i=0;i<r->threads;i++) {
+		args[i].r = r;
+		args[i].tnumber = i;
+		argp[i] = &args[i];
+	}
+
+	int result = pool_run(r->pool,body,argp);
+
+	if(r->instrument) instrument_finish(r->instrument);
+
+	workqueue_delete(r->queue);
+	r->queue = 0;
+
+	return result;
+}
+
+/*
+Compute a Mandelbrot image, writing the iterations at each point into r->iters.
+Scale the image to the range (xmin-xmax,ymin-ymax), limiting iterations to "max".
+Each thread keeps taking chunks of rows from the work queue until none are left.
+*/
+
+void * compute_image( void *a )
+{
+	int i,j,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+
+	int *reference = malloc(r->width*sizeof(int));
+	struct kernel_stats stats = {0,0,0};
+
+	if(!reference) {
+		fprintf(stderr,"mandel: out of memory in thread %d\n",args->tnumber+1);
+		exit(1);
+	}
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		double started = r->instrument ? instrument_now() : 0;
+
+		// For every row in the chunk...
+		for(j = start; j<end; j++) {
+
+			// Determine the y coordinate of the row.
+			double y = render_y(r,j);
+			int *iters = &r->iters[j*r->width];
+
+			// Compute the iterations at every point in the row.
+			if(r->frac) {
+				kernel_row_smooth(r->kernel,r->chosen,r->xs,r->xlo,y,r->ylo[j],r->width,r->max,iters,&r->frac[j*r->width],r->shortcuts ? &stats : 0);
+			} else {
+				kernel_row(r->kernel,r->chosen,r->xs,r->xlo,y,r->ylo[j],r->width,r->max,iters,r->shortcuts ? &stats : 0);
+			}
+
+			if(r->check) {
+				int wrong = 0;
+				kernel_row(KERNEL_SCALAR,r->chosen,r->xs,r->xlo,y,r->ylo[j],r->width,r->max,reference,0);
+				for(i=0;i<r->width;i++) {
+					if(iters[i]!=reference[i]) wrong++;
+				}
+				if(wrong) __sync_fetch_and_add(&r->mismatches,wrong);
+			}
+		}
+
+		if(r->instrument) {
+			long pixels = (long)(end-start)*r->width;
+			instrument_unit(r->instrument,args->tnumber,unit,0,start,r->width,end,pixels,instrument_sum(&r->iters[start*r->width],pixels),started);
+		}
+	}
+
+	free(reference);
+
+	render_add_stats(r,&stats);
+
+	return (void *) 1;
+}
+
+int engine_from_name( const char *name, engine_t *engine )
+{
+	if(!strcmp(name,"brute")) {
+		*engine = ENGINE_BRUTE;
+	} else if(!strcmp(name,"subdivide")) {
+		*engine = ENGINE_SUBDIVIDE;
+	} else if(!strcmp(name,"perturb")) {
+		*engine = ENGINE_PERTURB;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * engine_name( engine_t engine )
+{
+	switch(engine) {
+		case ENGINE_BRUTE:     return "brute";
+		case ENGINE_SUBDIVIDE: return "subdivide";
+		case ENGINE_PERTURB:   return "perturb";
+	}
+	return "unknown";
+}
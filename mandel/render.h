@@ -0,0 +1,170 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "kernel.h"
+#include "workqueue.h"
+
+/*
+An engine is a way of filling in the iteration counts of an image.
+ENGINE_BRUTE     computes every point, a chunk of rows at a time.
+ENGINE_SUBDIVIDE computes the border of each tile, fills the tile if the
+                 border is uniform, and otherwise splits it in four (Mariani-Silver).
+ENGINE_PERTURB   iterates every point as a difference from one high precision
+                 orbit, for zooms beyond the reach of doubles (see deepzoom.h).
+*/
+
+typedef enum {
+	ENGINE_BRUTE,
+	ENGINE_SUBDIVIDE,
+	ENGINE_PERTURB
+} engine_t;
+
+// Everything the threads share about the image being rendered.
+struct render {
+	int width;
+	int height;
+	double xmin;
+	double xmax;
+	double ymin;
+	double ymax;
+	int max;
+
+	// The iteration count at every point, row by row,
+	// and the coordinates of every column and row.
+	int *iters;
+	double *xs;
+	double *ys;
+
+	// What xs and ys leave out of the exact coordinates, for the precisions that can use it.
+	double *xlo;
+	double *ylo;
+
+	// The distance between neighboring points, and how far the view reaches from the origin,
+	// which decide how much precision the kernels need.
+	double step;
+	double extent;
+
+	// If not null, the fractional part of a smooth count at every point (brute force engine only).
+	float *frac;
+
+	// How the work is done. These may be changed freely between renders.
+	int threads;
+	schedule_t schedule;
+	int chunk;
+	int tile;
+	kernel_t kernel;
+	precision_t precision;
+	int shortcuts;
+	int check;
+
+	// If ncpus>0, thread i only runs on CPU cpus[i % ncpus].
+	// Set these before the first render, since the threads are only started once.
+	int *cpus;
+	int ncpus;
+
+	// If set, the first render has each thread write zeros to the rows it will be given,
+	// before any work is done, so that their pages are placed on the thread's own NUMA node.
+	// The rows follow the static schedule, which is the only one that knows in advance who gets what.
+	int first_touch;
+	int touched;
+
+	// Results collected from all the threads.
+	long mismatches;
+	long filled;
+	struct kernel_stats stats;
+
+	// The precision the last render used, once AUTO has been resolved.
+	precision_t chosen;
+
+	struct workqueue *queue;
+
+	// The threads, kept from one render to the next.
+	struct pool *pool;
+
+	// The high precision view used by the perturbation engine, if any.
+	struct deepzoom *deep;
+
+	// The previous frame of a zoom, if the brute force engine should reuse it.
+	struct reproject *reproject;
+
+	// Adaptive anti-aliasing, if it is wanted (see antialias.h).
+	struct antialias *antialias;
+
+	// If set, the brute force engine renders coarse to fine (see progressive.h).
+	struct progressive *progressive;
+
+	// Per-thread and per-unit counters, if they are wanted (see instrument.h).
+	struct instrument *instrument;
+};
+
+struct thread_args {
+	struct render *r;
+	int tnumber;
+};
+
+struct render * render_create( int width, int height );
+void            render_delete( struct render *r );
+
+/*
+Change the size of the render, keeping its threads and settings.
+The view goes back to the default, and any deep zoom or reuse state is dropped.
+Returns 0 if out of memory, leaving the render as it was.
+*/
+int             render_resize( struct render *r, int width, int height );
+
+/* Set the region of the plane to be rendered, and the maximum number of iterations. */
+void            render_set_view( struct render *r, double xcenter, double ycenter, double scale, int max );
+
+/*
+The same as render_set_view, but with the center given as decimal strings,
+so that the precisions finer than double get all of its digits.
+Returns 0 if the strings are not numbers.
+*/
+int             render_set_view_text( struct render *r, const char *xcenter, const char *ycenter, double scale, int max );
+
+/* The same, with each coordinate of the center given as a double and what the double leaves out. */
+void            render_set_view_parts( struct render *r, double xcenter, double xcenterlo, double ycenter, double ycenterlo, double scale, int max );
+
+/* Split a decimal string into a double and what the double leaves out. Returns 0 if it isn't a number. */
+int             render_parse_center( const char *text, double *hi, double *lo );
+
+/*
+Make the r->height rows of the render be rows first, first+1, ... of an image
+"total" rows high, centered on ycenter+ycenterlo with the given scale. The columns are left as they are.
+*/
+void            render_set_rows( struct render *r, double ycenter, double ycenterlo, double scale, int first, int total );
+
+/* Keep smooth fractional counts in r->frac as well. Returns 0 if out of memory. */
+int             render_enable_smooth( struct render *r );
+
+/*
+Save the counts (and smooth fractions) of a render to a file, or load a render back from one,
+so that it can be colored again without computing it.
+*/
+int             render_save( struct render *r, const char *file );
+struct render * render_load( const char *file );
+
+/* Return the thread pool of the render, creating it if needed. */
+struct pool *   render_pool( struct render *r );
+
+/* Return the y coordinate of row j. */
+double          render_y( struct render *r, int j );
+
+/* Fill in r->iters using the given engine and r->threads threads. Returns 0 on failure. */
+int             render_run( struct render *r, engine_t engine );
+
+/* Run "body" on the r->threads threads of the pool, with a fresh work queue of nunits units. Returns 0 on failure. */
+int             render_threads( struct render *r, void * (*body)( void *a ), int nunits );
+
+/* Add one thread's kernel counters into the totals for the render. */
+void            render_add_stats( struct render *r, struct kernel_stats *stats );
+
+/* The thread bodies of each engine. */
+void *          compute_image( void *a );
+void *          compute_subdivide( void *a );
+
+/* Convert between an engine and its name. Returns 0 if the name is unknown. */
+int             engine_from_name( const char *name, engine_t *engine );
+const char *    engine_name( engine_t engine );
+
+#endif
@@ -0,0 +1,198 @@
+#include "reproject.h"
+#include "render.h"
+#include "instrument.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+struct reproject * reproject_create( int width, int height, double tolerance )
+{
+	struct reproject *p = malloc(sizeof(*p));
+	if(!p) return 0;
+
+	memset(p,0,sizeof(*p));
+
+	p->tolerance = tolerance;
+	p->xs = malloc(width*sizeof(double));
+	p->ys = malloc(height*sizeof(double));
+	p->xlo = malloc(width*sizeof(double));
+	p->ylo = malloc(height*sizeof(double));
+	p->colmap = malloc(width*sizeof(int));
+	p->rowmap = malloc(height*sizeof(int));
+
+	if(!p->xs || !p->ys || !p->xlo || !p->ylo || !p->colmap || !p->rowmap) {
+		reproject_delete(p);
+		return 0;
+	}
+
+	return p;
+}
+
+void reproject_delete( struct reproject *p )
+{
+	if(!p) return;
+	free(p->xs);
+	free(p->ys);
+	free(p->xlo);
+	free(p->ylo);
+	free(p->colmap);
+	free(p->rowmap);
+	free(p);
+}
+
+void reproject_remember( struct reproject *p, struct render *r )
+{
+	p->iters = r->iters;
+	memcpy(p->xs,r->xs,r->width*sizeof(double));
+	memcpy(p->ys,r->ys,r->height*sizeof(double));
+	memcpy(p->xlo,r->xlo,r->width*sizeof(double));
+	memcpy(p->ylo,r->ylo,r->height*sizeof(double));
+	p->width = r->width;
+	p->height = r->height;
+	p->max = r->max;
+	p->chosen = r->chosen;
+	p->valid = 1;
+}
+
+/*
+Match every coordinate in "want" to the nearest one in "have", if it is within
+"limit". Both are in increasing order, so one pass over each does it.
+With a limit of zero, the low parts must be the same too.
+Returns the number matched.
+*/
+
+static int match( const double *want, const double *wantlo, int nwant, const double *have, const double *havelo, int nhave, double limit, int *map )
+{
+	int i, k = 0, matched = 0;
+
+	for(i=0;i<nwant;i++) {
+		while(k+1<nhave && fabs(have[k+1]-want[i]) <= fabs(have[k]-want[i])) k++;
+
+		if(fabs(have[k]-want[i]) <= limit && (limit>0 || havelo[k]==wantlo[i])) {
+			map[i] = k;
+			matched++;
+		} else {
+			map[i] = -1;
+		}
+	}
+
+	return matched;
+}
+
+int reproject_prepare( struct reproject *p, struct render *r )
+{
+	p->hits = 0;
+
+	if(!p->valid || p->max!=r->max || p->width!=r->width || p->height!=r->height) return 0;
+
+	// A point computed in another precision may have another count.
+	if(p->chosen!=r->chosen) return 0;
+
+	double dx = (r->xmax-r->xmin)/r->width;
+	double dy = (r->ymax-r->ymin)/r->height;
+
+	int cols = match(r->xs,r->xlo,r->width,p->xs,p->xlo,p->width,p->tolerance*dx,p->colmap);
+	int rows = match(r->ys,r->ylo,r->height,p->ys,p->ylo,p->height,p->tolerance*dy,p->rowmap);
+
+	return cols>0 && rows>0;
+}
+
+/* Are the counts around (i,j) in the previous frame all the same? */
+
+static int settled( struct reproject *p, int i, int j )
+{
+	int value = p->iters[j*p->width+i];
+	int x0 = i>0 ? i-1 : i, x1 = i<p->width-1 ? i+1 : i;
+	int y0 = j>0 ? j-1 : j, y1 = j<p->height-1 ? j+1 : j;
+	int x, y;
+
+	for(y=y0;y<=y1;y++) {
+		for(x=x0;x<=x1;x++) {
+			if(p->iters[y*p->width+x]!=value) return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+Like compute_image, but copy every point that the previous frame already has,
+and gather the rest of each row into one run for the kernel.
+*/
+
+void * compute_reproject( void *a )
+{
+	int i,j,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	struct reproject *p = r->reproject;
+
+	struct kernel_stats stats = {0,0,0};
+	double *xs = malloc(r->width*sizeof(double));
+	double *xlo = malloc(r->width*sizeof(double));
+	int *iters = malloc(r->width*sizeof(int));
+	int *where = malloc(r->width*sizeof(int));
+	long hits = 0;
+
+	if(!xs || !xlo || !iters || !where) {
+		fprintf(stderr,"mandel: out of memory in thread %d\n",args->tnumber+1);
+		exit(1);
+	}
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		int start = unit * r->chunk;
+		int end = start + r->chunk;
+		if(end > r->height) end = r->height;
+
+		double started = r->instrument ? instrument_now() : 0;
+		long pixels = 0, iterations = 0;
+
+		for(j = start; j<end; j++) {
+			double y = render_y(r,j);
+			int *row = &r->iters[j*r->width];
+			int oldj = p->rowmap[j];
+			int n = 0;
+
+			for(i=0;i<r->width;i++) {
+				int oldi = p->colmap[i];
+
+				if(oldj>=0 && oldi>=0 && (p->tolerance==0 || settled(p,oldi,oldj))) {
+					row[i] = p->iters[oldj*p->width+oldi];
+					hits++;
+				} else {
+					xs[n] = r->xs[i];
+					xlo[n] = r->xlo[i];
+					where[n] = i;
+					n++;
+				}
+			}
+
+			if(n==r->width) {
+				kernel_row(r->kernel,r->chosen,r->xs,r->xlo,y,r->ylo[j],r->width,r->max,row,r->shortcuts ? &stats : 0);
+				if(r->instrument) iterations += instrument_sum(row,n);
+			} else if(n>0) {
+				kernel_row(r->kernel,r->chosen,xs,xlo,y,r->ylo[j],n,r->max,iters,r->shortcuts ? &stats : 0);
+				for(i=0;i<n;i++) row[where[i]] = iters[i];
+				if(r->instrument) iterations += instrument_sum(iters,n);
+			}
+
+			pixels += n;
+		}
+
+		if(r->instrument) instrument_unit(r->instrument,args->tnumber,unit,0,start,r->width,end,pixels,iterations,started);
+	}
+
+	free(xs);
+	free(xlo);
+	free(iters);
+	free(where);
+
+	__sync_fetch_and_add(&p->hits,hits);
+	render_add_stats(r,&stats);
+
+	return (void *) 1;
+}
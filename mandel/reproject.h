@@ -0,0 +1,58 @@
+#ifndef REPROJECT_H
+#define REPROJECT_H
+
+#include "kernel.h"
+
+struct render;
+
+/*
+Reuse of iteration counts from one frame of a zoom to the next.
+
+Each column and row of the new frame is matched to the nearest column and row
+of the previous frame. A point whose match is within "tolerance" pixels
+(of the new frame) in both directions takes its count from the previous frame,
+and only the rest are computed.
+
+With a tolerance of zero only points that are sampled at exactly the same
+coordinates (low parts included) in the same precision are reused, so the
+image is identical to a full render.
+With a larger tolerance, a point is also recomputed if the counts around its
+match in the previous frame are not all the same, since those are the points
+where a small shift could change the answer.
+*/
+
+struct reproject {
+	double tolerance;
+
+	// The previous frame. Its counts are only borrowed, and must stay put until the next frame is done.
+	const int *iters;
+	double *xs;
+	double *ys;
+	double *xlo;
+	double *ylo;
+	int width;
+	int height;
+	int max;
+	precision_t chosen;
+	int valid;
+
+	// For each column and row of the new frame, its match in the previous one, or -1.
+	int *colmap;
+	int *rowmap;
+
+	long hits;
+};
+
+struct reproject * reproject_create( int width, int height, double tolerance );
+void               reproject_delete( struct reproject *p );
+
+/* Remember the frame just rendered in r, to be reused by the next one. */
+void               reproject_remember( struct reproject *p, struct render *r );
+
+/* Match the view now set in r against the previous frame. Returns 0 if nothing can be reused. */
+int                reproject_prepare( struct reproject *p, struct render *r );
+
+/* The thread body of the brute force engine when there is a previous frame to reuse. */
+void *             compute_reproject( void *a );
+
+#endif
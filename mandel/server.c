@@ -0,0 +1,357 @@
+#include "server.h"
+#include "client.h"
+#include "tilecache.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+// Centers further than this many pixels from the origin don't fit the cache's keys.
+#define MAX_PIXELS 1e18
+
+struct server {
+	struct render *r;
+	engine_t engine;
+
+	// Only one tile is rendered at a time, with all of the render's threads.
+	pthread_mutex_t render_lock;
+
+	pthread_mutex_t cache_lock;
+	struct tilecache *cache;
+
+	// The clients still connected, so they can be cut off when the server stops.
+	pthread_mutex_t clients_lock;
+	pthread_cond_t clients_gone;
+	struct connection *clients;
+	int nclients;
+};
+
+struct connection {
+	struct server *s;
+	int fd;
+	struct connection *next;
+	struct connection **prev;
+};
+
+// SIGINT and SIGTERM write to this pipe, which wakes the accept loop
+// whichever thread the signal happens to be delivered to.
+static int wakeup[2] = { -1, -1 };
+
+static void stop( int sig )
+{
+	char c = 0;
+	write(wakeup[1],&c,1);
+}
+
+static double seconds_since( struct timeval *start )
+{
+	struct timeval now;
+	gettimeofday(&now,0);
+	return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1000000.0;
+}
+
+/*
+Render one tile into counts, or fetch it from the cache.
+Returns 0 and fills in error if it can't be done.
+*/
+
+static int serve_tile( struct server *s, const char *line, FILE *out, int **counts, int *capacity, char *error, int length )
+{
+	char xtext[64], ytext[64], *end;
+	double scale;
+	int max, size;
+	struct timeval start;
+
+	gettimeofday(&start,0);
+
+	if(sscanf(line,"tile %63s %63s %lf %d %d",xtext,ytext,&scale,&max,&size)!=5) {
+		snprintf(error,length,"use: tile <x> <y> <scale> <max> <size>");
+		return 0;
+	}
+
+	double x = strtod(xtext,&end);
+	if(*end) {
+		snprintf(error,length,"%s is not a number",xtext);
+		return 0;
+	}
+
+	double y = strtod(ytext,&end);
+	if(*end) {
+		snprintf(error,length,"%s is not a number",ytext);
+		return 0;
+	}
+
+	if(!(scale>0) || max<1 || size<1 || size>SERVER_MAX_SIZE) {
+		snprintf(error,length,"the scale and max must be positive, and the size from 1 to %d",SERVER_MAX_SIZE);
+		return 0;
+	}
+
+	// Round the center to the grid of pixels, so that tiles of the same scale line up and can be shared.
+	double step = 2*scale/size;
+	if(!(fabs(x/step)<MAX_PIXELS && fabs(y/step)<MAX_PIXELS)) {
+		snprintf(error,length,"the scale is too small for the server");
+		return 0;
+	}
+
+	struct tilecache_key key = { llround(x/step), llround(y/step), scale, max, size };
+	double xcenter = key.qx*step;
+	double ycenter = key.qy*step;
+
+	if(size*size > *capacity) {
+		int *bigger = realloc(*counts,(size_t)size*size*sizeof(int));
+		if(!bigger) {
+			snprintf(error,length,"out of memory");
+			return 0;
+		}
+		*counts = bigger;
+		*capacity = size*size;
+	}
+
+	pthread_mutex_lock(&s->cache_lock);
+	int hit = tilecache_get(s->cache,&key,*counts);
+	pthread_mutex_unlock(&s->cache_lock);
+
+	if(!hit) {
+		struct render *r = s->r;
+		int ok;
+
+		pthread_mutex_lock(&s->render_lock);
+		ok = render_resize(r,size,size);
+		if(ok) {
+			render_set_view(r,xcenter,ycenter,scale,max);
+			ok = render_run(r,s->engine);
+			if(ok) memcpy(*counts,r->iters,(size_t)size*size*sizeof(int));
+		}
+		pthread_mutex_unlock(&s->render_lock);
+
+		if(!ok) {
+			snprintf(error,length,"couldn't render a %dx%d tile",size,size);
+			return 0;
+		}
+
+		pthread_mutex_lock(&s->cache_lock);
+		tilecache_put(s->cache,&key,*counts);
+		pthread_mutex_unlock(&s->cache_lock);
+	}
+
+	fprintf(out,"ok %d %s %ld %.17g %.17g\n",size,hit ? "hit" : "miss",(long)(seconds_since(&start)*1e6),xcenter,ycenter);
+	fwrite(*counts,sizeof(int),(size_t)size*size,out);
+
+	return 1;
+}
+
+/* Answer the requests of one client until it hangs up. */
+
+static void * serve_client( void *a )
+{
+	struct connection *c = a;
+	struct server *s = c->s;
+	int *counts = 0;
+	int capacity = 0;
+	char line[512], error[256];
+
+	FILE *in = fdopen(dup(c->fd),"r");
+	FILE *out = fdopen(dup(c->fd),"w");
+
+	while(in && out && fgets(line,sizeof(line),in)) {
+		line[strcspn(line,"\n")] = 0;
+
+		if(!strncmp(line,"tile ",5)) {
+			if(!serve_tile(s,line,out,&counts,&capacity,error,sizeof(error))) {
+				fprintf(out,"error %s\n",error);
+			}
+		} else if(!strcmp(line,"stats")) {
+			struct tilecache_stats stats;
+			pthread_mutex_lock(&s->cache_lock);
+			tilecache_stats(s->cache,&stats);
+			pthread_mutex_unlock(&s->cache_lock);
+			fprintf(out,"stats %ld %zu %ld %ld %ld\n",stats.tiles,stats.bytes,stats.hits,stats.misses,stats.evictions);
+		} else {
+			fprintf(out,"error unknown request: %s\n",line);
+		}
+
+		if(fflush(out)!=0) break;
+	}
+
+	if(in) fclose(in);
+	if(out) fclose(out);
+	free(counts);
+
+	pthread_mutex_lock(&s->clients_lock);
+	*c->prev = c->next;
+	if(c->next) c->next->prev = c->prev;
+	close(c->fd);
+	free(c);
+	if(--s->nclients==0) pthread_cond_signal(&s->clients_gone);
+	pthread_mutex_unlock(&s->clients_lock);
+
+	return 0;
+}
+
+/* Make the listening socket, replacing a socket left behind by an earlier server. */
+
+static int listen_on( const char *path )
+{
+	struct sockaddr_un address;
+	struct stat info;
+
+	if(strlen(path)>=sizeof(address.sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(&address,0,sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path,path);
+
+	if(lstat(path,&info)==0 && S_ISSOCK(info.st_mode)) unlink(path);
+
+	int fd = socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd<0) return -1;
+
+	if(bind(fd,(struct sockaddr *)&address,sizeof(address))!=0 || listen(fd,SOMAXCONN)!=0) {
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+
+	return fd;
+}
+
+int server_run( struct render *r, engine_t engine, const char *path, size_t cache_bytes )
+{
+	struct server s;
+	struct sigaction action;
+
+	memset(&s,0,sizeof(s));
+	s.r = r;
+	s.engine = engine;
+
+	s.cache = tilecache_create(cache_bytes);
+	if(!s.cache) {
+		fprintf(stderr,"mandel: out of memory for the tile cache\n");
+		return 0;
+	}
+
+	int listener = listen_on(path);
+	if(listener<0) {
+		fprintf(stderr,"mandel: couldn't listen on %s: %s\n",path,strerror(errno));
+		tilecache_delete(s.cache);
+		return 0;
+	}
+
+	// Start the threads now, rather than on the first request.
+	if(!render_pool(r)) {
+		close(listener);
+		unlink(path);
+		tilecache_delete(s.cache);
+		return 0;
+	}
+
+	pthread_mutex_init(&s.render_lock,0);
+	pthread_mutex_init(&s.cache_lock,0);
+	pthread_mutex_init(&s.clients_lock,0);
+	pthread_cond_init(&s.clients_gone,0);
+
+	if(pipe(wakeup)!=0) {
+		fprintf(stderr,"mandel: couldn't make a pipe: %s\n",strerror(errno));
+		close(listener);
+		unlink(path);
+		tilecache_delete(s.cache);
+		return 0;
+	}
+
+	memset(&action,0,sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT,&action,0);
+	sigaction(SIGTERM,&action,0);
+	signal(SIGPIPE,SIG_IGN);
+
+	printf("mandel: serving tiles on %s with a %zuMB cache\n",path,cache_bytes>>20);
+	fflush(stdout);
+
+	for(;;) {
+		struct pollfd waiting[2] = { { listener, POLLIN, 0 }, { wakeup[0], POLLIN, 0 } };
+
+		if(poll(waiting,2,-1)<0) continue;
+		if(waiting[1].revents) break;
+
+		int fd = accept(listener,0,0);
+		if(fd<0) {
+			if(errno!=EINTR && errno!=ECONNABORTED) fprintf(stderr,"mandel: couldn't accept a client: %s\n",strerror(errno));
+			continue;
+		}
+
+		struct connection *c = malloc(sizeof(*c));
+		pthread_t tid;
+		pthread_attr_t attr;
+
+		if(!c) {
+			close(fd);
+			continue;
+		}
+
+		c->s = &s;
+		c->fd = fd;
+
+		pthread_mutex_lock(&s.clients_lock);
+		c->next = s.clients;
+		c->prev = &s.clients;
+		if(s.clients) s.clients->prev = &c->next;
+		s.clients = c;
+		s.nclients++;
+		pthread_mutex_unlock(&s.clients_lock);
+
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+
+		if(pthread_create(&tid,&attr,serve_client,c)!=0) {
+			fprintf(stderr,"mandel: couldn't start a thread for a client\n");
+			pthread_mutex_lock(&s.clients_lock);
+			s.clients = c->next;
+			if(c->next) c->next->prev = &s.clients;
+			s.nclients--;
+			pthread_mutex_unlock(&s.clients_lock);
+			close(fd);
+			free(c);
+		}
+
+		pthread_attr_destroy(&attr);
+	}
+
+	close(listener);
+	unlink(path);
+	close(wakeup[0]);
+	close(wakeup[1]);
+	wakeup[0] = wakeup[1] = -1;
+
+	// Hang up on every client, and wait for their threads to finish with the render.
+	pthread_mutex_lock(&s.clients_lock);
+	struct connection *c;
+	for(c=s.clients;c;c=c->next) shutdown(c->fd,SHUT_RDWR);
+	while(s.nclients>0) pthread_cond_wait(&s.clients_gone,&s.clients_lock);
+	pthread_mutex_unlock(&s.clients_lock);
+
+	struct tilecache_stats stats;
+	tilecache_stats(s.cache,&stats);
+	printf("mandel: served %ld tiles from the cache and rendered %ld, evicting %ld\n",stats.hits,stats.misses,stats.evictions);
+
+	tilecache_delete(s.cache);
+	pthread_cond_destroy(&s.clients_gone);
+	pthread_mutex_destroy(&s.clients_lock);
+	pthread_mutex_destroy(&s.cache_lock);
+	pthread_mutex_destroy(&s.render_lock);
+
+	return 1;
+}
@@ -0,0 +1,24 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "render.h"
+
+#include <stddef.h>
+
+/*
+A long-running render server, so that an interactive explorer doesn't pay for
+a new process, new buffers and new threads on every tile.
+
+server_run listens on a UNIX domain socket at path, and answers the requests
+described in client.h, each client on its own thread. Tiles are rendered one
+at a time with r and its thread pool, using whatever engine, kernel, precision
+and schedule r is set up for, and the counts of the last cache_bytes worth of
+tiles are kept in an LRU cache (see tilecache.h), so that panning back and
+forth, or zooming out again, comes straight from memory.
+
+It runs until SIGINT or SIGTERM, and then removes the socket.
+Returns 0 if the server couldn't be started.
+*/
+int server_run( struct render *r, engine_t engine, const char *path, size_t cache_bytes );
+
+#endif
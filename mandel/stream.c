@@ -0,0 +1,189 @@
+#include "stream.h"
+#include "bitmap.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+// One band is computed while the one before it is written.
+#define SLOTS 2
+
+// For each point of a band: its count, its color, and its encoded pixel, in each slot.
+#define BYTES_PER_POINT (SLOTS*(sizeof(int) + sizeof(int) + 3))
+
+// One finished band, waiting to be colored and written.
+struct band {
+	int *iters;
+	struct bitmap *bm;
+	int first;
+	int rows;
+	int full;
+};
+
+struct stream {
+	struct band bands[SLOTS];
+	int nbands;
+	int width;
+	int max;
+	palette_t palette;
+	int fd;
+	int failed;
+
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+};
+
+int stream_band_rows( int width, long budget )
+{
+	long rows = budget / ((long)width*BYTES_PER_POINT);
+	if(rows<1) rows = 1;
+	return rows;
+}
+
+static double elapsed( struct timeval *start )
+{
+	struct timeval now;
+	gettimeofday(&now,0);
+	return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1000000.0;
+}
+
+/* The writer thread colors and writes the bands in order as they are finished. */
+
+static void * write_bands( void *a )
+{
+	struct stream *s = a;
+	int n;
+
+	for(n=0;n<s->nbands;n++) {
+		struct band *b = &s->bands[n%SLOTS];
+
+		pthread_mutex_lock(&s->lock);
+		while(!b->full) pthread_cond_wait(&s->changed,&s->lock);
+		pthread_mutex_unlock(&s->lock);
+
+		// A band with no rows means the renderer gave up.
+		if(b->rows==0) break;
+
+		if(!palette_apply_bitmap(s->palette,b->iters,0,s->width*b->rows,s->max,b->bm,0)) {
+			fprintf(stderr,"mandel: couldn't color rows %d-%d\n",b->first,b->first+b->rows-1);
+			s->failed = 1;
+		} else if(!bitmap_write_rows(b->bm,s->fd,b->rows,b->first)) {
+			fprintf(stderr,"mandel: couldn't write rows %d-%d: %s\n",b->first,b->first+b->rows-1,strerror(errno));
+			s->failed = 1;
+		}
+
+		pthread_mutex_lock(&s->lock);
+		b->full = 0;
+		pthread_cond_broadcast(&s->changed);
+		pthread_mutex_unlock(&s->lock);
+	}
+
+	return 0;
+}
+
+int stream_run( struct render *r, struct bitmap *bm, engine_t engine, palette_t palette, const char *xcenter, const char *ycenter, double scale, int max, int height, const char *outfile )
+{
+	struct stream s;
+	pthread_t writer;
+	struct timeval start;
+	int band_rows = r->height;
+	int n, i, ok = 1;
+	double x, xlo, y, ylo;
+
+	// Every band needs the whole center, low parts included, for the precisions finer than double.
+	if(!render_parse_center(xcenter,&x,&xlo) || !render_parse_center(ycenter,&y,&ylo)) {
+		fprintf(stderr,"mandel: couldn't use %s,%s as a center point\n",xcenter,ycenter);
+		return 0;
+	}
+
+	memset(&s,0,sizeof(s));
+	s.width = r->width;
+	s.max = max;
+	s.palette = palette;
+	s.nbands = (height+band_rows-1)/band_rows;
+
+	s.fd = bitmap_open_stream(outfile,r->width,height);
+	if(s.fd<0) {
+		fprintf(stderr,"mandel: couldn't create %s: %s\n",outfile,strerror(errno));
+		return 0;
+	}
+
+	// The caller's buffers are the first slot; the other is only needed while streaming.
+	int *own = r->iters;
+
+	for(i=0;i<SLOTS;i++) {
+		s.bands[i].iters = i==0 ? own : malloc((size_t)r->width*band_rows*sizeof(int));
+		s.bands[i].bm = i==0 ? bm : bitmap_create_like(bm,r->width,band_rows);
+		if(!s.bands[i].iters || !s.bands[i].bm) {
+			fprintf(stderr,"mandel: couldn't allocate a band of %d rows: %s\n",band_rows,strerror(errno));
+			ok = 0;
+		}
+	}
+
+	pthread_mutex_init(&s.lock,0);
+	pthread_cond_init(&s.changed,0);
+
+	if(ok && pthread_create(&writer,0,write_bands,&s)!=0) {
+		fprintf(stderr,"mandel: couldn't create the writer thread: %s\n",strerror(errno));
+		ok = 0;
+	}
+
+	if(ok) {
+		gettimeofday(&start,0);
+
+		render_set_view_parts(r,x,xlo,y,ylo,scale,max);
+
+		for(n=0;n<s.nbands;n++) {
+			struct band *b = &s.bands[n%SLOTS];
+			int first = n*band_rows;
+			int rows = height-first < band_rows ? height-first : band_rows;
+
+			pthread_mutex_lock(&s.lock);
+			while(b->full) pthread_cond_wait(&s.changed,&s.lock);
+			pthread_mutex_unlock(&s.lock);
+
+			r->iters = b->iters;
+			r->height = rows;
+			render_set_rows(r,y,ylo,scale,first,height);
+
+			int result = render_run(r,engine);
+
+			pthread_mutex_lock(&s.lock);
+			b->first = first;
+			b->rows = result ? rows : 0;
+			b->full = 1;
+			pthread_cond_broadcast(&s.changed);
+			pthread_mutex_unlock(&s.lock);
+
+			if(!result) {
+				ok = 0;
+				break;
+			}
+		}
+
+		pthread_join(writer,0);
+
+		if(s.failed) ok = 0;
+
+		printf("mandel: %d bands of %d rows in %.3fs in %s precision\n",n,band_rows,elapsed(&start),precision_name(r->chosen));
+	}
+
+	r->iters = own;
+	r->height = band_rows;
+
+	for(i=1;i<SLOTS;i++) {
+		free(s.bands[i].iters);
+		if(s.bands[i].bm) bitmap_delete(s.bands[i].bm);
+	}
+
+	pthread_cond_destroy(&s.changed);
+	pthread_mutex_destroy(&s.lock);
+
+	if(close(s.fd)!=0) ok = 0;
+
+	return ok;
+}
@@ -0,0 +1,27 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "render.h"
+#include "palette.h"
+
+struct bitmap;
+
+/*
+Streaming renders an image too big for memory one band of rows at a time.
+The render and bitmap passed in are only one band high, and set the size of every band.
+Each band is computed by the render's threads while a writer thread colors the
+band before it and writes it straight to its place in the output file,
+so only two bands are ever in memory and the disk is busy during the computation.
+*/
+
+/* Return the number of rows in a band of an image "width" wide, to fit in about budget bytes. */
+int stream_band_rows( int width, long budget );
+
+/*
+Render the view (xcenter,ycenter,scale,max) at r->width by height pixels into outfile.
+The center is given as decimal strings, as for render_set_view_text.
+Returns 0 on failure.
+*/
+int stream_run( struct render *r, struct bitmap *bm, engine_t engine, palette_t palette, const char *xcenter, const char *ycenter, double scale, int max, int height, const char *outfile );
+
+#endif
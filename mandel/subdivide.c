@@ -0,0 +1,213 @@
+/*
+The Mariani-Silver engine.
+
+The image is cut into square tiles, which are the units of work handed out to threads.
+Within a tile, we compute only the points on the border of a rectangle.
+If every point on the border has the same iteration count, the whole rectangle
+is filled in with that count. Otherwise the rectangle is split into four
+smaller rectangles, which share the border lines already computed.
+
+For points inside the set this is exact, because the set is connected.
+Elsewhere a small feature can in principle hide entirely inside a rectangle,
+so mandel -V compares the result against the brute force engine.
+*/
+
+#include "render.h"
+#include "instrument.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// A point whose iterations have not been computed yet.
+#define UNKNOWN -1
+
+// Rectangles narrower than this are computed in full, where the vector kernels
+// can still work on long runs of points instead of splitting any further.
+#define MIN_SIZE 16
+
+struct subdivide_state {
+	struct render *r;
+	struct kernel_stats stats;
+	long filled;
+	long filled_iterations;
+	int *column;
+};
+
+static struct kernel_stats * stats_of( struct subdivide_state *s )
+{
+	return s->r->shortcuts ? &s->stats : 0;
+}
+
+/* Compute any unknown points in row j from x0 to x1 inclusive. */
+
+static void compute_span( struct subdivide_state *s, int j, int x0, int x1 )
+{
+	struct render *r = s->r;
+	int *row = &r->iters[j*r->width];
+	double y = render_y(r,j);
+	int i = x0;
+
+	// Find each run of unknown points and hand it to the kernel in one go.
+	while(i<=x1) {
+		if(row[i]!=UNKNOWN) {
+			i++;
+			continue;
+		}
+
+		int start = i;
+		while(i<=x1 && row[i]==UNKNOWN) i++;
+
+		kernel_row(r->kernel,r->chosen,&r->xs[start],&r->xlo[start],y,r->ylo[j],i-start,r->max,&row[start],stats_of(s));
+	}
+}
+
+/* Compute any unknown points in column i from y0 to y1 inclusive. */
+
+static void compute_column( struct subdivide_state *s, int i, int y0, int y1 )
+{
+	struct render *r = s->r;
+	int *point = &r->iters[y0*r->width+i];
+	int j = y0;
+
+	// The points in a column are not next to each other in memory,
+	// so each run goes through s->column on its way to the image.
+	while(j<=y1) {
+		if(*point!=UNKNOWN) {
+			j++;
+			point += r->width;
+			continue;
+		}
+
+		int start = j;
+		while(j<=y1 && r->iters[j*r->width+i]==UNKNOWN) j++;
+
+		kernel_column(r->kernel,r->chosen,r->xs[i],r->xlo[i],&r->ys[start],&r->ylo[start],j-start,r->max,s->column,stats_of(s));
+
+		int k;
+		for(k=0;k<j-start;k++) {
+			*point = s->column[k];
+			point += r->width;
+		}
+	}
+}
+
+/* Return true if every point on the border of the rectangle has the same count. */
+
+static int border_uniform( struct render *r, int x0, int y0, int x1, int y1 )
+{
+	int *top = &r->iters[y0*r->width];
+	int *bottom = &r->iters[y1*r->width];
+	int value = top[x0];
+	int i, j;
+
+	for(i=x0;i<=x1;i++) {
+		if(top[i]!=value || bottom[i]!=value) return 0;
+	}
+
+	for(j=y0+1;j<y1;j++) {
+		int *row = &r->iters[j*r->width];
+		if(row[x0]!=value || row[x1]!=value) return 0;
+	}
+
+	return 1;
+}
+
+/* Fill in the rectangle x0-x1, y0-y1 (inclusive), whose border has been computed. */
+
+static void subdivide( struct subdivide_state *s, int x0, int y0, int x1, int y1 )
+{
+	struct render *r = s->r;
+	int j;
+
+	if(x1-x0 < MIN_SIZE || y1-y0 < MIN_SIZE) {
+		for(j=y0;j<=y1;j++) compute_span(s,j,x0,x1);
+		return;
+	}
+
+	if(border_uniform(r,x0,y0,x1,y1)) {
+		int value = r->iters[y0*r->width+x0];
+		int i;
+
+		for(j=y0+1;j<y1;j++) {
+			int *row = &r->iters[j*r->width];
+			for(i=x0+1;i<x1;i++) row[i] = value;
+		}
+
+		s->filled += (long)(x1-x0-1)*(y1-y0-1);
+		s->filled_iterations += (long)value*(x1-x0-1)*(y1-y0-1);
+		return;
+	}
+
+	// Compute the lines that divide the rectangle into four, then handle each quarter.
+	int xm = (x0+x1)/2;
+	int ym = (y0+y1)/2;
+
+	compute_span(s,ym,x0+1,x1-1);
+	compute_column(s,xm,y0+1,y1-1);
+
+	subdivide(s,x0,y0,xm,ym);
+	subdivide(s,xm,y0,x1,ym);
+	subdivide(s,x0,ym,xm,y1);
+	subdivide(s,xm,ym,x1,y1);
+}
+
+void * compute_subdivide( void *a )
+{
+	int j,unit;
+
+	struct thread_args *args = a;
+	struct render *r = args->r;
+	struct subdivide_state s = { r, {0,0,0}, 0, 0, 0 };
+
+	s.column = malloc(r->tile*sizeof(int));
+	if(!s.column) {
+		fprintf(stderr,"mandel: out of memory in thread %d\n",args->tnumber+1);
+		exit(1);
+	}
+
+	int tiles_across = (r->width+r->tile-1)/r->tile;
+
+	while((unit = workqueue_next(r->queue,args->tnumber)) >= 0) {
+
+		int x0 = (unit % tiles_across) * r->tile;
+		int y0 = (unit / tiles_across) * r->tile;
+		int x1 = x0 + r->tile - 1;
+		int y1 = y0 + r->tile - 1;
+		if(x1 >= r->width) x1 = r->width-1;
+		if(y1 >= r->height) y1 = r->height-1;
+
+		double started = r->instrument ? instrument_now() : 0;
+		long filled = s.filled;
+		long filled_iterations = s.filled_iterations;
+
+		// Each tile belongs to exactly one thread, so it can be cleared without locking.
+		for(j=y0;j<=y1;j++) {
+			int i;
+			int *row = &r->iters[j*r->width];
+			for(i=x0;i<=x1;i++) row[i] = UNKNOWN;
+		}
+
+		compute_span(&s,y0,x0,x1);
+		compute_span(&s,y1,x0,x1);
+		compute_column(&s,x0,y0+1,y1-1);
+		compute_column(&s,x1,y0+1,y1-1);
+
+		subdivide(&s,x0,y0,x1,y1);
+
+		if(r->instrument) {
+			// Count only the points that were iterated, not the ones filled in.
+			long iterations = -(s.filled_iterations-filled_iterations);
+			for(j=y0;j<=y1;j++) iterations += instrument_sum(&r->iters[j*r->width+x0],x1-x0+1);
+			long pixels = (long)(x1-x0+1)*(y1-y0+1) - (s.filled-filled);
+			instrument_unit(r->instrument,args->tnumber,unit,x0,y0,x1+1,y1+1,pixels,iterations,started);
+		}
+	}
+
+	free(s.column);
+
+	render_add_stats(r,&s.stats);
+	__sync_fetch_and_add(&r->filled,s.filled);
+
+	return (void *) 1;
+}
@@ -0,0 +1,203 @@
+#include "tilecache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// The hash table starts with this many buckets, and doubles whenever it has more tiles than buckets.
+#define FIRST_BUCKETS 256
+
+struct entry {
+	struct tilecache_key key;
+	int *counts;
+	size_t bytes;
+
+	// The next entry in the same bucket.
+	struct entry *chain;
+
+	// The list of all entries, most recently used first.
+	struct entry *newer;
+	struct entry *older;
+};
+
+struct tilecache {
+	size_t budget;
+	struct entry **buckets;
+	int nbuckets;
+
+	struct entry *newest;
+	struct entry *oldest;
+
+	struct tilecache_stats stats;
+};
+
+static unsigned long hash_key( const struct tilecache_key *key )
+{
+	unsigned long scale;
+	memcpy(&scale,&key->scale,sizeof(scale));
+
+	unsigned long h = key->qx*0x9e3779b97f4a7c15UL;
+	h = (h ^ (h>>29) ^ key->qy)*0xbf58476d1ce4e5b9UL;
+	h = (h ^ (h>>31) ^ scale)*0x94d049bb133111ebUL;
+	h = (h ^ (h>>29) ^ ((unsigned long)key->max<<32 | key->size))*0x9e3779b97f4a7c15UL;
+
+	return h ^ (h>>32);
+}
+
+static int same_key( const struct tilecache_key *a, const struct tilecache_key *b )
+{
+	return a->qx==b->qx && a->qy==b->qy && a->scale==b->scale && a->max==b->max && a->size==b->size;
+}
+
+struct tilecache * tilecache_create( size_t budget )
+{
+	struct tilecache *c = malloc(sizeof(*c));
+	if(!c) return 0;
+
+	memset(c,0,sizeof(*c));
+	c->budget = budget;
+	c->nbuckets = FIRST_BUCKETS;
+	c->buckets = calloc(c->nbuckets,sizeof(struct entry *));
+	if(!c->buckets) {
+		free(c);
+		return 0;
+	}
+
+	return c;
+}
+
+void tilecache_delete( struct tilecache *c )
+{
+	struct entry *e, *next;
+
+	for(e=c->newest;e;e=next) {
+		next = e->older;
+		free(e->counts);
+		free(e);
+	}
+
+	free(c->buckets);
+	free(c);
+}
+
+static struct entry ** find( struct tilecache *c, const struct tilecache_key *key )
+{
+	struct entry **link = &c->buckets[hash_key(key) & (c->nbuckets-1)];
+
+	while(*link && !same_key(&(*link)->key,key)) link = &(*link)->chain;
+
+	return link;
+}
+
+static void unlink_lru( struct tilecache *c, struct entry *e )
+{
+	if(e->newer) e->newer->older = e->older; else c->newest = e->older;
+	if(e->older) e->older->newer = e->newer; else c->oldest = e->newer;
+}
+
+static void push_newest( struct tilecache *c, struct entry *e )
+{
+	e->newer = 0;
+	e->older = c->newest;
+	if(c->newest) c->newest->newer = e; else c->oldest = e;
+	c->newest = e;
+}
+
+/* Throw out the least recently used tile. */
+
+static void evict( struct tilecache *c )
+{
+	struct entry *e = c->oldest;
+	struct entry **link = find(c,&e->key);
+
+	*link = e->chain;
+	unlink_lru(c,e);
+
+	c->stats.tiles--;
+	c->stats.bytes -= e->bytes;
+	c->stats.evictions++;
+
+	free(e->counts);
+	free(e);
+}
+
+/* Double the buckets, so that chains stay short. If there's no memory for it, they just get longer. */
+
+static void grow( struct tilecache *c )
+{
+	int n = c->nbuckets*2;
+	struct entry **buckets = calloc(n,sizeof(struct entry *));
+	struct entry *e;
+
+	if(!buckets) return;
+
+	for(e=c->newest;e;e=e->older) {
+		struct entry **link = &buckets[hash_key(&e->key) & (n-1)];
+		e->chain = *link;
+		*link = e;
+	}
+
+	free(c->buckets);
+	c->buckets = buckets;
+	c->nbuckets = n;
+}
+
+int tilecache_get( struct tilecache *c, const struct tilecache_key *key, int *counts )
+{
+	struct entry *e = *find(c,key);
+
+	if(!e) {
+		c->stats.misses++;
+		return 0;
+	}
+
+	unlink_lru(c,e);
+	push_newest(c,e);
+
+	memcpy(counts,e->counts,e->bytes - sizeof(*e));
+	c->stats.hits++;
+
+	return 1;
+}
+
+int tilecache_put( struct tilecache *c, const struct tilecache_key *key, const int *counts )
+{
+	// Each tile is charged for its entry as well as its counts.
+	size_t bytes = sizeof(struct entry) + (size_t)key->size*key->size*sizeof(int);
+
+	if(bytes>c->budget) return 0;
+
+	// Two requests for the same tile may both have missed, and both rendered it.
+	if(*find(c,key)) return 1;
+
+	while(c->oldest && c->stats.bytes+bytes>c->budget) evict(c);
+
+	struct entry *e = malloc(sizeof(*e));
+	if(!e) return 0;
+
+	e->counts = malloc(bytes - sizeof(*e));
+	if(!e->counts) {
+		free(e);
+		return 0;
+	}
+
+	e->key = *key;
+	e->bytes = bytes;
+	memcpy(e->counts,counts,bytes - sizeof(*e));
+
+	if(c->stats.tiles>=c->nbuckets) grow(c);
+
+	struct entry **link = &c->buckets[hash_key(key) & (c->nbuckets-1)];
+	e->chain = *link;
+	*link = e;
+	push_newest(c,e);
+
+	c->stats.tiles++;
+	c->stats.bytes += bytes;
+
+	return 1;
+}
+
+void tilecache_stats( struct tilecache *c, struct tilecache_stats *stats )
+{
+	*stats = c->stats;
+}
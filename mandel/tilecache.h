@@ -0,0 +1,43 @@
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include <stddef.h>
+
+/*
+A cache of the iteration counts of rendered tiles, for the render server.
+It holds as many tiles as fit in its budget of bytes, and when a new tile
+doesn't fit, throws out the ones that were used least recently.
+
+A tile is known by its key, which the server makes from the view with the
+center rounded to the nearest pixel, so that any request for the same pixels
+finds it. The cache does no locking of its own.
+*/
+
+struct tilecache_key {
+	long qx;
+	long qy;
+	double scale;
+	int max;
+	int size;
+};
+
+struct tilecache_stats {
+	long hits;
+	long misses;
+	long evictions;
+	long tiles;
+	size_t bytes;
+};
+
+struct tilecache * tilecache_create( size_t budget );
+void               tilecache_delete( struct tilecache *c );
+
+/* If the tile is in the cache, copy its size*size counts into counts, mark it used, and return 1. */
+int                tilecache_get( struct tilecache *c, const struct tilecache_key *key, int *counts );
+
+/* Add a copy of a tile's counts, making room for it. Returns 0 if it can't be cached. */
+int                tilecache_put( struct tilecache *c, const struct tilecache_key *key, const int *counts );
+
+void               tilecache_stats( struct tilecache *c, struct tilecache_stats *stats );
+
+#endif
@@ -0,0 +1,252 @@
+#include "tilequeue.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TILEQUEUE_MAGIC "MANDTQ02"
+
+// Keep each part of the shared memory on its own cache lines.
+static size_t round_up( size_t n )
+{
+	return (n+63) & ~(size_t)63;
+}
+
+/*
+Work out where each part of the queue is, and return how big the whole thing is.
+If q is null, only the size is wanted.
+*/
+
+static size_t layout( struct tilequeue *q, char *base, int width, int height, int frames, int bands )
+{
+	size_t scales = round_up(sizeof(struct tilequeue_header));
+	size_t tiles = scales + round_up(frames*sizeof(double));
+	size_t saves = tiles + round_up((size_t)frames*bands*sizeof(int));
+	size_t counts = saves + round_up(frames*sizeof(int));
+
+	if(q) {
+		q->header = (struct tilequeue_header *) base;
+		q->scales = (double *) (base + scales);
+		q->tiles = (int *) (base + tiles);
+		q->saves = (int *) (base + saves);
+		q->counts = (int *) (base + counts);
+	}
+
+	return counts + (size_t)frames*width*height*sizeof(int);
+}
+
+struct tilequeue * tilequeue_create( const char *name, int width, int height, int max, int frames, int band_rows, const char *xcenter, const char *ycenter, const double *scales, const char *outfile )
+{
+	struct tilequeue *q;
+	int bands = (height+band_rows-1)/band_rows;
+	size_t size = layout(0,0,width,height,frames,bands);
+
+	if(strlen(outfile)>=sizeof(q->header->outfile) || strlen(xcenter)>=sizeof(q->header->xcenter) || strlen(ycenter)>=sizeof(q->header->ycenter)) {
+		errno = ENAMETOOLONG;
+		return 0;
+	}
+
+	q = malloc(sizeof(*q));
+	if(!q) return 0;
+
+	int fd = shm_open(name,O_RDWR|O_CREAT|O_EXCL,0600);
+	if(fd<0) {
+		free(q);
+		return 0;
+	}
+
+	// The new memory is all zeros, so every tile and frame starts out free.
+	char *base = MAP_FAILED;
+	if(ftruncate(fd,size)==0) {
+		base = mmap(0,size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	}
+
+	int saved_errno = errno;
+	close(fd);
+
+	if(base==MAP_FAILED) {
+		shm_unlink(name);
+		free(q);
+		errno = saved_errno;
+		return 0;
+	}
+
+	layout(q,base,width,height,frames,bands);
+
+	struct tilequeue_header *h = q->header;
+	memcpy(h->magic,TILEQUEUE_MAGIC,8);
+	h->size = size;
+	h->width = width;
+	h->height = height;
+	h->max = max;
+	h->frames = frames;
+	h->band_rows = band_rows;
+	h->bands = bands;
+	strcpy(h->xcenter,xcenter);
+	strcpy(h->ycenter,ycenter);
+	strcpy(h->outfile,outfile);
+	h->next = 0;
+	memcpy(q->scales,scales,frames*sizeof(double));
+
+	return q;
+}
+
+struct tilequeue * tilequeue_open( const char *name )
+{
+	struct tilequeue *q;
+	struct tilequeue_header header;
+
+	int fd = shm_open(name,O_RDWR,0);
+	if(fd<0) return 0;
+
+	if(pread(fd,&header,sizeof(header),0)!=sizeof(header) || memcmp(header.magic,TILEQUEUE_MAGIC,8)) {
+		close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	char *base = mmap(0,header.size,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	int saved_errno = errno;
+	close(fd);
+
+	if(base==MAP_FAILED) {
+		errno = saved_errno;
+		return 0;
+	}
+
+	q = malloc(sizeof(*q));
+	if(!q) {
+		munmap(base,header.size);
+		return 0;
+	}
+
+	layout(q,base,header.width,header.height,header.frames,header.bands);
+
+	return q;
+}
+
+void tilequeue_close( struct tilequeue *q )
+{
+	munmap(q->header,q->header->size);
+	free(q);
+}
+
+int tilequeue_unlink( const char *name )
+{
+	return shm_unlink(name)==0;
+}
+
+/* Return true if every tile of a frame is done. */
+
+static int frame_complete( struct tilequeue *q, int frame )
+{
+	int *tiles = &q->tiles[frame*q->header->bands];
+	int b;
+
+	for(b=0;b<q->header->bands;b++) {
+		if(tiles[b]!=TILE_DONE) return 0;
+	}
+
+	return 1;
+}
+
+int tilequeue_claim( struct tilequeue *q, pid_t pid, int *frame, int *band )
+{
+	struct tilequeue_header *h = q->header;
+	int total = h->frames*h->bands;
+	int f, t;
+
+	// Finished frames first, so they are written out as soon as possible.
+	for(f=0;f<h->frames;f++) {
+		if(q->saves[f]==TILE_FREE && frame_complete(q,f) && __sync_bool_compare_and_swap(&q->saves[f],TILE_FREE,pid)) {
+			*frame = f;
+			return CLAIM_SAVE;
+		}
+	}
+
+	// Then the tiles in order, which nobody else can have taken yet.
+	while((t = __sync_fetch_and_add(&h->next,1)) < total) {
+		if(__sync_bool_compare_and_swap(&q->tiles[t],TILE_FREE,pid)) {
+			*frame = t / h->bands;
+			*band = t % h->bands;
+			return CLAIM_TILE;
+		}
+	}
+
+	// Then any tiles given back by workers that died.
+	for(t=0;t<total;t++) {
+		if(q->tiles[t]==TILE_FREE && __sync_bool_compare_and_swap(&q->tiles[t],TILE_FREE,pid)) {
+			*frame = t / h->bands;
+			*band = t % h->bands;
+			return CLAIM_TILE;
+		}
+	}
+
+	return CLAIM_NONE;
+}
+
+void tilequeue_done( struct tilequeue *q, int frame, int band )
+{
+	// The counts must be in place before anyone can see that the tile is done.
+	__sync_synchronize();
+	q->tiles[frame*q->header->bands+band] = TILE_DONE;
+}
+
+void tilequeue_saved( struct tilequeue *q, int frame )
+{
+	__sync_synchronize();
+	q->saves[frame] = TILE_DONE;
+}
+
+int * tilequeue_counts( struct tilequeue *q, int frame )
+{
+	return &q->counts[(size_t)frame*q->header->width*q->header->height];
+}
+
+int tilequeue_reclaim( struct tilequeue *q, pid_t pid )
+{
+	struct tilequeue_header *h = q->header;
+	int total = h->frames*h->bands;
+	int i, n = 0;
+
+	for(i=0;i<total;i++) {
+		if(__sync_bool_compare_and_swap(&q->tiles[i],pid,TILE_FREE)) n++;
+	}
+
+	for(i=0;i<h->frames;i++) {
+		if(__sync_bool_compare_and_swap(&q->saves[i],pid,TILE_FREE)) n++;
+	}
+
+	return n;
+}
+
+int tilequeue_pending( struct tilequeue *q )
+{
+	struct tilequeue_header *h = q->header;
+	int i;
+
+	for(i=0;i<h->frames*h->bands;i++) {
+		if(q->tiles[i]==TILE_FREE) return 1;
+	}
+
+	for(i=0;i<h->frames;i++) {
+		if(q->saves[i]==TILE_FREE && frame_complete(q,i)) return 1;
+	}
+
+	return 0;
+}
+
+int tilequeue_finished( struct tilequeue *q )
+{
+	int i;
+
+	for(i=0;i<q->header->frames;i++) {
+		if(q->saves[i]!=TILE_DONE) return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,96 @@
+#ifndef TILEQUEUE_H
+#define TILEQUEUE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+A queue of (frame, tile) work items in POSIX shared memory, so that separate
+processes can share the frames of a movie down to the last tile.
+
+mandelmovie creates the queue, and every worker (mandel -Q) opens it by name.
+A tile is a band of rows of one frame. Workers claim tiles with an atomic
+compare and swap of the tile's owner, write the counts straight into the
+shared frame, and mark the tile done. Once every tile of a frame is done,
+one worker claims the frame in the same way, colors it and saves it.
+
+An item's owner is the pid of the worker that claimed it, so if a worker
+dies, the parent gives everything it held back to the queue with
+tilequeue_reclaim, to be done again by someone else.
+*/
+
+// The owner of an item nobody has claimed yet, and of one that is finished.
+#define TILE_FREE  0
+#define TILE_DONE -1
+
+// What tilequeue_claim handed out.
+#define CLAIM_NONE 0
+#define CLAIM_TILE 1
+#define CLAIM_SAVE 2
+
+// The part of the queue that lives at the start of the shared memory.
+struct tilequeue_header {
+	char magic[8];
+	size_t size;
+	int width;
+	int height;
+	int max;
+	int frames;
+	int band_rows;
+	int bands;
+	char xcenter[256]; //the center as decimal strings, so that the workers get all of its digits
+	char ycenter[256];
+	char outfile[1024];
+
+	// The next tile that has never been handed out.
+	int next;
+};
+
+// One process's view of the queue. The pointers are into the shared memory.
+struct tilequeue {
+	struct tilequeue_header *header;
+	double *scales;
+	int *tiles;
+	int *saves;
+	int *counts;
+};
+
+/*
+Create a queue named "name" (such as "/mandelmovie.123") for "frames" frames
+of width x height points, split into bands of band_rows rows.
+Frame f (from 0) is centered on xcenter,ycenter (decimal strings) with scale scales[f], and is
+saved to outfile with %d replaced by f+1. Returns 0 and sets errno on failure.
+*/
+struct tilequeue * tilequeue_create( const char *name, int width, int height, int max, int frames, int band_rows, const char *xcenter, const char *ycenter, const double *scales, const char *outfile );
+
+/* Open a queue made by tilequeue_create. Returns 0 and sets errno on failure. */
+struct tilequeue * tilequeue_open( const char *name );
+
+/* Unmap the queue. The shared memory lasts until tilequeue_unlink. */
+void               tilequeue_close( struct tilequeue *q );
+int                tilequeue_unlink( const char *name );
+
+/*
+Claim the next item of work for process "pid", setting *frame and *band.
+A frame that is ready to be saved comes before any more tiles.
+Returns CLAIM_TILE, CLAIM_SAVE (with *band unset), or CLAIM_NONE if there's nothing left to claim.
+*/
+int                tilequeue_claim( struct tilequeue *q, pid_t pid, int *frame, int *band );
+
+/* Mark a tile computed, or a frame saved. */
+void               tilequeue_done( struct tilequeue *q, int frame, int band );
+void               tilequeue_saved( struct tilequeue *q, int frame );
+
+/* The counts of a frame, row by row. */
+int *              tilequeue_counts( struct tilequeue *q, int frame );
+
+/* Give back every item held by pid, which has died. Returns the number of items. */
+int                tilequeue_reclaim( struct tilequeue *q, pid_t pid );
+
+/* Return true if some item could be claimed right now. */
+int                tilequeue_pending( struct tilequeue *q );
+
+/* Return true if every frame has been saved. */
+int                tilequeue_finished( struct tilequeue *q );
+
+#endif
@@ -0,0 +1,96 @@
+#include "tileworker.h"
+#include "tilequeue.h"
+#include "bitmap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+static double elapsed( struct timeval *start )
+{
+	struct timeval now;
+	gettimeofday(&now,0);
+	return (now.tv_sec-start->tv_sec) + (now.tv_usec-start->tv_usec)/1000000.0;
+}
+
+/* Color the counts of a finished frame and save it. */
+
+static int save_frame( struct render *r, struct bitmap *bm, struct tilequeue *q, palette_t palette, int frame )
+{
+	struct tilequeue_header *h = q->header;
+	char filename[4096];
+
+	if(!palette_apply_bitmap(palette,tilequeue_counts(q,frame),0,h->width*h->height,h->max,bm,render_pool(r))) {
+		fprintf(stderr,"mandel: couldn't color frame %d\n",frame+1);
+		return 0;
+	}
+
+	snprintf(filename,sizeof(filename),h->outfile,frame+1);
+
+	if(!bitmap_save(bm,filename)) {
+		fprintf(stderr,"mandel: couldn't write to %s: %s\n",filename,strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+int tileworker_run( struct render *r, struct bitmap *bm, struct tilequeue *q, engine_t engine, palette_t palette )
+{
+	struct tilequeue_header *h = q->header;
+	struct timeval start;
+	pid_t me = getpid();
+	int *own = r->iters;
+	int band_rows = r->height;
+	int tiles = 0, saved = 0;
+	int frame, band, what;
+	int ok = 1;
+	double x, xlo, y, ylo;
+
+	// Every band needs the whole center, low parts included, for the precisions finer than double.
+	if(!render_parse_center(h->xcenter,&x,&xlo) || !render_parse_center(h->ycenter,&y,&ylo)) {
+		fprintf(stderr,"mandel: couldn't use %s,%s as a center point\n",h->xcenter,h->ycenter);
+		return 0;
+	}
+
+	gettimeofday(&start,0);
+
+	while((what = tilequeue_claim(q,me,&frame,&band))!=CLAIM_NONE) {
+		if(what==CLAIM_SAVE) {
+			if(!save_frame(r,bm,q,palette,frame)) {
+				ok = 0;
+				break;
+			}
+			tilequeue_saved(q,frame);
+			saved++;
+			continue;
+		}
+
+		int first = band*band_rows;
+		int rows = h->height-first < band_rows ? h->height-first : band_rows;
+		double scale = q->scales[frame];
+
+		// The band is computed right into its place in the shared frame.
+		r->iters = tilequeue_counts(q,frame) + (size_t)first*h->width;
+		r->height = rows;
+		render_set_view_parts(r,x,xlo,y,ylo,scale,h->max);
+		render_set_rows(r,y,ylo,scale,first,h->height);
+
+		if(!render_run(r,engine)) {
+			ok = 0;
+			break;
+		}
+
+		tilequeue_done(q,frame,band);
+		tiles++;
+	}
+
+	r->iters = own;
+	r->height = band_rows;
+
+	printf("mandel: worker %d computed %d tiles and saved %d frames in %.3fs\n",(int)me,tiles,saved,elapsed(&start));
+
+	return ok;
+}
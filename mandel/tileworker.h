@@ -0,0 +1,19 @@
+#ifndef TILEWORKER_H
+#define TILEWORKER_H
+
+#include "render.h"
+#include "palette.h"
+
+struct bitmap;
+struct tilequeue;
+
+/*
+A worker of a multi-process movie: keep claiming items from the shared queue
+(see tilequeue.h) until there are none left. A tile is computed by the render's
+threads straight into the shared frame; a finished frame is colored and saved.
+The render passed in is one band of the queue high, and the bitmap a whole frame.
+Returns 0 on failure, leaving whatever it held for the parent to reclaim.
+*/
+int tileworker_run( struct render *r, struct bitmap *bm, struct tilequeue *q, engine_t engine, palette_t palette );
+
+#endif
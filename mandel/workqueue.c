@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "workqueue.h"
+
+#define CACHE_LINE 64
+
+/*
+The range of units still owned by one thread.
+Each range sits on its own cache line so that threads
+taking units from their own range don't slow each other down.
+*/
+
+struct range {
+	pthread_mutex_t lock;
+	int lo;
+	int hi;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct workqueue {
+	schedule_t mode;
+	int nunits;
+	int nthreads;
+	struct range *ranges;
+	int next __attribute__((aligned(CACHE_LINE)));
+};
+
+struct workqueue * workqueue_create( int nunits, int nthreads, schedule_t mode )
+{
+	struct workqueue *q;
+	int i;
+
+	if(nthreads<1) nthreads = 1;
+
+	if(posix_memalign((void**)&q,CACHE_LINE,sizeof(*q))) return 0;
+
+	if(posix_memalign((void**)&q->ranges,CACHE_LINE,nthreads*sizeof(struct range))) {
+		free(q);
+		return 0;
+	}
+
+	q->mode = mode;
+	q->nunits = nunits;
+	q->nthreads = nthreads;
+
+	for(i=0;i<nthreads;i++) {
+		pthread_mutex_init(&q->ranges[i].lock,0);
+	}
+
+	workqueue_reset(q);
+
+	return q;
+}
+
+void workqueue_delete( struct workqueue *q )
+{
+	int i;
+	for(i=0;i<q->nthreads;i++) {
+		pthread_mutex_destroy(&q->ranges[i].lock);
+	}
+	free(q->ranges);
+	free(q);
+}
+
+/*
+Put every unit back in the queue.
+Must not be called while threads are still taking units.
+*/
+
+void workqueue_reset( struct workqueue *q )
+{
+	int i;
+
+	q->next = 0;
+
+	// Thread i initially owns the units [i*n/t, (i+1)*n/t).
+	for(i=0;i<q->nthreads;i++) {
+		q->ranges[i].lo = (long)q->nunits*i/q->nthreads;
+		q->ranges[i].hi = (long)q->nunits*(i+1)/q->nthreads;
+	}
+}
+
+int workqueue_nunits( struct workqueue *q )
+{
+	return q->nunits;
+}
+
+static int take_own( struct workqueue *q, int thread )
+{
+	struct range *r = &q->ranges[thread];
+	int unit = -1;
+
+	pthread_mutex_lock(&r->lock);
+	if(r->lo < r->hi) unit = r->lo++;
+	pthread_mutex_unlock(&r->lock);
+
+	return unit;
+}
+
+/*
+Move the top half of the fullest range into our own range.
+Returns zero if every range is empty.
+*/
+
+static int steal( struct workqueue *q, int thread )
+{
+	for(;;) {
+		int i, victim = -1, most = 0;
+
+		// The sizes are read without locking, so they are only a hint.
+		for(i=0;i<q->nthreads;i++) {
+			int left = q->ranges[i].hi - q->ranges[i].lo;
+			if(i!=thread && left>most) {
+				most = left;
+				victim = i;
+			}
+		}
+
+		if(victim<0) return 0;
+
+		struct range *v = &q->ranges[victim];
+		struct range *r = &q->ranges[thread];
+
+		pthread_mutex_lock(&v->lock);
+		int left = v->hi - v->lo;
+		if(left<=0) {
+			// Someone else got there first, look again.
+			pthread_mutex_unlock(&v->lock);
+			continue;
+		}
+		int count = (left+1)/2;
+		int hi = v->hi;
+		v->hi -= count;
+		pthread_mutex_unlock(&v->lock);
+
+		pthread_mutex_lock(&r->lock);
+		r->lo = hi - count;
+		r->hi = hi;
+		pthread_mutex_unlock(&r->lock);
+
+		return 1;
+	}
+}
+
+int workqueue_next( struct workqueue *q, int thread )
+{
+	int unit;
+
+	switch(q->mode) {
+		case SCHEDULE_DYNAMIC:
+			unit = __sync_fetch_and_add(&q->next,1);
+			return unit<q->nunits ? unit : -1;
+
+		case SCHEDULE_STEAL:
+			while((unit = take_own(q,thread))<0) {
+				if(!steal(q,thread)) return -1;
+			}
+			return unit;
+
+		case SCHEDULE_STATIC:
+		default:
+			return take_own(q,thread);
+	}
+}
+
+int schedule_from_name( const char *name, schedule_t *mode )
+{
+	if(!strcmp(name,"static")) {
+		*mode = SCHEDULE_STATIC;
+	} else if(!strcmp(name,"dynamic")) {
+		*mode = SCHEDULE_DYNAMIC;
+	} else if(!strcmp(name,"steal")) {
+		*mode = SCHEDULE_STEAL;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * schedule_name( schedule_t mode )
+{
+	switch(mode) {
+		case SCHEDULE_STATIC:  return "static";
+		case SCHEDULE_DYNAMIC: return "dynamic";
+		case SCHEDULE_STEAL:   return "steal";
+	}
+	return "unknown";
+}
@@ -0,0 +1,33 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+/*
+A work queue hands out the integers 0..nunits-1 to a fixed set of threads.
+What a unit means (a chunk of rows, a tile, ...) is up to the caller.
+
+SCHEDULE_STATIC  gives each thread one contiguous block of units up front.
+SCHEDULE_DYNAMIC has every thread pull the next unit from a shared counter.
+SCHEDULE_STEAL   starts like static, but a thread that runs out of units
+                 steals half of the remaining units from the busiest thread.
+*/
+
+typedef enum {
+	SCHEDULE_STATIC,
+	SCHEDULE_DYNAMIC,
+	SCHEDULE_STEAL
+} schedule_t;
+
+struct workqueue * workqueue_create( int nunits, int nthreads, schedule_t mode );
+void               workqueue_delete( struct workqueue *q );
+void               workqueue_reset( struct workqueue *q );
+
+/* Return the next unit for thread number "thread" (0-based), or -1 when no work is left. */
+int                workqueue_next( struct workqueue *q, int thread );
+
+int                workqueue_nunits( struct workqueue *q );
+
+/* Convert between a schedule and its name. Returns 0 if the name is unknown. */
+int                schedule_from_name( const char *name, schedule_t *mode );
+const char *       schedule_name( schedule_t mode );
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ARC, after Megiddo and Modha, "ARC: A Self-Tuning, Low Overhead Replacement
+Cache", FAST 2003.
+
+The resident pages are split between T1, seen once since they were loaded,
+and T2, seen more than once, each in LRU order. B1 and B2 remember the pages
+last evicted from each. A fault on a page remembered in B1 means T1 should
+have been bigger, and one in B2 means T2 should, and the target size p of T1
+moves towards whichever it was. Uses of resident pages are sampled (see
+policy_sample), and move them to the most recent end of T2.
+*/
+
+#include "policy.h"
+#include "pagelist.h"
+
+#include <stdlib.h>
+
+struct arc {
+	struct policy_context *context;
+	int *frame; //of each page, -1 if it isn't resident
+	struct pagelist *t1;
+	struct pagelist *t2;
+	struct pagelist *b1;
+	struct pagelist *b2;
+	int p;
+	int loads;
+	long ghost_hits;
+};
+
+static void arc_free( void *state );
+
+static void * arc_init( struct policy_context *context )
+{
+	int i;
+	struct arc *a = calloc(1,sizeof(*a));
+	if(!a) return 0;
+
+	a->context = context;
+	a->frame = malloc(sizeof(int)*context->npages);
+	a->t1 = pagelist_create(context->npages);
+	a->t2 = pagelist_create(context->npages);
+	a->b1 = pagelist_create(context->npages);
+	a->b2 = pagelist_create(context->npages);
+
+	if(!a->frame || !a->t1 || !a->t2 || !a->b1 || !a->b2) {
+		arc_free(a);
+		return 0;
+	}
+
+	for(i=0;i<context->npages;i++) a->frame[i] = -1;
+	return a;
+}
+
+static void arc_on_fault( void *state, int page, int frame )
+{
+	struct arc *a = state;
+
+	a->frame[page] = frame;
+
+	if(pagelist_contains(a->b1,page)) {
+		pagelist_remove(a->b1,page);
+		pagelist_push(a->t2,page);
+	} else if(pagelist_contains(a->b2,page)) {
+		pagelist_remove(a->b2,page);
+		pagelist_push(a->t2,page);
+	} else {
+		pagelist_push(a->t1,page);
+	}
+
+	policy_sample(a->context,&a->loads);
+}
+
+static void arc_on_access( void *state, int page, int frame, int write )
+{
+	struct arc *a = state;
+
+	if(pagelist_contains(a->t1,page)) {
+		pagelist_remove(a->t1,page);
+		pagelist_push(a->t2,page);
+	} else if(pagelist_contains(a->t2,page)) {
+		pagelist_touch(a->t2,page);
+	}
+}
+
+/* Evict the least recent page of T1 or T2, into B1 or B2, as the paper's REPLACE. */
+
+static int arc_replace( struct arc *a, int in_b2 )
+{
+	int t1 = pagelist_size(a->t1);
+	int victim;
+
+	if(t1 > 0 && ((in_b2 && t1 == a->p) || t1 > a->p || pagelist_size(a->t2) == 0)) {
+		victim = pagelist_oldest(a->t1);
+		pagelist_remove(a->t1,victim);
+		pagelist_push(a->b1,victim);
+	} else {
+		victim = pagelist_oldest(a->t2);
+		pagelist_remove(a->t2,victim);
+		pagelist_push(a->b2,victim);
+	}
+	return victim;
+}
+
+static int arc_choose_victim( void *state, int page )
+{
+	struct arc *a = state;
+	int c = a->context->nframes;
+	int b1 = pagelist_size(a->b1);
+	int b2 = pagelist_size(a->b2);
+	int victim;
+
+	if(pagelist_contains(a->b1,page)) {
+		a->p += b1 >= b2 ? 1 : b2/b1;
+		if(a->p > c) a->p = c;
+		a->ghost_hits++;
+		victim = arc_replace(a,0);
+	} else if(pagelist_contains(a->b2,page)) {
+		a->p -= b2 >= b1 ? 1 : b1/b2;
+		if(a->p < 0) a->p = 0;
+		a->ghost_hits++;
+		victim = arc_replace(a,1);
+	} else if(pagelist_size(a->t1) + b1 == c) {
+		if(pagelist_size(a->t1) < c) {
+			pagelist_remove(a->b1,pagelist_oldest(a->b1));
+			victim = arc_replace(a,0);
+		} else {
+			//T1 is the whole cache, so its oldest page is dropped without being remembered
+			victim = pagelist_oldest(a->t1);
+			pagelist_remove(a->t1,victim);
+		}
+	} else {
+		if(pagelist_size(a->t1) + pagelist_size(a->t2) + b1 + b2 >= 2*c) {
+			pagelist_remove(a->b2,pagelist_oldest(a->b2));
+		}
+		victim = arc_replace(a,0);
+	}
+
+	int frame = a->frame[victim];
+	a->frame[victim] = -1;
+	return frame;
+}
+
+static void arc_stats( void *state, FILE *out )
+{
+	struct arc *a = state;
+	fprintf(out,"arc: target %d of %d frames for T1, %ld ghost hits, T1 %d, T2 %d, B1 %d, B2 %d\n",
+		a->p,a->context->nframes,a->ghost_hits,
+		pagelist_size(a->t1),pagelist_size(a->t2),pagelist_size(a->b1),pagelist_size(a->b2));
+}
+
+static void arc_free( void *state )
+{
+	struct arc *a = state;
+	free(a->frame);
+	if(a->t1) pagelist_delete(a->t1);
+	if(a->t2) pagelist_delete(a->t2);
+	if(a->b1) pagelist_delete(a->b1);
+	if(a->b2) pagelist_delete(a->b2);
+	free(a);
+}
+
+const struct policy arc_policy = {
+	"arc", "adaptive replacement, balancing recency against frequency",
+	arc_init, arc_on_fault, arc_on_access, arc_choose_victim, arc_stats, arc_free
+};
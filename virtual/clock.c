@@ -0,0 +1,155 @@
+/*
+CLOCK (second chance), and LRU approximated by sampling references.
+*/
+
+#include "policy.h"
+#include "pagelist.h"
+
+#include <stdlib.h>
+
+/*
+CLOCK sweeps a hand around the frames. A frame whose reference bit is set
+has it cleared and is passed over; the first one found clear is the victim.
+There is no hardware reference bit, so clearing it also revokes the page,
+and the bit is set again when the page next faults.
+*/
+
+struct clock {
+	struct policy_context *context;
+	char *referenced;
+	int hand;
+	long second_chances;
+};
+
+static void * clock_init( struct policy_context *context )
+{
+	struct clock *c = malloc(sizeof(*c));
+	if(!c) return 0;
+
+	c->context = context;
+	c->referenced = calloc(context->nframes,1);
+	c->hand = 0;
+	c->second_chances = 0;
+
+	if(!c->referenced) {
+		free(c);
+		return 0;
+	}
+	return c;
+}
+
+static void clock_on_fault( void *state, int page, int frame )
+{
+	struct clock *c = state;
+	c->referenced[frame] = 1;
+}
+
+static void clock_on_access( void *state, int page, int frame, int write )
+{
+	struct clock *c = state;
+	c->referenced[frame] = 1;
+}
+
+static int clock_choose_victim( void *state, int page )
+{
+	struct clock *c = state;
+	int nframes = c->context->nframes;
+
+	while(c->referenced[c->hand]) {
+		c->referenced[c->hand] = 0;
+		c->context->revoke(c->context,frame_table_page(c->context->frames,c->hand));
+		c->second_chances++;
+		c->hand = (c->hand+1) % nframes;
+	}
+
+	int frame = c->hand;
+	c->hand = (c->hand+1) % nframes;
+	return frame;
+}
+
+static void clock_stats( void *state, FILE *out )
+{
+	struct clock *c = state;
+	fprintf(out,"clock: %ld second chances\n",c->second_chances);
+}
+
+static void clock_free( void *state )
+{
+	struct clock *c = state;
+	free(c->referenced);
+	free(c);
+}
+
+const struct policy clock_policy = {
+	"clock", "second chance, sweeping a hand over the frames",
+	clock_init, clock_on_fault, clock_on_access, clock_choose_victim, clock_stats, clock_free
+};
+
+/*
+LRU keeps the frames in the order their pages were last seen used, and evicts
+the least recent. Every resident page is revoked once for each nframes loads
+(see policy_sample), so a use is seen at most once per sample, and the order
+is that of the first use after each sample.
+*/
+
+struct lru {
+	struct policy_context *context;
+	struct pagelist *recent; //of frames, least recently used first
+	int loads;
+	long references;
+};
+
+static void * lru_init( struct policy_context *context )
+{
+	struct lru *l = malloc(sizeof(*l));
+	if(!l) return 0;
+
+	l->context = context;
+	l->recent = pagelist_create(context->nframes);
+	l->loads = 0;
+	l->references = 0;
+
+	if(!l->recent) {
+		free(l);
+		return 0;
+	}
+	return l;
+}
+
+static void lru_on_fault( void *state, int page, int frame )
+{
+	struct lru *l = state;
+	pagelist_touch(l->recent,frame);
+	policy_sample(l->context,&l->loads);
+}
+
+static void lru_on_access( void *state, int page, int frame, int write )
+{
+	struct lru *l = state;
+	pagelist_touch(l->recent,frame);
+	l->references++;
+}
+
+static int lru_choose_victim( void *state, int page )
+{
+	struct lru *l = state;
+	return pagelist_oldest(l->recent);
+}
+
+static void lru_stats( void *state, FILE *out )
+{
+	struct lru *l = state;
+	fprintf(out,"lru: %ld references seen\n",l->references);
+}
+
+static void lru_free( void *state )
+{
+	struct lru *l = state;
+	pagelist_delete(l->recent);
+	free(l);
+}
+
+const struct policy lru_policy = {
+	"lru", "least recently used, by sampling references",
+	lru_init, lru_on_fault, lru_on_access, lru_choose_victim, lru_stats, lru_free
+};
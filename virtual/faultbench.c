@@ -0,0 +1,150 @@
+/*
+Benchmark for the page table backends, in page faults per second.
+
+Each backend runs the same workload: the pages are swept in order,
+reading or writing one word in each, over and over, with fewer frames
+than pages so that every touch of a page faults. The handler is a plain
+FIFO that writes dirty frames back to, and reads pages from, a disk kept
+in memory, so that the time measured is the backend's and not the disk's.
+*/
+
+#include "page_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+struct bench {
+	char *disk;
+	int *frame_page;
+	int next_frame;
+	long faults;
+};
+
+struct bench bench;
+
+void bench_fault_handler( struct page_table *pt, int page )
+{
+	int frame, bits;
+	char *physmem = page_table_get_physmem(pt);
+
+	bench.faults++;
+
+	page_table_get_entry(pt,page,&frame,&bits);
+
+	//The page is in memory, and is being written for the first time
+	if(bits&PROT_READ) {
+		page_table_set_entry(pt,page,frame,PROT_READ|PROT_WRITE);
+		return;
+	}
+
+	//Otherwise take the next frame in turn, writing back its page if it is dirty
+	frame = bench.next_frame;
+	bench.next_frame = (bench.next_frame+1) % page_table_get_nframes(pt);
+
+	int old_page = bench.frame_page[frame];
+	if(old_page>=0) {
+		int old_frame, old_bits;
+		page_table_get_entry(pt,old_page,&old_frame,&old_bits);
+		if(old_bits&PROT_WRITE) memcpy(&bench.disk[old_page*PAGE_SIZE],&physmem[frame*PAGE_SIZE],PAGE_SIZE);
+		page_table_set_entry(pt,old_page,frame,0);
+	}
+
+	page_table_set_entry(pt,page,frame,PROT_READ);
+	memcpy(&physmem[frame*PAGE_SIZE],&bench.disk[page*PAGE_SIZE],PAGE_SIZE);
+	bench.frame_page[frame] = page;
+}
+
+static double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+/* Run the sweeps with one backend, and show its rate. Returns 0 if the backend couldn't be used. */
+
+static int run( page_table_backend_t backend, int npages, int nframes, int sweeps, int write, long *checksum )
+{
+	int i, j;
+
+	memset(bench.disk,0,(size_t)npages*PAGE_SIZE);
+	for(i=0;i<nframes;i++) bench.frame_page[i] = -1;
+	bench.next_frame = 0;
+	bench.faults = 0;
+
+	struct page_table *pt = page_table_create_backend(npages,nframes,bench_fault_handler,backend);
+	if(!pt) {
+		fprintf(stderr,"faultbench: couldn't create %s page table: %s\n",page_table_backend_name(backend),strerror(errno));
+		return 0;
+	}
+
+	char *virtmem = page_table_get_virtmem(pt);
+	long sum = 0;
+
+	double start = now();
+
+	for(j=0;j<sweeps;j++) {
+		for(i=0;i<npages;i++) {
+			if(write) {
+				virtmem[i*PAGE_SIZE+j%PAGE_SIZE] += 1;
+			} else {
+				sum += virtmem[i*PAGE_SIZE+j%PAGE_SIZE];
+			}
+		}
+	}
+
+	double elapsed = now()-start;
+
+	// Read everything back, to check that no write was lost along the way.
+	for(i=0;i<npages*PAGE_SIZE;i+=64) sum += virtmem[i];
+
+	page_table_delete(pt);
+
+	printf("%s,%d,%d,%s,%ld,%.3f,%.0f\n",page_table_backend_name(backend),npages,nframes,write ? "write" : "read",bench.faults,elapsed,bench.faults/elapsed);
+
+	*checksum = sum;
+	return 1;
+}
+
+int main( int argc, char *argv[] )
+{
+	if(argc!=5) {
+		printf("use: faultbench <npages> <nframes> <sweeps> <read|write>\n");
+		return 1;
+	}
+
+	int npages = atoi(argv[1]);
+	int nframes = atoi(argv[2]);
+	int sweeps = atoi(argv[3]);
+	int write = !strcmp(argv[4],"write");
+
+	if(npages<=0 || nframes<=0 || nframes>=npages || sweeps<=0) {
+		printf("error: must have at least 1 frame and sweep, and fewer frames than pages\n");
+		return 1;
+	}
+
+	bench.disk = malloc((size_t)npages*PAGE_SIZE);
+	bench.frame_page = malloc(sizeof(int)*nframes);
+	if(!bench.disk || !bench.frame_page) {
+		fprintf(stderr,"faultbench: out of memory\n");
+		return 1;
+	}
+
+	long signal_sum = 0, userfaultfd_sum = 0;
+
+	printf("backend,npages,nframes,access,faults,seconds,faults_per_sec\n");
+
+	int ok = run(PAGE_TABLE_SIGNAL,npages,nframes,sweeps,write,&signal_sum);
+	if(run(PAGE_TABLE_USERFAULTFD,npages,nframes,sweeps,write,&userfaultfd_sum) && ok && userfaultfd_sum!=signal_sum) {
+		fprintf(stderr,"faultbench: the backends left different data in memory\n");
+		return 1;
+	}
+
+	free(bench.disk);
+	free(bench.frame_page);
+
+	return 0;
+}
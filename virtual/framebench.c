@@ -0,0 +1,233 @@
+/*
+Benchmark of the cost of choosing a frame on each page fault, against the number of frames.
+
+The same stream of faults is run through two versions of the bookkeeping
+for each replacement policy: the frame table (see frames.h), and the scans
+over an array of frames that virtmem used before it. Each fault loads a page
+into the frame the policy picks, and some of the pages are then written,
+just as they would be in virtmem. Both versions must pick the same frames.
+Only the faults after every frame is in use are timed.
+*/
+
+#include "frames.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+	ran,
+	fifo,
+	custom
+} replacement_strategy;
+
+const char *strategy_names[] = { "rand", "fifo", "custom" };
+
+//The frames as virtmem used to keep them, with the time each was loaded
+typedef struct Frame {
+	int page_number;
+	int dirty;
+	int time;
+} Frame;
+
+Frame *frames_list;
+int nframes;
+int faults;
+
+int scan_free_frame() {
+	int i;
+	for(i=0; i < nframes; i++){
+		if(frames_list[i].page_number == -1){
+			return i;
+		}
+	}
+	return -1;
+}
+
+int scan_oldest_frame() {
+	int i;
+	int min = frames_list[0].time;
+	int frame = 0;
+	for(i=1; i < nframes; i++){
+		if(frames_list[i].time < min){
+			frame = i;
+			min = frames_list[i].time;
+		}
+	}
+	return frame;
+}
+
+int scan_oldest_clean_frame() {
+	int i;
+	int frame = -1;
+	int min = faults;
+	for(i=0; i < nframes; i++){
+		if((frames_list[i].time < min) && (!frames_list[i].dirty)){
+			frame = i;
+			min = frames_list[i].time;
+		}
+	}
+	return frame;
+}
+
+/* Pick the frame for one fault with the scans, and load the page into it. */
+
+int scan_fault( replacement_strategy replace, int page, unsigned short *seed ) {
+	int i;
+	int frame = scan_free_frame();
+
+	if(frame == -1) {
+		switch(replace) {
+			case ran:
+				frame = nrand48(seed) % nframes;
+				break;
+			case fifo:
+				frame = scan_oldest_frame();
+				break;
+			case custom:
+				frame = scan_oldest_clean_frame();
+				if(frame == -1) {
+					for(i=0; i < nframes; i++) frames_list[i].dirty = 0;
+					frame = scan_oldest_frame();
+				}
+				break;
+		}
+	}
+
+	frames_list[frame].page_number = page;
+	frames_list[frame].dirty = 0;
+	frames_list[frame].time = faults;
+	return frame;
+}
+
+/* The same with the frame table. */
+
+int table_fault( struct frame_table *ft, replacement_strategy replace, int page, unsigned short *seed ) {
+	int frame = frame_table_take_free(ft);
+
+	if(frame == -1) {
+		switch(replace) {
+			case ran:
+				frame = nrand48(seed) % nframes;
+				break;
+			case fifo:
+				frame = frame_table_oldest(ft);
+				break;
+			case custom:
+				frame = frame_table_oldest_clean(ft);
+				if(frame == -1) {
+					frame_table_clean_all(ft);
+					frame = frame_table_oldest(ft);
+				}
+				break;
+		}
+	}
+
+	frame_table_load(ft, frame, page);
+	return frame;
+}
+
+double now() {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+/*
+Run "nfaults" faults after filling every frame, with either version, into "picked".
+Writes are decided by their own random numbers, the same for both versions.
+Returns the time the faults after the fill took.
+*/
+
+double run( replacement_strategy replace, int use_table, int nfaults, int *picked ) {
+	int i;
+	unsigned short seed[3] = { 1, 2, 3 };
+	unsigned short write_seed[3] = { 4, 5, 6 };
+	struct frame_table *ft = 0;
+	double start = 0;
+
+	if(use_table) {
+		ft = frame_table_create(nframes);
+		if(!ft) {
+			fprintf(stderr,"framebench: out of memory\n");
+			exit(1);
+		}
+	} else {
+		for(i=0; i < nframes; i++){
+			frames_list[i].page_number = -1;
+			frames_list[i].dirty = 0;
+			frames_list[i].time = 0;
+		}
+	}
+
+	faults = 0;
+
+	for(i=0; i < nframes+nfaults; i++) {
+		if(i == nframes) start = now();
+
+		faults++;
+		int page = i;
+		int frame = use_table ? table_fault(ft, replace, page, seed) : scan_fault(replace, page, seed);
+
+		if(nrand48(write_seed) % 3 == 0) {
+			if(use_table) frame_table_set_dirty(ft, frame);
+			else frames_list[frame].dirty = 1;
+		}
+
+		if(i >= nframes) picked[i-nframes] = frame;
+	}
+
+	double elapsed = now()-start;
+
+	if(ft) frame_table_delete(ft);
+
+	return elapsed;
+}
+
+int main( int argc, char *argv[] )
+{
+	if(argc!=3) {
+		printf("use: framebench <most frames> <faults>\n");
+		return 1;
+	}
+
+	int most = atoi(argv[1]);
+	int nfaults = atoi(argv[2]);
+	if(most <= 0 || nfaults <= 0) {
+		printf("error: must have at least 1 frame and 1 fault\n");
+		return 1;
+	}
+
+	frames_list = malloc(sizeof(Frame)*most);
+	int *scan_picked = malloc(sizeof(int)*nfaults);
+	int *table_picked = malloc(sizeof(int)*nfaults);
+	if(!frames_list || !scan_picked || !table_picked) {
+		fprintf(stderr,"framebench: out of memory\n");
+		return 1;
+	}
+
+	printf("nframes,policy,scan_ns_per_fault,table_ns_per_fault\n");
+
+	for(nframes = 16; nframes <= most; nframes *= 4) {
+		replacement_strategy replace;
+		for(replace = ran; replace <= custom; replace++) {
+			double scan = run(replace, 0, nfaults, scan_picked);
+			double table = run(replace, 1, nfaults, table_picked);
+
+			if(memcmp(scan_picked, table_picked, sizeof(int)*nfaults)) {
+				fprintf(stderr,"framebench: %s with %d frames picked different frames\n",strategy_names[replace],nframes);
+				return 1;
+			}
+
+			printf("%d,%s,%.1f,%.1f\n",nframes,strategy_names[replace],scan*1e9/nfaults,table*1e9/nfaults);
+			fflush(stdout);
+		}
+	}
+
+	free(frames_list);
+	free(scan_picked);
+	free(table_picked);
+
+	return 0;
+}
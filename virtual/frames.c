@@ -0,0 +1,176 @@
+#include "frames.h"
+
+#include <stdlib.h>
+
+/*
+A queue of frames is a circular doubly linked list threaded through two arrays,
+with the extra entry nframes as the head, so that frames can be added at the
+back and taken out of the middle without searching.
+*/
+
+struct queue {
+	int *next;
+	int *prev;
+};
+
+struct frame_table {
+	int nframes;
+
+	// The page in each frame (-1 if free), and whether it has been written.
+	int *page;
+	char *dirty;
+
+	// The free frames, with the lowest numbered on top.
+	int *free;
+	int nfree;
+
+	// Every loaded frame in the order it was loaded, and just the clean ones in the same order.
+	struct queue order;
+	struct queue clean;
+	char *in_clean;
+};
+
+static int queue_init( struct queue *q, int nframes )
+{
+	q->next = malloc(sizeof(int)*(nframes+1));
+	q->prev = malloc(sizeof(int)*(nframes+1));
+	if(!q->next || !q->prev) return 0;
+
+	q->next[nframes] = q->prev[nframes] = nframes;
+	return 1;
+}
+
+static void queue_free( struct queue *q )
+{
+	free(q->next);
+	free(q->prev);
+}
+
+static void queue_remove( struct queue *q, int frame )
+{
+	q->next[q->prev[frame]] = q->next[frame];
+	q->prev[q->next[frame]] = q->prev[frame];
+}
+
+static void queue_append( struct queue *q, int head, int frame )
+{
+	q->prev[frame] = q->prev[head];
+	q->next[frame] = head;
+	q->next[q->prev[head]] = frame;
+	q->prev[head] = frame;
+}
+
+struct frame_table * frame_table_create( int nframes )
+{
+	int i;
+	struct frame_table *ft = calloc(1,sizeof(*ft));
+	if(!ft) return 0;
+
+	ft->nframes = nframes;
+	ft->page = malloc(sizeof(int)*nframes);
+	ft->dirty = calloc(nframes,1);
+	ft->free = malloc(sizeof(int)*nframes);
+	ft->in_clean = calloc(nframes,1);
+
+	if(!ft->page || !ft->dirty || !ft->free || !ft->in_clean || !queue_init(&ft->order,nframes) || !queue_init(&ft->clean,nframes)) {
+		frame_table_delete(ft);
+		return 0;
+	}
+
+	for(i=0;i<nframes;i++) {
+		ft->page[i] = -1;
+		ft->free[i] = nframes-1-i;
+	}
+	ft->nfree = nframes;
+
+	return ft;
+}
+
+void frame_table_delete( struct frame_table *ft )
+{
+	free(ft->page);
+	free(ft->dirty);
+	free(ft->free);
+	free(ft->in_clean);
+	queue_free(&ft->order);
+	queue_free(&ft->clean);
+	free(ft);
+}
+
+int frame_table_take_free( struct frame_table *ft )
+{
+	if(ft->nfree==0) return -1;
+	return ft->free[--ft->nfree];
+}
+
+void frame_table_load( struct frame_table *ft, int frame, int page )
+{
+	int head = ft->nframes;
+
+	if(ft->page[frame]>=0) queue_remove(&ft->order,frame);
+	queue_append(&ft->order,head,frame);
+
+	if(ft->in_clean[frame]) queue_remove(&ft->clean,frame);
+	queue_append(&ft->clean,head,frame);
+	ft->in_clean[frame] = 1;
+
+	ft->page[frame] = page;
+	ft->dirty[frame] = 0;
+}
+
+void frame_table_set_dirty( struct frame_table *ft, int frame )
+{
+	if(ft->in_clean[frame]) {
+		queue_remove(&ft->clean,frame);
+		ft->in_clean[frame] = 0;
+	}
+	ft->dirty[frame] = 1;
+}
+
+void frame_table_clean_all( struct frame_table *ft )
+{
+	int head = ft->nframes;
+	int frame;
+
+	// Every loaded frame is clean now, so the clean queue is the same as the loaded one.
+	ft->clean.next[head] = ft->clean.prev[head] = head;
+
+	for(frame=ft->order.next[head];frame!=head;frame=ft->order.next[frame]) {
+		queue_append(&ft->clean,head,frame);
+		ft->in_clean[frame] = 1;
+		ft->dirty[frame] = 0;
+	}
+}
+
+int frame_table_oldest( struct frame_table *ft )
+{
+	int frame = ft->order.next[ft->nframes];
+	return frame==ft->nframes ? -1 : frame;
+}
+
+int frame_table_newest( struct frame_table *ft )
+{
+	int frame = ft->order.prev[ft->nframes];
+	return frame==ft->nframes ? -1 : frame;
+}
+
+int frame_table_oldest_clean( struct frame_table *ft )
+{
+	int frame = ft->clean.next[ft->nframes];
+	return frame==ft->nframes ? -1 : frame;
+}
+
+int frame_table_page( struct frame_table *ft, int frame )
+{
+	return ft->page[frame];
+}
+
+int frame_table_dirty( struct frame_table *ft, int frame )
+{
+	return ft->dirty[frame];
+}
+
+int frame_table_nframes( struct frame_table *ft )
+{
+	return ft->nframes;
+}
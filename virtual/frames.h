@@ -0,0 +1,55 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+/*
+The frames of physical memory, and what the replacement policies need to know about them,
+kept so that every question a policy asks is answered in constant time:
+
+- The free frames are a stack, handed out lowest numbered first.
+- The loaded frames are a queue in the order they were loaded, oldest first.
+- The clean frames are a second queue in the same order, so that the oldest
+  clean frame is at its head, and a frame leaves it as soon as it is written.
+*/
+
+struct frame_table;
+
+/* Create a table of "nframes" frames, all of them free. Returns 0 if out of memory. */
+
+struct frame_table * frame_table_create( int nframes );
+
+/* Delete a frame table. */
+
+void frame_table_delete( struct frame_table *ft );
+
+/* Take the lowest numbered free frame, or return -1 if every frame is in use. */
+
+int frame_table_take_free( struct frame_table *ft );
+
+/* Record that "frame" now holds "page", freshly loaded and clean, making it the newest frame. */
+
+void frame_table_load( struct frame_table *ft, int frame, int page );
+
+/* Record that the page in "frame" has been written. */
+
+void frame_table_set_dirty( struct frame_table *ft, int frame );
+
+/* Record that every frame has been written back, keeping the order they were loaded in. */
+
+void frame_table_clean_all( struct frame_table *ft );
+
+/* Return the frame loaded longest ago, the one loaded last, or the clean one loaded longest ago, or -1 if there is none. */
+
+int frame_table_oldest( struct frame_table *ft );
+int frame_table_newest( struct frame_table *ft );
+int frame_table_oldest_clean( struct frame_table *ft );
+
+/* Return the page in a frame (-1 if it is free), and whether it is dirty. */
+
+int frame_table_page( struct frame_table *ft, int frame );
+int frame_table_dirty( struct frame_table *ft, int frame );
+
+/* Return the total number of frames. */
+
+int frame_table_nframes( struct frame_table *ft );
+
+#endif
@@ -0,0 +1,182 @@
+/*
+LIRS, after Jiang and Zhang, "LIRS: An Efficient Low Inter-reference Recency
+Set Replacement Policy to Improve Buffer Cache Performance", SIGMETRICS 2002.
+
+Pages with a short distance between their last two uses are LIR, and always
+resident; they take all but one percent of the frames. The rest are HIR, and
+the resident ones wait in the FIFO Q to be evicted. The stack S holds pages in
+the order they were last used, LIR and HIR, resident or not, with a LIR page
+always at the bottom. A HIR page used again while it is still in S has a
+shorter distance than the LIR page at the bottom, and the two swap status.
+Uses of resident pages are sampled (see policy_sample). S remembers at most
+as many evicted pages as there are frames.
+*/
+
+#include "policy.h"
+#include "pagelist.h"
+
+#include <stdlib.h>
+
+struct lirs {
+	struct policy_context *context;
+	int *frame; //of each page, -1 if it isn't resident
+	char *lir;
+	struct pagelist *s;
+	struct pagelist *q;
+	struct pagelist *evicted; //the non-resident pages in S, in the order they were evicted
+	int nlir;
+	int llirs;
+	int loads;
+	long promotions;
+};
+
+static void lirs_free( void *state );
+
+static void * lirs_init( struct policy_context *context )
+{
+	int i;
+	struct lirs *l = calloc(1,sizeof(*l));
+	if(!l) return 0;
+
+	l->context = context;
+	l->frame = malloc(sizeof(int)*context->npages);
+	l->lir = calloc(context->npages,1);
+	l->s = pagelist_create(context->npages);
+	l->q = pagelist_create(context->npages);
+	l->evicted = pagelist_create(context->npages);
+
+	int lhirs = context->nframes/100 > 0 ? context->nframes/100 : 1;
+	l->llirs = context->nframes - lhirs;
+
+	if(!l->frame || !l->lir || !l->s || !l->q || !l->evicted) {
+		lirs_free(l);
+		return 0;
+	}
+
+	for(i=0;i<context->npages;i++) l->frame[i] = -1;
+	return l;
+}
+
+/* Take HIR pages off the bottom of S until a LIR page is there. */
+
+static void lirs_prune( struct lirs *l )
+{
+	int page;
+
+	while((page = pagelist_oldest(l->s)) >= 0 && !l->lir[page]) {
+		pagelist_remove(l->s,page);
+		if(l->frame[page] < 0) pagelist_remove(l->evicted,page);
+	}
+}
+
+/* Make the LIR page at the bottom of S a resident HIR page. */
+
+static void lirs_demote( struct lirs *l )
+{
+	lirs_prune(l);
+
+	int page = pagelist_oldest(l->s);
+	if(page < 0) return;
+
+	l->lir[page] = 0;
+	l->nlir--;
+	pagelist_remove(l->s,page);
+	pagelist_push(l->q,page);
+	lirs_prune(l);
+}
+
+/* A HIR page still in S has been used, so it becomes LIR, and the bottom LIR page HIR. */
+
+static void lirs_promote( struct lirs *l, int page )
+{
+	pagelist_touch(l->s,page);
+	l->lir[page] = 1;
+	l->nlir++;
+	l->promotions++;
+	if(l->nlir > l->llirs) lirs_demote(l);
+}
+
+static void lirs_on_fault( void *state, int page, int frame )
+{
+	struct lirs *l = state;
+
+	l->frame[page] = frame;
+
+	if(pagelist_contains(l->s,page)) {
+		pagelist_remove(l->evicted,page);
+		lirs_promote(l,page);
+	} else if(l->nlir < l->llirs) {
+		l->lir[page] = 1;
+		l->nlir++;
+		pagelist_push(l->s,page);
+	} else {
+		pagelist_push(l->s,page);
+		pagelist_push(l->q,page);
+	}
+
+	policy_sample(l->context,&l->loads);
+}
+
+static void lirs_on_access( void *state, int page, int frame, int write )
+{
+	struct lirs *l = state;
+
+	if(l->lir[page]) {
+		int bottom = pagelist_oldest(l->s)==page;
+		pagelist_touch(l->s,page);
+		if(bottom) lirs_prune(l);
+	} else if(pagelist_contains(l->s,page)) {
+		pagelist_remove(l->q,page);
+		lirs_promote(l,page);
+	} else {
+		pagelist_push(l->s,page);
+		pagelist_touch(l->q,page);
+	}
+}
+
+static int lirs_choose_victim( void *state, int page )
+{
+	struct lirs *l = state;
+
+	if(pagelist_size(l->q) == 0) lirs_demote(l);
+
+	int victim = pagelist_oldest(l->q);
+	int frame = l->frame[victim];
+	pagelist_remove(l->q,victim);
+	l->frame[victim] = -1;
+
+	if(pagelist_contains(l->s,victim)) {
+		pagelist_push(l->evicted,victim);
+		if(pagelist_size(l->evicted) > l->context->nframes) {
+			int forgotten = pagelist_oldest(l->evicted);
+			pagelist_remove(l->evicted,forgotten);
+			pagelist_remove(l->s,forgotten);
+			lirs_prune(l);
+		}
+	}
+
+	return frame;
+}
+
+static void lirs_stats( void *state, FILE *out )
+{
+	struct lirs *l = state;
+	fprintf(out,"lirs: %d LIR pages of %d, %ld promoted from HIR, %d in S, %d evicted pages remembered\n",
+		l->nlir,l->llirs,l->promotions,pagelist_size(l->s),pagelist_size(l->evicted));
+}
+
+static void lirs_free( void *state )
+{
+	struct lirs *l = state;
+	free(l->frame);
+	free(l->lir);
+	if(l->s) pagelist_delete(l->s);
+	if(l->q) pagelist_delete(l->q);
+	if(l->evicted) pagelist_delete(l->evicted);
+	free(l);
+}
+
+const struct policy lirs_policy = {
+	"lirs", "low inter-reference recency set",
+	lirs_init, lirs_on_fault, lirs_on_access, lirs_choose_victim, lirs_stats, lirs_free
+};
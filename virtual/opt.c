@@ -0,0 +1,166 @@
+/*
+OPT, or MIN, after Belady, "A study of replacement algorithms for a virtual-storage
+computer", IBM Systems Journal 1966: evict the page whose next use is furthest in
+the future. No policy can load fewer pages, so it is the baseline the others are
+measured against. It only counts loads; a dirty page costs no more to evict than
+a clean one.
+
+It looks ahead in a recorded trace, so it only runs under vmtrace replay. The next
+use after every event comes from the trace's next-use index (see trace_next_use),
+and the resident pages are kept in a max-heap on their next use, updated on every
+access, so that each event costs O(log nframes).
+*/
+
+#include "policy.h"
+#include "trace.h"
+
+#include <stdlib.h>
+
+struct opt {
+	struct policy_context *context;
+	const uint32_t *next_use;
+
+	// The resident pages, with the one used furthest in the future at the top.
+	int *heap;
+	int nheap;
+
+	// For each page: its place in the heap (-1 if it isn't resident), next use and frame.
+	int *place;
+	uint32_t *key;
+	int *frame;
+
+	long never_used_again;
+};
+
+static void opt_free( void *state );
+
+static void * opt_init( struct policy_context *context )
+{
+	int i;
+	struct opt *o = calloc(1,sizeof(*o));
+	if(!o) return 0;
+
+	o->context = context;
+	o->heap = malloc(sizeof(int)*context->nframes);
+	o->place = malloc(sizeof(int)*context->npages);
+	o->key = malloc(sizeof(uint32_t)*context->npages);
+	o->frame = malloc(sizeof(int)*context->npages);
+
+	if(!o->heap || !o->place || !o->key || !o->frame) {
+		opt_free(o);
+		return 0;
+	}
+
+	for(i=0;i<context->npages;i++) o->place[i] = -1;
+	return o;
+}
+
+static void heap_set( struct opt *o, int i, int page )
+{
+	o->heap[i] = page;
+	o->place[page] = i;
+}
+
+static void heap_up( struct opt *o, int i )
+{
+	int page = o->heap[i];
+
+	while(i>0) {
+		int parent = (i-1)/2;
+		if(o->key[o->heap[parent]] >= o->key[page]) break;
+		heap_set(o,i,o->heap[parent]);
+		i = parent;
+	}
+	heap_set(o,i,page);
+}
+
+static void heap_down( struct opt *o, int i )
+{
+	int page = o->heap[i];
+
+	for(;;) {
+		int child = 2*i+1;
+		if(child >= o->nheap) break;
+		if(child+1 < o->nheap && o->key[o->heap[child+1]] > o->key[o->heap[child]]) child++;
+		if(o->key[o->heap[child]] <= o->key[page]) break;
+		heap_set(o,i,o->heap[child]);
+		i = child;
+	}
+	heap_set(o,i,page);
+}
+
+/* The next-use index is made before the replay starts, so this only fetches it. */
+
+static const uint32_t * opt_next_use( struct opt *o )
+{
+	if(!o->next_use) {
+		if(!o->context->trace || !(o->next_use = trace_next_use(o->context->trace))) {
+			fprintf(stderr,"opt: no next-use index to look ahead in\n");
+			abort();
+		}
+	}
+	return o->next_use;
+}
+
+static void opt_on_fault( void *state, int page, int frame )
+{
+	struct opt *o = state;
+
+	o->frame[page] = frame;
+	o->key[page] = opt_next_use(o)[o->context->now];
+	o->heap[o->nheap] = page;
+	heap_up(o,o->nheap++);
+}
+
+static void opt_on_access( void *state, int page, int frame, int write )
+{
+}
+
+static void opt_on_use( void *state, int page, long event )
+{
+	struct opt *o = state;
+	uint32_t next = opt_next_use(o)[event];
+
+	// A page's next use only ever moves later, so it can only rise in the heap.
+	if(next != o->key[page]) {
+		o->key[page] = next;
+		heap_up(o,o->place[page]);
+	}
+}
+
+static int opt_choose_victim( void *state, int page )
+{
+	struct opt *o = state;
+	int victim = o->heap[0];
+
+	if(o->key[victim] == TRACE_NEVER) o->never_used_again++;
+
+	o->place[victim] = -1;
+	if(--o->nheap > 0) {
+		heap_set(o,0,o->heap[o->nheap]);
+		heap_down(o,0);
+	}
+
+	return o->frame[victim];
+}
+
+static void opt_stats( void *state, FILE *out )
+{
+	struct opt *o = state;
+	fprintf(out,"opt: %ld of the pages evicted were never used again\n",o->never_used_again);
+}
+
+static void opt_free( void *state )
+{
+	struct opt *o = state;
+	free(o->heap);
+	free(o->place);
+	free(o->key);
+	free(o->frame);
+	free(o);
+}
+
+const struct policy opt_policy = {
+	"opt", "the page used furthest in the future (vmtrace replay only)",
+	opt_init, opt_on_fault, opt_on_access, opt_choose_victim, opt_stats, opt_free, opt_on_use
+};
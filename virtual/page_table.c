@@ -1,7 +1,11 @@
-
 /*
-Do not modify this file.
-Make all of your changes to main.c instead.
+The page table, with two ways of catching page faults (see page_table.h).
+The signal backend maps virtmem onto physmem with remap_file_pages and sets the
+access with mprotect, so a fault arrives as SIGSEGV on the faulting thread.
+The userfaultfd backend watches both memories with userfaultfd, moves (or copies)
+each frame between physmem and the page it is mapped to, and uses write protection
+in place of mprotect. Its faults are answered by threads of its own, one for each
+memory, while the faulting thread waits.
 */
 
 #define _GNU_SOURCE
@@ -14,9 +18,31 @@ Make all of your changes to main.c instead.
 #include <fcntl.h>
 #include <stdlib.h>
 #include <ucontext.h>
+#include <signal.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
 
 #include "page_table.h"
 
+// Moving pages between mappings came in Linux 6.8, after many of the headers in use.
+#ifndef UFFD_FEATURE_MOVE
+#define UFFD_FEATURE_MOVE (1<<16)
+#define _UFFDIO_MOVE (0x05)
+#define UFFDIO_MOVE_MODE_DONTWAKE ((__u64)1<<0)
+struct uffdio_move {
+	__u64 dst;
+	__u64 src;
+	__u64 len;
+	__u64 mode;
+	__s64 move;
+};
+#define UFFDIO_MOVE _IOWR(UFFDIO, _UFFDIO_MOVE, struct uffdio_move)
+#endif
+
 struct page_table {
 	int fd;
 	char *virtmem;
@@ -26,6 +52,23 @@ struct page_table {
 	int *page_mapping;
 	int *page_bits;
 	page_fault_handler_t handler;
+	page_table_backend_t backend;
+
+	// Only for the userfaultfd backend:
+	// One userfaultfd for each memory, each with a thread answering its faults.
+	int virt_fd;
+	int phys_fd;
+	pthread_t virt_thread;
+	pthread_t phys_thread;
+
+	// If the kernel can move a page from one mapping to another, rather than copying it.
+	int can_move;
+
+	// The page whose virtual memory holds each frame, or -1 if the frame is in physmem,
+	// and whether each page holds its frame. Guarded by lock.
+	int *frame_owner;
+	char *page_resident;
+	pthread_mutex_t lock;
 };
 
 struct page_table *the_page_table = 0;
@@ -54,59 +97,402 @@ static void internal_fault_handler( int signum, siginfo_t *info, void *context )
 	abort();
 }
 
-struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler )
+static int create_signal( struct page_table *pt )
 {
-	int i;
 	struct sigaction sa;
-	struct page_table *pt;
 	char filename[256];
 
-	pt = malloc(sizeof(struct page_table));
-	if(!pt) return 0;
-
-	the_page_table = pt;
-
 	sprintf(filename,"/tmp/pmem.%d.%d",getpid(),getuid());
 
 	pt->fd = open(filename,O_CREAT|O_TRUNC|O_RDWR,0777);
 	if(!pt->fd) return 0;
 
-	ftruncate(pt->fd,PAGE_SIZE*npages);
+	ftruncate(pt->fd,PAGE_SIZE*pt->npages);
 
 	unlink(filename);
 
-	pt->physmem = mmap(0,nframes*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,pt->fd,0);
-	pt->nframes = nframes;
+	pt->physmem = mmap(0,pt->nframes*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,pt->fd,0);
+	pt->virtmem = mmap(0,pt->npages*PAGE_SIZE,PROT_NONE,MAP_SHARED|MAP_NORESERVE,pt->fd,0);
+
+	sa.sa_sigaction = internal_fault_handler;
+	sa.sa_flags = SA_SIGINFO;
+
+	sigfillset( &sa.sa_mask );
+	sigaction( SIGSEGV, &sa, 0 );
+
+	return 1;
+}
+
+/*
+The userfaultfd backend.
+
+A frame is one page of memory, which lives either in physmem, or in the virtual
+memory of the page mapped to it, and is moved (or, on older kernels, copied)
+between them as needed, so the two never disagree:
+
+- A fault on a page that has no access calls the handler on the virt_thread,
+  and if the handler gave it access, its frame is moved into place.
+- A fault on a page that has access, but whose frame is elsewhere, just moves the frame in.
+- A write to a page that is only readable is caught with userfaultfd's write protection,
+  and calls the handler.
+- Anything touching a frame while it is out of physmem, such as the handler
+  writing it to disk, faults, and the phys_thread moves the frame back.
+
+The handler is called for the same faults as with the signal backend, so a
+replacement policy counts the same faults, reads and writes with either one.
+The exception is a single access that straddles two pages that both fault,
+which the processor may report in either order.
+*/
+
+static int uffd_move( int fd, char *dst, char *src, int dontwake )
+{
+	struct uffdio_move move;
+
+	move.dst = (unsigned long) dst;
+	move.src = (unsigned long) src;
+	move.len = PAGE_SIZE;
+	move.mode = dontwake ? UFFDIO_MOVE_MODE_DONTWAKE : 0;
+	move.move = 0;
+
+	return ioctl(fd,UFFDIO_MOVE,&move);
+}
+
+static int uffd_copy( int fd, char *dst, char *src, int dontwake, int wp )
+{
+	struct uffdio_copy copy;
+
+	copy.dst = (unsigned long) dst;
+	copy.src = (unsigned long) src;
+	copy.len = PAGE_SIZE;
+	copy.mode = (dontwake ? UFFDIO_COPY_MODE_DONTWAKE : 0) | (wp ? UFFDIO_COPY_MODE_WP : 0);
+	copy.copy = 0;
+
+	if(ioctl(fd,UFFDIO_COPY,&copy)!=0) return -1;
+	return madvise(src,PAGE_SIZE,MADV_DONTNEED);
+}
+
+static int uffd_protect( int fd, char *addr, int wp, int dontwake )
+{
+	struct uffdio_writeprotect protect;
+
+	protect.range.start = (unsigned long) addr;
+	protect.range.len = PAGE_SIZE;
+	// The kernel always wakes the page when protecting it, which is harmless here,
+	// since by then the page is as it should be.
+	protect.mode = wp ? UFFDIO_WRITEPROTECT_MODE_WP : (dontwake ? UFFDIO_WRITEPROTECT_MODE_DONTWAKE : 0);
+
+	return ioctl(fd,UFFDIO_WRITEPROTECT,&protect);
+}
+
+static void uffd_wake( int fd, char *addr )
+{
+	struct uffdio_range range;
+
+	range.start = (unsigned long) addr;
+	range.len = PAGE_SIZE;
+
+	ioctl(fd,UFFDIO_WAKE,&range);
+}
+
+static void uffd_fail( const char *what )
+{
+	fprintf(stderr,"page_table: couldn't %s: %s\n",what,strerror(errno));
+	abort();
+}
+
+/* Move the frame of a resident page back into physmem, waking anything waiting on it there. Needs the lock. */
+
+static void evict_page( struct page_table *pt, int page )
+{
+	int frame = pt->page_mapping[page];
+	char *from = pt->virtmem+page*PAGE_SIZE;
+	char *to = pt->physmem+frame*PAGE_SIZE;
+
+	if(pt->can_move) {
+		if(uffd_move(pt->phys_fd,to,from,0)!=0) uffd_fail("move a frame back to physical memory");
+	} else {
+		if(uffd_copy(pt->phys_fd,to,from,0,0)!=0) uffd_fail("copy a frame back to physical memory");
+	}
+
+	pt->frame_owner[frame] = -1;
+	pt->page_resident[page] = 0;
+}
+
+/* Bring the frame of a page into its virtual memory, without waking it. Needs the lock. */
+
+static void install_page( struct page_table *pt, int page )
+{
+	int frame = pt->page_mapping[page];
+	int wp = !(pt->page_bits[page]&PROT_WRITE);
+	char *to = pt->virtmem+page*PAGE_SIZE;
+	char *from = pt->physmem+frame*PAGE_SIZE;
+
+	// Another page may still hold the frame, if it hasn't been touched since the frame was taken from it.
+	if(pt->frame_owner[frame]>=0) evict_page(pt,pt->frame_owner[frame]);
+
+	if(pt->can_move) {
+		if(uffd_move(pt->virt_fd,to,from,1)!=0) uffd_fail("move a frame to virtual memory");
+		if(wp && uffd_protect(pt->virt_fd,to,1,1)!=0) uffd_fail("write protect a page");
+	} else {
+		if(uffd_copy(pt->virt_fd,to,from,1,wp)!=0) uffd_fail("copy a frame to virtual memory");
+	}
+
+	pt->frame_owner[frame] = page;
+	pt->page_resident[page] = 1;
+}
+
+/* Answer the faults on the virtual memory. */
+
+static void * virt_faults( void *a )
+{
+	struct page_table *pt = a;
+	struct uffd_msg msg;
+
+	while(read(pt->virt_fd,&msg,sizeof(msg))==sizeof(msg)) {
+		if(msg.event!=UFFD_EVENT_PAGEFAULT) continue;
+
+		char *addr = (char *)(unsigned long) msg.arg.pagefault.address;
+		int page = (addr-pt->virtmem) / PAGE_SIZE;
+		char *start = pt->virtmem+page*PAGE_SIZE;
+
+		pthread_mutex_lock(&pt->lock);
+
+		// A page with access only faults for the handler if it is written without PROT_WRITE.
+		int call = !pt->page_bits[page] || (msg.arg.pagefault.flags&UFFD_PAGEFAULT_FLAG_WP);
+
+		if(call) {
+			pthread_mutex_unlock(&pt->lock);
+			pt->handler(pt,page);
+			pthread_mutex_lock(&pt->lock);
+		}
+
+		if(pt->page_bits[page] && !pt->page_resident[page]) install_page(pt,page);
+
+		pthread_mutex_unlock(&pt->lock);
+
+		uffd_wake(pt->virt_fd,start);
+	}
+
+	return 0;
+}
+
+/* Answer the faults on the physical memory, which only happen to frames that are out in virtual memory. */
+
+static void * phys_faults( void *a )
+{
+	struct page_table *pt = a;
+	struct uffd_msg msg;
+
+	while(read(pt->phys_fd,&msg,sizeof(msg))==sizeof(msg)) {
+		if(msg.event!=UFFD_EVENT_PAGEFAULT) continue;
+
+		char *addr = (char *)(unsigned long) msg.arg.pagefault.address;
+		int frame = (addr-pt->physmem) / PAGE_SIZE;
+
+		pthread_mutex_lock(&pt->lock);
+		if(pt->frame_owner[frame]>=0) {
+			evict_page(pt,pt->frame_owner[frame]);
+		} else {
+			uffd_wake(pt->phys_fd,pt->physmem+frame*PAGE_SIZE);
+		}
+		pthread_mutex_unlock(&pt->lock);
+	}
+
+	return 0;
+}
+
+/* Open a userfaultfd and watch the given memory with it. Returns -1 on failure. */
+
+static int uffd_open( char *start, int npages, int wp, int *can_move )
+{
+	struct uffdio_api api;
+	struct uffdio_register reg;
+
+	int fd = syscall(SYS_userfaultfd,O_CLOEXEC);
+	if(fd<0) return -1;
+
+	// Ask for the features one at a time, since asking for one the kernel lacks fails the whole call.
+	memset(&api,0,sizeof(api));
+	api.api = UFFD_API;
+	if(ioctl(fd,UFFDIO_API,&api)!=0) goto fail;
+
+	int features = (wp ? UFFD_FEATURE_PAGEFAULT_FLAG_WP : 0) | (api.features&UFFD_FEATURE_MOVE);
+	if(wp && !(api.features&UFFD_FEATURE_PAGEFAULT_FLAG_WP)) {
+		errno = ENOTSUP;
+		goto fail;
+	}
+	*can_move = (api.features&UFFD_FEATURE_MOVE)!=0;
+
+	// The features can only be set once per userfaultfd, on a fresh one.
+	close(fd);
+	fd = syscall(SYS_userfaultfd,O_CLOEXEC);
+	if(fd<0) return -1;
+
+	memset(&api,0,sizeof(api));
+	api.api = UFFD_API;
+	api.features = features;
+	if(ioctl(fd,UFFDIO_API,&api)!=0) goto fail;
+
+	memset(&reg,0,sizeof(reg));
+	reg.range.start = (unsigned long) start;
+	reg.range.len = (unsigned long) npages*PAGE_SIZE;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING | (wp ? UFFDIO_REGISTER_MODE_WP : 0);
+	if(ioctl(fd,UFFDIO_REGISTER,&reg)!=0) goto fail;
+
+	return fd;
+
+	fail:
+	{
+		int saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return -1;
+	}
+}
+
+static int create_userfaultfd( struct page_table *pt )
+{
+	int i, can_move_phys;
+
+	pt->fd = -1;
+	pt->virt_fd = pt->phys_fd = -1;
+
+	// Both memories are private, so that pages can be moved between them.
+	pt->physmem = mmap(0,pt->nframes*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	pt->virtmem = mmap(0,pt->npages*PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+	if(pt->physmem==MAP_FAILED || pt->virtmem==MAP_FAILED) return 0;
+
+	// Every frame starts out in physmem.
+	memset(pt->physmem,0,pt->nframes*PAGE_SIZE);
+
+	pt->frame_owner = malloc(sizeof(int)*pt->nframes);
+	pt->page_resident = calloc(pt->npages,1);
+	if(!pt->frame_owner || !pt->page_resident) return 0;
+	for(i=0;i<pt->nframes;i++) pt->frame_owner[i] = -1;
+
+	pt->virt_fd = uffd_open(pt->virtmem,pt->npages,1,&pt->can_move);
+	if(pt->virt_fd<0) return 0;
+
+	pt->phys_fd = uffd_open(pt->physmem,pt->nframes,0,&can_move_phys);
+	if(pt->phys_fd<0) return 0;
+
+	pthread_mutex_init(&pt->lock,0);
+
+	if(pthread_create(&pt->virt_thread,0,virt_faults,pt)!=0) return 0;
+	if(pthread_create(&pt->phys_thread,0,phys_faults,pt)!=0) {
+		pthread_cancel(pt->virt_thread);
+		pthread_join(pt->virt_thread,0);
+		return 0;
+	}
+
+	return 1;
+}
+
+struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler )
+{
+	return page_table_create_backend(npages,nframes,handler,PAGE_TABLE_SIGNAL);
+}
+
+struct page_table * page_table_create_backend( int npages, int nframes, page_fault_handler_t handler, page_table_backend_t backend )
+{
+	int i;
+	struct page_table *pt;
+
+	pt = calloc(1,sizeof(struct page_table));
+	if(!pt) return 0;
 
-	pt->virtmem = mmap(0,npages*PAGE_SIZE,PROT_NONE,MAP_SHARED|MAP_NORESERVE,pt->fd,0);
 	pt->npages = npages;
+	pt->nframes = nframes;
+	pt->handler = handler;
+	pt->backend = backend;
 
 	pt->page_bits = malloc(sizeof(int)*npages);
 	pt->page_mapping = malloc(sizeof(int)*npages);
 
-	pt->handler = handler;
-
 	for(i=0;i<pt->npages;i++) pt->page_bits[i] = 0;
-
-	sa.sa_sigaction = internal_fault_handler;
-	sa.sa_flags = SA_SIGINFO;
-
-	sigfillset( &sa.sa_mask );
-	sigaction( SIGSEGV, &sa, 0 );
+	for(i=0;i<pt->npages;i++) pt->page_mapping[i] = 0;
+
+	if(backend==PAGE_TABLE_USERFAULTFD) {
+		if(!create_userfaultfd(pt)) {
+			int saved_errno = errno;
+			if(pt->virt_fd>=0) close(pt->virt_fd);
+			if(pt->phys_fd>=0) close(pt->phys_fd);
+			if(pt->physmem && pt->physmem!=MAP_FAILED) munmap(pt->physmem,nframes*PAGE_SIZE);
+			if(pt->virtmem && pt->virtmem!=MAP_FAILED) munmap(pt->virtmem,npages*PAGE_SIZE);
+			free(pt->frame_owner);
+			free(pt->page_resident);
+			free(pt->page_bits);
+			free(pt->page_mapping);
+			free(pt);
+			errno = saved_errno;
+			return 0;
+		}
+	} else {
+		the_page_table = pt;
+		if(!create_signal(pt)) return 0;
+	}
 
 	return pt;
 }
 
 void page_table_delete( struct page_table *pt )
 {
+	if(pt->backend==PAGE_TABLE_USERFAULTFD) {
+		pthread_cancel(pt->virt_thread);
+		pthread_cancel(pt->phys_thread);
+		pthread_join(pt->virt_thread,0);
+		pthread_join(pt->phys_thread,0);
+		close(pt->virt_fd);
+		close(pt->phys_fd);
+		pthread_mutex_destroy(&pt->lock);
+		free(pt->frame_owner);
+		free(pt->page_resident);
+	}
+
 	munmap(pt->virtmem,pt->npages*PAGE_SIZE);
 	munmap(pt->physmem,pt->nframes*PAGE_SIZE);
 	free(pt->page_bits);
 	free(pt->page_mapping);
-	close(pt->fd);
+	if(pt->fd>=0) close(pt->fd);
+	if(the_page_table==pt) the_page_table = 0;
 	free(pt);
 }
 
+/*
+With userfaultfd, a page that loses its frame or all of its access gives the frame
+back to physmem, and one that keeps its frame has its write protection changed.
+Frames are only brought into virtual memory when the page is touched.
+*/
+
+static void set_entry_userfaultfd( struct page_table *pt, int page, int frame, int bits )
+{
+	char *start = pt->virtmem+page*PAGE_SIZE;
+
+	pthread_mutex_lock(&pt->lock);
+
+	if(pt->page_resident[page]) {
+		int old_bits = pt->page_bits[page];
+
+		if(frame!=pt->page_mapping[page] || !bits) {
+			evict_page(pt,page);
+		} else if((bits&PROT_WRITE) && !(old_bits&PROT_WRITE)) {
+			if(uffd_protect(pt->virt_fd,start,0,1)!=0) uffd_fail("allow writes to a page");
+		} else if(!(bits&PROT_WRITE) && (old_bits&PROT_WRITE)) {
+			if(uffd_protect(pt->virt_fd,start,1,1)!=0) uffd_fail("write protect a page");
+		}
+	}
+
+	pt->page_mapping[page] = frame;
+	pt->page_bits[page] = bits;
+
+	// A frame given to another page is about to be filled with it, so take it back now,
+	// rather than waiting for the handler to fault on it in physmem.
+	int owner = pt->frame_owner[frame];
+	if(bits && owner>=0 && owner!=page) evict_page(pt,owner);
+
+	pthread_mutex_unlock(&pt->lock);
+}
+
 void page_table_set_entry( struct page_table *pt, int page, int frame, int bits )
 {
 	if( page<0 || page>=pt->npages ) {
@@ -119,6 +505,11 @@ void page_table_set_entry( struct page_table *pt, int page, int frame, int bits
 		abort();
 	}
 
+	if(pt->backend==PAGE_TABLE_USERFAULTFD) {
+		set_entry_userfaultfd(pt,page,frame,bits);
+		return;
+	}
+
 	pt->page_mapping[page] = frame;
 	pt->page_bits[page] = bits;
 
@@ -183,3 +574,20 @@ char * page_table_get_physmem( struct page_table *pt )
 {
 	return pt->physmem;
 }
+
+int page_table_backend_from_name( const char *name, page_table_backend_t *backend )
+{
+	if(!strcmp(name,"signal")) {
+		*backend = PAGE_TABLE_SIGNAL;
+	} else if(!strcmp(name,"userfaultfd")) {
+		*backend = PAGE_TABLE_USERFAULTFD;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char * page_table_backend_name( page_table_backend_t backend )
+{
+	return backend==PAGE_TABLE_USERFAULTFD ? "userfaultfd" : "signal";
+}
@@ -17,6 +17,30 @@ that is "npages" big and a physical memory that is "nframes" big
 
 struct page_table * page_table_create( int npages, int nframes, page_fault_handler_t handler );
 
+/*
+How page faults are caught.
+PAGE_TABLE_SIGNAL      catches them as SIGSEGV, and maps pages with remap_file_pages and mprotect.
+PAGE_TABLE_USERFAULTFD catches them with userfaultfd, and moves each frame between physmem and
+                       the page it is mapped to, with write protection standing in for mprotect.
+                       The handler is called on a thread of its own, while the faulting thread waits.
+Both call the handler for the same faults, except that an access straddling two
+pages may fault on them in a different order.
+*/
+
+typedef enum {
+	PAGE_TABLE_SIGNAL,
+	PAGE_TABLE_USERFAULTFD
+} page_table_backend_t;
+
+/* The same as page_table_create, with the given backend. Returns 0 and sets errno if it isn't available. */
+
+struct page_table * page_table_create_backend( int npages, int nframes, page_fault_handler_t handler, page_table_backend_t backend );
+
+/* Convert between a backend and its name. Returns 0 if the name is unknown. */
+
+int page_table_backend_from_name( const char *name, page_table_backend_t *backend );
+const char * page_table_backend_name( page_table_backend_t backend );
+
 /* Delete a page table and the corresponding virtual and physical memories. */
 
 void page_table_delete( struct page_table *pt );
@@ -0,0 +1,97 @@
+#include "pagelist.h"
+
+#include <stdlib.h>
+
+/*
+A circular doubly linked list threaded through two arrays, with the extra entry
+npages as the head. Pages not in the list have next set to -1.
+*/
+
+struct pagelist {
+	int npages;
+	int size;
+	int *next;
+	int *prev;
+};
+
+struct pagelist * pagelist_create( int npages )
+{
+	int i;
+	struct pagelist *l = malloc(sizeof(*l));
+	if(!l) return 0;
+
+	l->npages = npages;
+	l->size = 0;
+	l->next = malloc(sizeof(int)*(npages+1));
+	l->prev = malloc(sizeof(int)*(npages+1));
+
+	if(!l->next || !l->prev) {
+		pagelist_delete(l);
+		return 0;
+	}
+
+	for(i=0;i<npages;i++) l->next[i] = -1;
+	l->next[npages] = l->prev[npages] = npages;
+
+	return l;
+}
+
+void pagelist_delete( struct pagelist *l )
+{
+	free(l->next);
+	free(l->prev);
+	free(l);
+}
+
+void pagelist_push( struct pagelist *l, int page )
+{
+	int head = l->npages;
+
+	l->prev[page] = l->prev[head];
+	l->next[page] = head;
+	l->next[l->prev[head]] = page;
+	l->prev[head] = page;
+	l->size++;
+}
+
+void pagelist_remove( struct pagelist *l, int page )
+{
+	l->next[l->prev[page]] = l->next[page];
+	l->prev[l->next[page]] = l->prev[page];
+	l->next[page] = -1;
+	l->size--;
+}
+
+void pagelist_touch( struct pagelist *l, int page )
+{
+	if(l->next[page]>=0) pagelist_remove(l,page);
+	pagelist_push(l,page);
+}
+
+int pagelist_contains( struct pagelist *l, int page )
+{
+	return l->next[page]>=0;
+}
+
+int pagelist_oldest( struct pagelist *l )
+{
+	int page = l->next[l->npages];
+	return page==l->npages ? -1 : page;
+}
+
+int pagelist_newest( struct pagelist *l )
+{
+	int page = l->prev[l->npages];
+	return page==l->npages ? -1 : page;
+}
+
+int pagelist_next( struct pagelist *l, int page )
+{
+	int next = l->next[page];
+	return next==l->npages ? -1 : next;
+}
+
+int pagelist_size( struct pagelist *l )
+{
+	return l->size;
+}
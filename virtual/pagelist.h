@@ -0,0 +1,50 @@
+#ifndef PAGELIST_H
+#define PAGELIST_H
+
+/*
+An ordered list of page numbers, from the oldest entry to the newest, in which
+any page can be added, found, or taken out in constant time. A page is in a
+list at most once. The replacement policies keep their queues, stacks and
+ghost lists in these.
+*/
+
+struct pagelist;
+
+/* Create an empty list for pages 0 to npages-1. Returns 0 if out of memory. */
+
+struct pagelist * pagelist_create( int npages );
+
+/* Delete a list. */
+
+void pagelist_delete( struct pagelist *l );
+
+/* Add a page as the newest entry. The page must not be in the list already. */
+
+void pagelist_push( struct pagelist *l, int page );
+
+/* Take a page out of the list. The page must be in the list. */
+
+void pagelist_remove( struct pagelist *l, int page );
+
+/* Move a page in the list to be the newest entry, or add it if it isn't there. */
+
+void pagelist_touch( struct pagelist *l, int page );
+
+/* Return true if the page is in the list. */
+
+int pagelist_contains( struct pagelist *l, int page );
+
+/* Return the oldest or newest page in the list, or -1 if it is empty. */
+
+int pagelist_oldest( struct pagelist *l );
+int pagelist_newest( struct pagelist *l );
+
+/* Return the page after "page", towards the newest end, or -1 if it is the newest. */
+
+int pagelist_next( struct pagelist *l, int page );
+
+/* Return the number of pages in the list. */
+
+int pagelist_size( struct pagelist *l );
+
+#endif
@@ -0,0 +1,210 @@
+#include "pager.h"
+#include "frames.h"
+
+#include <sys/mman.h>
+#include <stdlib.h>
+
+struct pager {
+	struct pager_counts count;
+	struct frame_table *frames; //which page is in each frame, in the order they were loaded, see frames.h
+	int *frame_of_page; //the frame each page is in, or -1 if it isn't in memory
+	char *bits; //the access each page has
+
+	const struct pager_ops *ops;
+	void *arg;
+
+	const struct policy *policy;
+	void *policy_state;
+	struct policy_context context;
+};
+
+static void set_entry( struct pager *p, int page, int frame, int bits )
+{
+	p->bits[page] = bits;
+	if(p->ops) p->ops->set_entry(p->arg, page, frame, bits);
+}
+
+//Loads a page into a particular frame
+static void set_frame( struct pager *p, int page, int frame )
+{
+	p->count.disk_reads++;
+	p->frame_of_page[page] = frame;
+	frame_table_load(p->frames, frame, page); //The frame becomes the newest, which is what FIFO goes by
+	set_entry(p, page, frame, PROT_READ);
+	if(p->ops) p->ops->read_page(p->arg, page, frame);
+}
+
+//Swaps one page into a frame and removes the other page from that frame
+static void swap_pages( struct pager *p, int old_page, int new_page, int frame )
+{
+	set_frame(p, new_page, frame);
+	set_entry(p, old_page, frame, 0);
+	p->frame_of_page[old_page] = -1;
+}
+
+//Sets the write permission, marking the frame dirty
+static void set_write_permission( struct pager *p, int page, int frame )
+{
+	frame_table_set_dirty(p->frames, frame);
+	set_entry(p, page, frame, PROT_READ|PROT_WRITE);
+}
+
+//Writes a particular page back to disk
+static void write_to_disk( struct pager *p, int page, int frame )
+{
+	p->count.disk_writes++;
+	if(p->ops) p->ops->write_page(p->arg, page, frame);
+}
+
+//Writes every page back to disk, then resets their dirty bits, leaving revoked pages revoked
+static void clean_all( struct policy_context *context )
+{
+	struct pager *p = context->engine;
+	int frame, page;
+
+	for(frame=0; frame < context->nframes; frame++){
+		page = frame_table_page(p->frames, frame);
+		write_to_disk(p, page, frame);
+		set_entry(p, page, frame, p->bits[page] ? PROT_READ : 0);
+	}
+	frame_table_clean_all(p->frames);
+}
+
+//Takes all access away from a page in memory, so the policy hears of its next use
+static void revoke( struct policy_context *context, int page )
+{
+	struct pager *p = context->engine;
+	set_entry(p, page, p->frame_of_page[page], 0);
+}
+
+//Called once the policy has decided on a frame to replace
+static void replace_page( struct pager *p, int new_page, int frame )
+{
+	int old_page = frame_table_page(p->frames, frame);
+	if(frame_table_dirty(p->frames, frame)) {
+		//page is dirty, write back to disk
+		write_to_disk(p, old_page, frame);
+	}
+	swap_pages(p, old_page, new_page, frame);
+}
+
+struct pager * pager_create( int npages, int nframes, const struct policy *policy, const struct pager_ops *ops, void *arg )
+{
+	int i;
+	struct pager *p = calloc(1,sizeof(*p));
+	if(!p) return 0;
+
+	p->frames = frame_table_create(nframes);
+	p->frame_of_page = malloc(sizeof(int)*npages);
+	p->bits = calloc(npages,1);
+	p->ops = ops;
+	p->arg = arg;
+	p->policy = policy;
+
+	if(!p->frames || !p->frame_of_page || !p->bits) {
+		pager_delete(p);
+		return 0;
+	}
+
+	for(i=0; i < npages; i++) p->frame_of_page[i] = -1;
+
+	p->context.npages = npages;
+	p->context.nframes = nframes;
+	p->context.frames = p->frames;
+	p->context.revoke = revoke;
+	p->context.clean_all = clean_all;
+	p->context.engine = p;
+
+	p->policy_state = policy->init(&p->context);
+	if(!p->policy_state) {
+		pager_delete(p);
+		return 0;
+	}
+
+	return p;
+}
+
+void pager_delete( struct pager *p )
+{
+	if(p->policy_state) p->policy->free(p->policy_state);
+	if(p->frames) frame_table_delete(p->frames);
+	free(p->frame_of_page);
+	free(p->bits);
+	free(p);
+}
+
+void pager_fault( struct pager *p, int page )
+{
+	p->count.page_faults++;
+
+	int bits = p->bits[page];
+	int frame = p->frame_of_page[page];
+
+	if(bits & PROT_WRITE) {
+		//Nothing to do
+	} else if(bits & PROT_READ) {
+		//The page is in memory, but does not yet have write permission
+		set_write_permission(p, page, frame);
+		p->policy->on_access(p->policy_state, page, frame, 1);
+	} else if(frame != -1) {
+		//The page is in memory, but the policy revoked its access to see when it is used
+		p->count.reference_faults++;
+		set_entry(p, page, frame, frame_table_dirty(p->frames, frame) ? PROT_READ|PROT_WRITE : PROT_READ);
+		p->policy->on_access(p->policy_state, page, frame, 0);
+	} else {
+		//Try to get a free frame to put the page in, or ask the policy which to replace
+		frame = frame_table_take_free(p->frames);
+		if(frame != -1){
+			set_frame(p, page, frame);
+		} else {
+			frame = p->policy->choose_victim(p->policy_state, page);
+			replace_page(p, page, frame);
+		}
+		p->policy->on_fault(p->policy_state, page, frame);
+	}
+}
+
+void pager_access( struct pager *p, int page, int write )
+{
+	int need = write ? PROT_READ|PROT_WRITE : PROT_READ;
+	while((p->bits[page] & need) != need) pager_fault(p, page);
+}
+
+void pager_replay( struct pager *p, struct trace *t )
+{
+	long i;
+	const char *bits = p->bits;
+
+	p->context.trace = t;
+
+	if(!p->policy->on_use) {
+		for(i=0;i<t->nevents;i++) {
+			uint32_t event = t->events[i];
+			int page = trace_page(event);
+			int need = trace_is_write(event) ? PROT_READ|PROT_WRITE : PROT_READ;
+			while((bits[page] & need) != need) pager_fault(p, page);
+		}
+		return;
+	}
+
+	//The same, telling the policy of every access and when it is
+	for(i=0;i<t->nevents;i++) {
+		uint32_t event = t->events[i];
+		int page = trace_page(event);
+		int need = trace_is_write(event) ? PROT_READ|PROT_WRITE : PROT_READ;
+		p->context.now = i;
+		while((bits[page] & need) != need) pager_fault(p, page);
+		p->policy->on_use(p->policy_state, page, i);
+	}
+}
+
+struct pager_counts pager_get_counts( struct pager *p )
+{
+	return p->count;
+}
+
+void pager_print_stats( struct pager *p, FILE *out )
+{
+	if(p->count.reference_faults) fprintf(out,"%s: %ld of the faults were uses of revoked pages\n", p->policy->name, p->count.reference_faults);
+	if(p->policy->stats) p->policy->stats(p->policy_state, out);
+}
@@ -0,0 +1,67 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include "policy.h"
+#include "trace.h"
+
+#include <stdio.h>
+
+/*
+What virtmem does on each page fault: load the page into a free frame or one
+the policy gives up, write the old page back if it is dirty, give write access
+on the first write, and give back access the policy revoked, counting the
+faults and the disk traffic as it goes.
+
+The pager keeps the access bits of every page itself, and only tells its ops
+what to do to the page table and the disk, so that the same decisions can be
+made for a real page table, or over a recorded trace (see trace.h) with no ops
+at all.
+*/
+
+struct pager_ops {
+	/* Map "page" to "frame" with these access bits, as page_table_set_entry. */
+	void (*set_entry)( void *arg, int page, int frame, int bits );
+
+	/* Read "page" from disk into "frame", or write it back from there. */
+	void (*read_page)( void *arg, int page, int frame );
+	void (*write_page)( void *arg, int page, int frame );
+};
+
+struct pager_counts {
+	long page_faults;
+	long disk_reads;
+	long disk_writes;
+	long reference_faults; //of the page faults, those on pages whose access the policy revoked
+};
+
+struct pager;
+
+/* Create a pager running "policy" over npages and nframes. "ops" may be 0 to simulate. Returns 0 if out of memory. */
+
+struct pager * pager_create( int npages, int nframes, const struct policy *policy, const struct pager_ops *ops, void *arg );
+
+/* Delete a pager. */
+
+void pager_delete( struct pager *p );
+
+/* Handle one page fault on "page". */
+
+void pager_fault( struct pager *p, int page );
+
+/* Read or write "page", faulting for as long as it lacks the access, as the hardware would. */
+
+void pager_access( struct pager *p, int page, int write );
+
+/* Make every access in a trace in turn, as pager_access, telling the policy of each if it looks ahead. */
+
+void pager_replay( struct pager *p, struct trace *t );
+
+/* Return the counts so far. */
+
+struct pager_counts pager_get_counts( struct pager *p );
+
+/* Print the number of reference faults, if any, and the policy's own counts. */
+
+void pager_print_stats( struct pager *p, FILE *out );
+
+#endif
@@ -0,0 +1,150 @@
+#include "policy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+//Every policy that can be picked on the command line, in the order they are listed
+static const struct policy *policies[] = {
+	&rand_policy,
+	&fifo_policy,
+	&custom_policy,
+	&clock_policy,
+	&lru_policy,
+	&twoq_policy,
+	&arc_policy,
+	&lirs_policy,
+	&opt_policy,
+};
+
+#define NPOLICIES (sizeof(policies)/sizeof(policies[0]))
+
+const struct policy * policy_find( const char *name )
+{
+	unsigned i;
+	for(i=0;i<NPOLICIES;i++) {
+		if(!strcmp(policies[i]->name,name)) return policies[i];
+	}
+	return 0;
+}
+
+void policy_print_names( FILE *out, int with_lookahead )
+{
+	unsigned i;
+	int n = 0;
+	for(i=0;i<NPOLICIES;i++) {
+		if(policies[i]->on_use && !with_lookahead) continue;
+		fprintf(out,"%s%s",n++ ? "|" : "",policies[i]->name);
+	}
+}
+
+void policy_print_descriptions( FILE *out, int with_lookahead )
+{
+	unsigned i;
+	for(i=0;i<NPOLICIES;i++) {
+		if(policies[i]->on_use && !with_lookahead) continue;
+		fprintf(out,"  %-8s %s\n",policies[i]->name,policies[i]->description);
+	}
+}
+
+void policy_sample( struct policy_context *context, int *loads )
+{
+	int frame, page;
+
+	if(++*loads < context->nframes) return;
+	*loads = 0;
+
+	for(frame=0; frame < context->nframes; frame++) {
+		page = frame_table_page(context->frames, frame);
+		if(page >= 0) context->revoke(context,page);
+	}
+}
+
+/*
+FIFO and custom need nothing but the frame table, so their state is the context.
+*/
+
+static void * context_init( struct policy_context *context )
+{
+	return context;
+}
+
+static void nothing_on_fault( void *state, int page, int frame )
+{
+}
+
+static void nothing_on_access( void *state, int page, int frame, int write )
+{
+}
+
+static void nothing_free( void *state )
+{
+}
+
+/*
+Random replace chooses a random frame. It keeps its own generator, starting
+from the same all-zero state as an unseeded lrand48, so that every run of it
+picks the same frames, however many runs there are in one process.
+*/
+
+struct rand {
+	struct policy_context *context;
+	unsigned short seed[3];
+};
+
+static void * rand_init( struct policy_context *context )
+{
+	struct rand *r = calloc(1,sizeof(*r));
+	if(!r) return 0;
+	r->context = context;
+	return r;
+}
+
+static int rand_choose_victim( void *state, int page )
+{
+	struct rand *r = state;
+	return nrand48(r->seed) % r->context->nframes;
+}
+
+static void rand_free( void *state )
+{
+	free(state);
+}
+
+//Replace the frame that was put in first, i.e., the oldest frame
+static int fifo_choose_victim( void *state, int page )
+{
+	struct policy_context *context = state;
+	return frame_table_oldest(context->frames);
+}
+
+//This is modified FIFO, where it doesn't write dirty pages back to disk unless it has to
+static int custom_choose_victim( void *state, int page )
+{
+	struct policy_context *context = state;
+
+	//Get the oldest clean frame
+	int frame = frame_table_oldest_clean(context->frames);
+	if(frame == -1){
+		//All frames are dirty, write all back to disk
+		context->clean_all(context);
+
+		//Since all frames are clean, use regular FIFO here
+		frame = frame_table_oldest(context->frames);
+	}
+	return frame;
+}
+
+const struct policy rand_policy = {
+	"rand", "a frame picked at random",
+	rand_init, nothing_on_fault, nothing_on_access, rand_choose_victim, 0, rand_free
+};
+
+const struct policy fifo_policy = {
+	"fifo", "the frame loaded longest ago",
+	context_init, nothing_on_fault, nothing_on_access, fifo_choose_victim, 0, nothing_free
+};
+
+const struct policy custom_policy = {
+	"custom", "the clean frame loaded longest ago, writing every frame back when all are dirty",
+	context_init, nothing_on_fault, nothing_on_access, custom_choose_victim, 0, nothing_free
+};
@@ -0,0 +1,100 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "frames.h"
+
+#include <stdio.h>
+
+/*
+A page replacement policy, as a set of hooks called from the page fault handler.
+
+The only references the handler sees are faults, so a policy that wants to know
+when a resident page is used again takes its access away with "revoke" in its
+context. The next use of the page then faults without any disk traffic, the
+access is given back, and the policy hears of it through on_access.
+
+A policy that looks ahead, such as OPT, can only be run over a recorded trace
+(see trace.h), and hears of every access in it through on_use.
+*/
+
+struct trace;
+
+struct policy_context {
+	int npages;
+	int nframes;
+
+	// Which page is in each frame, the order they were loaded in, and which are dirty.
+	struct frame_table *frames;
+
+	// Take away all access to a resident page, so that its next use calls on_access.
+	void (*revoke)( struct policy_context *context, int page );
+
+	// Write every dirty frame back to disk, leaving them all clean.
+	void (*clean_all)( struct policy_context *context );
+
+	// Whatever runs the policy, for revoke and clean_all.
+	void *engine;
+
+	// When replaying, the trace and the number of the event being replayed; otherwise 0.
+	struct trace *trace;
+	long now;
+};
+
+struct policy {
+	const char *name;
+	const char *description;
+
+	/* Create the policy's state. Returns 0 if out of memory. */
+	void * (*init)( struct policy_context *context );
+
+	/* "page" has been loaded into "frame" after a fault. */
+	void (*on_fault)( void *state, int page, int frame );
+
+	/* The resident page in "frame" was used after its access was revoked, or written for the first time since it was loaded or cleaned. */
+	void (*on_access)( void *state, int page, int frame, int write );
+
+	/* Every frame is in use and "page" is to be loaded: return the frame to take it from. */
+	int (*choose_victim)( void *state, int page );
+
+	/* Print anything the policy counts of its own on one line, or nothing. May be 0. */
+	void (*stats)( void *state, FILE *out );
+
+	/* Delete the policy's state. */
+	void (*free)( void *state );
+
+	/* Event number "event" of the trace used "page", after any faults it took. 0 if the policy doesn't need a trace. */
+	void (*on_use)( void *state, int page, long event );
+};
+
+/* Find a registered policy by name. Returns 0 if there is none. */
+
+const struct policy * policy_find( const char *name );
+
+/* Print the names of the registered policies, separated by '|', leaving out those that look ahead unless with_lookahead is set. */
+
+void policy_print_names( FILE *out, int with_lookahead );
+
+/* Print the registered policies with their descriptions, one per line, leaving out those that look ahead unless with_lookahead is set. */
+
+void policy_print_descriptions( FILE *out, int with_lookahead );
+
+/*
+For policies that sample references: revoke every resident page once for each
+"nframes" pages loaded, counting loads in *loads. Call it from on_fault.
+*/
+
+void policy_sample( struct policy_context *context, int *loads );
+
+/* The registered policies. */
+
+extern const struct policy rand_policy;
+extern const struct policy fifo_policy;
+extern const struct policy custom_policy;
+extern const struct policy clock_policy;
+extern const struct policy lru_policy;
+extern const struct policy twoq_policy;
+extern const struct policy arc_policy;
+extern const struct policy lirs_policy;
+extern const struct policy opt_policy;
+
+#endif
@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+
+#include "trace.h"
+#include "page_table.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define TRACE_MAGIC "VMTRACE1"
+
+struct trace_header {
+	char magic[8];
+	uint32_t npages;
+	uint32_t reserved;
+	uint64_t nevents;
+};
+
+/*
+While recording, only the page accessed last is open, with read access after a
+read and write access after a write, so that every other access faults and is
+recorded. The faulting instruction is single stepped: a fault before the step
+traps is the same instruction touching another page, and the pages it touched
+stay open until it is done, when all but the last are closed again.
+*/
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CAN_RECORD 1
+#define TRAP_FLAG 0x100
+#else
+#define CAN_RECORD 0
+#endif
+
+#define RECORD_BUFFER 65536
+#define MAX_OPEN 8
+
+static struct recorder {
+	char *mem;
+	int npages;
+	char *bits;
+
+	int open[MAX_OPEN];
+	int nopen;
+	int last;
+
+	int fd;
+	uint32_t buffer[RECORD_BUFFER];
+	int nbuffer;
+	uint64_t nevents;
+	int failed;
+} rec;
+
+static void record_flush( void )
+{
+	size_t size = rec.nbuffer*sizeof(uint32_t);
+	if(write(rec.fd,rec.buffer,size)!=size) rec.failed = 1;
+	rec.nbuffer = 0;
+}
+
+static void record_event( int page, int write )
+{
+	rec.buffer[rec.nbuffer++] = ((uint32_t)page<<1) | (write ? TRACE_WRITE : 0);
+	rec.nevents++;
+	if(rec.nbuffer==RECORD_BUFFER) record_flush();
+}
+
+static void set_bits( int page, int bits )
+{
+	rec.bits[page] = bits;
+	mprotect(rec.mem+(long)page*PAGE_SIZE,PAGE_SIZE,bits);
+}
+
+#if CAN_RECORD
+
+static void record_fault( int signum, siginfo_t *info, void *context )
+{
+	ucontext_t *uc = context;
+	char *addr = info->si_addr;
+	int page = (addr-rec.mem) / PAGE_SIZE;
+
+	if(addr<rec.mem || page>=rec.npages) {
+		fprintf(stderr,"segmentation fault at address %p\n",addr);
+		abort();
+	}
+
+	if(rec.bits[page] & PROT_READ) {
+		record_event(page,1);
+		set_bits(page,PROT_READ|PROT_WRITE);
+	} else {
+		if(rec.nopen==MAX_OPEN) {
+			fprintf(stderr,"an instruction touched more than %d pages\n",MAX_OPEN);
+			abort();
+		}
+		record_event(page,0);
+		set_bits(page,PROT_READ);
+		rec.open[rec.nopen++] = page;
+	}
+
+	rec.last = page;
+	uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+static void record_step( int signum, siginfo_t *info, void *context )
+{
+	ucontext_t *uc = context;
+	int i;
+
+	uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+
+	for(i=0;i<rec.nopen;i++) {
+		if(rec.open[i]!=rec.last) set_bits(rec.open[i],0);
+	}
+	rec.open[0] = rec.last;
+	rec.nopen = 1;
+}
+
+#endif
+
+int trace_record( int npages, void (*program)( char *data, int length ), const char *filename )
+{
+#if CAN_RECORD
+	struct sigaction sa, old_segv, old_trap;
+	struct trace_header header;
+	int saved_errno;
+
+	memset(&rec,0,sizeof(rec));
+	rec.npages = npages;
+	rec.last = -1;
+
+	rec.fd = open(filename,O_CREAT|O_TRUNC|O_WRONLY,0666);
+	if(rec.fd<0) return 0;
+
+	rec.bits = calloc(npages,1);
+	rec.mem = mmap(0,(long)npages*PAGE_SIZE,PROT_NONE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+	if(!rec.bits || rec.mem==MAP_FAILED) {
+		saved_errno = rec.bits ? errno : ENOMEM;
+		free(rec.bits);
+		close(rec.fd);
+		errno = saved_errno;
+		return 0;
+	}
+
+	// The header is written again with the number of events at the end.
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,TRACE_MAGIC,sizeof(header.magic));
+	header.npages = npages;
+	if(write(rec.fd,&header,sizeof(header))!=sizeof(header)) rec.failed = 1;
+
+	memset(&sa,0,sizeof(sa));
+	sa.sa_flags = SA_SIGINFO;
+	sigfillset(&sa.sa_mask);
+	sa.sa_sigaction = record_fault;
+	sigaction(SIGSEGV,&sa,&old_segv);
+	sa.sa_sigaction = record_step;
+	sigaction(SIGTRAP,&sa,&old_trap);
+
+	program(rec.mem,npages*PAGE_SIZE);
+
+	sigaction(SIGSEGV,&old_segv,0);
+	sigaction(SIGTRAP,&old_trap,0);
+
+	record_flush();
+	header.nevents = rec.nevents;
+	if(pwrite(rec.fd,&header,sizeof(header),0)!=sizeof(header)) rec.failed = 1;
+
+	saved_errno = errno;
+	munmap(rec.mem,(long)npages*PAGE_SIZE);
+	free(rec.bits);
+	if(close(rec.fd)!=0) rec.failed = 1;
+
+	if(rec.failed) {
+		errno = saved_errno ? saved_errno : EIO;
+		return 0;
+	}
+	return 1;
+#else
+	errno = ENOSYS;
+	return 0;
+#endif
+}
+
+struct trace * trace_load( const char *filename )
+{
+	struct trace_header header;
+	struct stat info;
+	struct trace *t;
+
+	int fd = open(filename,O_RDONLY);
+	if(fd<0) return 0;
+
+	if(fstat(fd,&info)!=0) {
+		close(fd);
+		return 0;
+	}
+
+	if(info.st_size<sizeof(header) || pread(fd,&header,sizeof(header),0)!=sizeof(header)
+		|| memcmp(header.magic,TRACE_MAGIC,sizeof(header.magic))
+		|| info.st_size!=sizeof(header)+header.nevents*sizeof(uint32_t)) {
+		close(fd);
+		errno = EINVAL;
+		return 0;
+	}
+
+	t = calloc(1,sizeof(*t));
+	if(!t) {
+		close(fd);
+		return 0;
+	}
+
+	t->npages = header.npages;
+	t->nevents = header.nevents;
+	t->size = info.st_size;
+	t->map = mmap(0,t->size,PROT_READ,MAP_PRIVATE|MAP_POPULATE,fd,0);
+	close(fd);
+
+	if(t->map==MAP_FAILED) {
+		free(t);
+		return 0;
+	}
+
+	t->events = (const uint32_t *)((char*)t->map+sizeof(header));
+	return t;
+}
+
+const uint32_t * trace_next_use( struct trace *t )
+{
+	long i;
+	int page;
+
+	if(t->next_use) return t->next_use;
+
+	if(t->nevents>=TRACE_NEVER) {
+		errno = EFBIG;
+		return 0;
+	}
+
+	uint32_t *next = malloc(sizeof(uint32_t)*(t->nevents ? t->nevents : 1));
+	uint32_t *last = malloc(sizeof(uint32_t)*t->npages);
+	if(!next || !last) {
+		free(next);
+		free(last);
+		errno = ENOMEM;
+		return 0;
+	}
+
+	for(page=0;page<t->npages;page++) last[page] = TRACE_NEVER;
+
+	for(i=t->nevents-1;i>=0;i--) {
+		page = trace_page(t->events[i]);
+		next[i] = last[page];
+		last[page] = i;
+	}
+
+	free(last);
+	t->next_use = next;
+	return next;
+}
+
+void trace_delete( struct trace *t )
+{
+	free(t->next_use);
+	munmap(t->map,t->size);
+	free(t);
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/*
+A recorded stream of the accesses a program makes to its virtual memory, as
+far as page faults can tell them apart: each access to a page other than the
+one accessed last, and each first write to a page after it was read. Those are
+the only accesses that can fault in virtmem, whatever the policy, because the
+access bits only change in the fault handler. Replaying them through a pager
+(see pager.h) gives the same counts as running the program under virtmem.
+
+The file is a header followed by one 32-bit event per access, page<<1 | write.
+
+An instruction whose access straddles two pages is recorded as an access to
+each, in the order they faulted while recording. Under virtmem the hardware may
+fault on them in another order, depending on the access each has, and a policy
+that can evict one page for the other in the middle of the instruction may then
+count differently: rand over sort with two or three frames is off by a few faults.
+*/
+
+#define TRACE_WRITE 1
+
+// The next use of a page that is never used again.
+#define TRACE_NEVER UINT32_MAX
+
+struct trace {
+	int npages;
+	long nevents;
+	const uint32_t *events;
+
+	void *map;
+	long size;
+
+	uint32_t *next_use; //see trace_next_use
+};
+
+/* Run "program" over npages of memory, recording its accesses to "filename". Returns 0 and sets errno on failure. */
+
+int trace_record( int npages, void (*program)( char *data, int length ), const char *filename );
+
+/* Load a trace recorded by trace_record. Returns 0 and sets errno on failure. */
+
+struct trace * trace_load( const char *filename );
+
+/*
+Return the next-use index of a trace: for each event, the number of the next
+event that uses the same page, or TRACE_NEVER. It is made on the first call,
+in one pass from the end, and kept with the trace. Returns 0 and sets errno if
+out of memory, or if the trace has too many events to number in 32 bits.
+*/
+
+const uint32_t * trace_next_use( struct trace *t );
+
+/* Delete a loaded trace. */
+
+void trace_delete( struct trace *t );
+
+/* The page an event accessed, and whether it wrote it. */
+
+static inline int trace_page( uint32_t event ) { return event>>1; }
+static inline int trace_is_write( uint32_t event ) { return event & TRACE_WRITE; }
+
+#endif
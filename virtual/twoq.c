@@ -0,0 +1,118 @@
+/*
+2Q, after Johnson and Shasha, "2Q: A Low Overhead High Performance Buffer
+Management Replacement Algorithm", VLDB 1994 (the full version).
+
+A page loaded for the first time goes into A1in, a FIFO of a quarter of the
+frames, and leaves it to the ghost list A1out, which remembers half as many
+pages as there are frames. A page that faults while it is remembered in
+A1out has been used twice far apart, so it goes into Am, kept in LRU order.
+Uses of pages in A1in are taken to be correlated with the fault that loaded
+them, and are ignored. Uses of pages in Am are sampled (see policy_sample).
+*/
+
+#include "policy.h"
+#include "pagelist.h"
+
+#include <stdlib.h>
+
+struct twoq {
+	struct policy_context *context;
+	int *frame; //of each page, -1 if it isn't resident
+	struct pagelist *a1in;
+	struct pagelist *a1out;
+	struct pagelist *am;
+	int kin;
+	int kout;
+	int loads;
+	long promotions;
+};
+
+static void twoq_free( void *state );
+
+static void * twoq_init( struct policy_context *context )
+{
+	int i;
+	struct twoq *q = calloc(1,sizeof(*q));
+	if(!q) return 0;
+
+	q->context = context;
+	q->frame = malloc(sizeof(int)*context->npages);
+	q->a1in = pagelist_create(context->npages);
+	q->a1out = pagelist_create(context->npages);
+	q->am = pagelist_create(context->npages);
+	q->kin = context->nframes/4 > 0 ? context->nframes/4 : 1;
+	q->kout = context->nframes/2 > 0 ? context->nframes/2 : 1;
+
+	if(!q->frame || !q->a1in || !q->a1out || !q->am) {
+		twoq_free(q);
+		return 0;
+	}
+
+	for(i=0;i<context->npages;i++) q->frame[i] = -1;
+	return q;
+}
+
+static void twoq_on_fault( void *state, int page, int frame )
+{
+	struct twoq *q = state;
+
+	q->frame[page] = frame;
+
+	if(pagelist_contains(q->a1out,page)) {
+		pagelist_remove(q->a1out,page);
+		pagelist_push(q->am,page);
+		q->promotions++;
+	} else {
+		pagelist_push(q->a1in,page);
+	}
+
+	policy_sample(q->context,&q->loads);
+}
+
+static void twoq_on_access( void *state, int page, int frame, int write )
+{
+	struct twoq *q = state;
+	if(pagelist_contains(q->am,page)) pagelist_touch(q->am,page);
+}
+
+static int twoq_choose_victim( void *state, int page )
+{
+	struct twoq *q = state;
+	int victim;
+
+	if(pagelist_size(q->a1in) > q->kin || pagelist_size(q->am) == 0) {
+		victim = pagelist_oldest(q->a1in);
+		pagelist_remove(q->a1in,victim);
+		pagelist_push(q->a1out,victim);
+		if(pagelist_size(q->a1out) > q->kout) pagelist_remove(q->a1out,pagelist_oldest(q->a1out));
+	} else {
+		victim = pagelist_oldest(q->am);
+		pagelist_remove(q->am,victim);
+	}
+
+	int frame = q->frame[victim];
+	q->frame[victim] = -1;
+	return frame;
+}
+
+static void twoq_stats( void *state, FILE *out )
+{
+	struct twoq *q = state;
+	fprintf(out,"2q: %ld pages promoted to Am, %d in A1in, %d in Am, %d remembered in A1out\n",
+		q->promotions,pagelist_size(q->a1in),pagelist_size(q->am),pagelist_size(q->a1out));
+}
+
+static void twoq_free( void *state )
+{
+	struct twoq *q = state;
+	free(q->frame);
+	if(q->a1in) pagelist_delete(q->a1in);
+	if(q->a1out) pagelist_delete(q->a1out);
+	if(q->am) pagelist_delete(q->am);
+	free(q);
+}
+
+const struct policy twoq_policy = {
+	"2q", "2Q, a FIFO for pages used once and LRU for pages used again",
+	twoq_init, twoq_on_fault, twoq_on_access, twoq_choose_victim, twoq_stats, twoq_free
+};
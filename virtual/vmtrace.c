@@ -0,0 +1,138 @@
+/*
+Record a program's accesses to a trace, and replay traces through the
+replacement policies without running the program again.
+
+vmtrace record <npages> <sort|scan|focus> <trace>
+	Runs the program as virtmem would, writing its accesses to the trace (see trace.h).
+
+vmtrace replay <trace> <policy> <nframes> [last nframes]
+	Simulates virtmem over the trace, with no page table and no disk, for each
+	number of frames in turn, printing the same nframes,faults,reads,writes CSV
+	as virtmem. With a single number of frames, the policy's own counts go to stderr.
+	Policies that look ahead, such as opt, can only be run this way.
+*/
+
+#include "trace.h"
+#include "pager.h"
+#include "policy.h"
+#include "program.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+static void show_help( void )
+{
+	printf("use: vmtrace record <npages> <sort|scan|focus> <trace>\n");
+	printf("     vmtrace replay <trace> <");
+	policy_print_names(stdout,1);
+	printf("> <nframes> [last nframes]\n");
+}
+
+static int record( int argc, char *argv[] )
+{
+	void (*program)( char *data, int length );
+
+	if(argc!=5) {
+		show_help();
+		return 1;
+	}
+
+	int npages = atoi(argv[2]);
+	if(npages <= 0) {
+		printf("error: must have at least 1 page\n");
+		return 1;
+	}
+
+	if(!strcmp(argv[3],"sort")) {
+		program = sort_program;
+	} else if(!strcmp(argv[3],"scan")) {
+		program = scan_program;
+	} else if(!strcmp(argv[3],"focus")) {
+		program = focus_program;
+	} else {
+		fprintf(stderr,"unknown program: %s\n",argv[3]);
+		return 1;
+	}
+
+	if(!trace_record(npages,program,argv[4])) {
+		fprintf(stderr,"couldn't record %s: %s\n",argv[4],strerror(errno));
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Replay a trace with one number of frames. Returns 0 if out of memory. */
+
+static int replay_one( struct trace *t, const struct policy *policy, int nframes, int show_stats )
+{
+	struct pager *p = pager_create(t->npages, nframes, policy, 0, 0);
+	if(!p) return 0;
+
+	pager_replay(p, t);
+
+	struct pager_counts count = pager_get_counts(p);
+	printf("%d,%ld,%ld,%ld\n", nframes, count.page_faults, count.disk_reads, count.disk_writes);
+	fflush(stdout);
+
+	if(show_stats) pager_print_stats(p, stderr);
+
+	pager_delete(p);
+	return 1;
+}
+
+static int replay( int argc, char *argv[] )
+{
+	if(argc!=5 && argc!=6) {
+		show_help();
+		return 1;
+	}
+
+	const struct policy *policy = policy_find(argv[3]);
+	if(!policy) {
+		fprintf(stderr,"unknown replacement strategy: %s\n",argv[3]);
+		policy_print_descriptions(stderr,1);
+		return 1;
+	}
+
+	int first = atoi(argv[4]);
+	int last = argc==6 ? atoi(argv[5]) : first;
+	if(first <= 0 || last < first) {
+		printf("error: must have at least 1 frame\n");
+		return 1;
+	}
+
+	struct trace *t = trace_load(argv[2]);
+	if(!t) {
+		fprintf(stderr,"couldn't load trace %s: %s\n",argv[2],strerror(errno));
+		return 1;
+	}
+
+	//a policy that looks ahead needs the next use after every event, made once for every number of frames
+	if(policy->on_use && !trace_next_use(t)) {
+		fprintf(stderr,"couldn't index trace %s: %s\n",argv[2],strerror(errno));
+		return 1;
+	}
+
+	int nframes;
+	for(nframes=first;nframes<=last;nframes++) {
+		if(!replay_one(t,policy,nframes,first==last)) {
+			fprintf(stderr,"couldn't start the %s policy: out of memory\n",policy->name);
+			return 1;
+		}
+	}
+
+	trace_delete(t);
+	return 0;
+}
+
+int main( int argc, char *argv[] )
+{
+	if(argc>=2 && !strcmp(argv[1],"record")) return record(argc,argv);
+	if(argc>=2 && !strcmp(argv[1],"replay")) return replay(argc,argv);
+
+	show_help();
+	return 1;
+}